@@ -73,9 +73,6 @@
 */
 
 
-#define DOWNSAMPLE (8)
-static int _downsample_counter = 0;
-
 static kinect_manager_resolution_t resolution = kinect_manager_resolution_640x480;
 
 /* integer char values used to define end of command */
@@ -94,6 +91,8 @@ typedef struct _gl_ghosts {
 	/* Shader variables */
 	const char* vertex_shader_path;
 	const char* fragment_shader_path;
+	const char* spill_path;
+	const char* archive_path;
 
 	float depth_scale;
 	float depth_cutoff;
@@ -143,6 +142,12 @@ static void _depth_cb(
 	void* depth_data,
 	timestamp_t timestamp,
 	void* user_data);
+static void* _video_buffer_cb(
+	kinect_manager_handle_t kinect_manager,
+	void* user_data);
+static void* _depth_buffer_cb(
+	kinect_manager_handle_t kinect_manager,
+	void* user_data);
 
 /* command callback */
 static int _command_set(const char* cmd, void* data);
@@ -165,6 +170,8 @@ int main(int argc, const char* argv[]) {
 	};
 	glGhosts.vertex_shader_path = "glsl/vertex.vert";
 	glGhosts.fragment_shader_path = "glsl/fragment.frag";
+	glGhosts.spill_path = "ghosts.spill";
+	glGhosts.archive_path = "archive";
 
 	userData = &glGhosts;
 	/* run main loop */
@@ -198,6 +205,8 @@ int _init(void* data) {
 	kinect_callbacks.video_frame_callback = &_video_cb;
 	kinect_callbacks.depth_ready_callback = NULL;
 	kinect_callbacks.depth_frame_callback = &_depth_cb;
+	kinect_callbacks.video_buffer_callback = &_video_buffer_cb;
+	kinect_callbacks.depth_buffer_callback = &_depth_buffer_cb;
 
 	error = kinect_manager_create(
 		&p_gl_ghosts->kinect_manager,
@@ -306,6 +315,32 @@ int _init(void* data) {
 		LOG_ERROR("failed to init director");
 		return error;
 	}
+	error = director_set_spill_file(
+		p_gl_ghosts->director,
+		p_gl_ghosts->spill_path,
+		1024l * 1024l * 1024l * 16l); // 16 GB
+	if (NO_ERROR != error) {
+		LOG_WARNING("no spill file, old loops will be evicted (%s)", error_string(error));
+	}
+	error = director_set_previews(
+		p_gl_ghosts->director,
+		p_gl_ghosts->depth_stream_properties.width,
+		p_gl_ghosts->depth_stream_properties.height);
+	if (NO_ERROR != error) {
+		LOG_WARNING("motion is detected at full resolution (%s)", error_string(error));
+	}
+	error = director_set_foreground(
+		p_gl_ghosts->director,
+		p_gl_ghosts->depth_stream_properties.width,
+		p_gl_ghosts->depth_stream_properties.height);
+	if (NO_ERROR != error) {
+		LOG_WARNING("loops keep whole frames (%s)", error_string(error));
+	}
+	/* loops from the last run play again before anyone records */
+	error = director_set_archive(p_gl_ghosts->director, p_gl_ghosts->archive_path);
+	if (NO_ERROR != error) {
+		LOG_WARNING("no loop archive (%s)", error_string(error));
+	}
 
 	error = timer_create(&(p_gl_ghosts->playback_timer));
 	if (NO_ERROR != error) {
@@ -356,39 +391,24 @@ void _display(void* data) {
 	status_t   error        = NO_ERROR;
 	gl_ghosts* p_gl_ghosts  = (gl_ghosts*)data;
 	size_t     index        = 0;
-	void*      video_buffer = NULL;
-	void*      depth_buffer = NULL;
-	double     delta        = 0.0;
+	double     play_time    = 0.0;
 	director_frame_layers_t layers;
 
-	/* This was added to speed things up by skipping frames. 
-	 * TODO: is there a better way to make sure that playback does not slow
-	 * down? */
-	_downsample_counter++;
-	if ((_downsample_counter % DOWNSAMPLE) != 0) {
-		return;
-	}
 	if (p_gl_ghosts == NULL) {
 		LOG_ERROR("null pointer");
 		return;
 	}
 
-	/* get time since last callback */
-	/* TODO: what does director expect?  A delta? */
-	error = timer_current(p_gl_ghosts->playback_timer, &delta);
+	/* time since playback started, the director keeps the loops' pace */
+	error = timer_current(p_gl_ghosts->playback_timer, &play_time);
 	if (0 != error) {
 		LOG_ERROR("error getting playback time");
 		return; 
 	}
-	error = timer_reset(p_gl_ghosts->playback_timer);
-	if (0 != error) {
-		LOG_ERROR("error reseting playback time");
-		return; 
-	}
 
 	error = director_playback_layers(
 		p_gl_ghosts->director,
-		delta,
+		play_time,
 		&layers);
 	if (0 != error) {
 		LOG_ERROR("error getting playback layers");
@@ -399,13 +419,12 @@ void _display(void* data) {
 	error = display_manager_prepare_frame(p_gl_ghosts->display_manager);
 	if (NO_ERROR != error) {
 		LOG_ERROR("error preparing frame");
+		director_release_layers(p_gl_ghosts->director, &layers);
 		return; 
 	}
 
 	/* loop through clips adding image data to opengl */
 	for (index = 0; index < layers.layer_count; index++) {
-		video_buffer = NULL;
-		depth_buffer = NULL;
 		error = display_manager_set_frame_layer(
 			p_gl_ghosts->display_manager,
 			layers.depth_cutoffs[index],
@@ -415,32 +434,34 @@ void _display(void* data) {
 			LOG_ERROR("error setting frame layer");
 		}
 	}
-	/* display live data */
-	error = kinect_manager_live_video(
-		p_gl_ghosts->kinect_manager,
-		&video_buffer);
-	if (NO_ERROR != error) {
-		LOG_ERROR("failed to get live video frame");
-	}
-	error = kinect_manager_live_depth(
-		p_gl_ghosts->kinect_manager,
-		&depth_buffer);
-	if (NO_ERROR != error) {
-		LOG_ERROR("failed to get live video frame");
+	/* display live data.  the newest captured frame is pinned by the
+	 * director like the loop frames, so it is not copied anywhere */
+	error = director_live_layer(p_gl_ghosts->director, &layers);
+	if (NO_ERROR == error) {
+		index = layers.layer_count - 1;
+		error = display_manager_set_frame_layer(
+			p_gl_ghosts->display_manager,
+			p_gl_ghosts->depth_cutoff,
+			layers.video_layers[index],
+			layers.depth_layers[index]);
+		if (NO_ERROR != error) {
+			LOG_ERROR("error setting frame layer");
+		}
 	}
-	error = display_manager_set_frame_layer(
-		p_gl_ghosts->display_manager,
-		p_gl_ghosts->depth_cutoff,
-		video_buffer,
-		depth_buffer);
-	if (NO_ERROR != error) {
-		LOG_ERROR("error setting frame layer");
+	else if (ERR_EMPTY != error) {
+		LOG_ERROR("failed to get live frame");
 	}
 
 	error = display_manager_display_frame(p_gl_ghosts->display_manager);
 	if (NO_ERROR != error) {
 		LOG_ERROR("error displaying frame");
 	}
+
+	/* layer data has been handed to opengl, the frames can be evicted now */
+	error = director_release_layers(p_gl_ghosts->director, &layers);
+	if (NO_ERROR != error) {
+		LOG_ERROR("error releasing playback layers");
+	}
 }
 
 void _reshape(int width, int height, void* data) {
@@ -674,6 +695,39 @@ void _depth_cb(
 	*/
 }
 
+void* _video_buffer_cb(
+	kinect_manager_handle_t kinect_manager,
+	void* user_data)
+{
+	gl_ghosts* p_ghosts = (gl_ghosts*)user_data;
+	void* buffer = NULL;
+
+	if ((NULL == p_ghosts) || (NULL == p_ghosts->director)) {
+		return NULL;
+	}
+	/* on failure the kinect manager falls back to its own buffer */
+	if (NO_ERROR != director_video_target(p_ghosts->director, &buffer)) {
+		return NULL;
+	}
+	return buffer;
+}
+
+void* _depth_buffer_cb(
+	kinect_manager_handle_t kinect_manager,
+	void* user_data)
+{
+	gl_ghosts* p_ghosts = (gl_ghosts*)user_data;
+	void* buffer = NULL;
+
+	if ((NULL == p_ghosts) || (NULL == p_ghosts->director)) {
+		return NULL;
+	}
+	if (NO_ERROR != director_depth_target(p_ghosts->director, &buffer)) {
+		return NULL;
+	}
+	return buffer;
+}
+
 void _cleanup(void* data) {
 	gl_ghosts* p_gl_ghosts = (gl_ghosts*)data;
 	if (p_gl_ghosts == NULL) {
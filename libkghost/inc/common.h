@@ -28,6 +28,8 @@
 #define ERR_DEVICE_ERROR (-14)
 #define ERR_UNSUPPORTED_ARCHITECTURE (-15)
 #define ERR_UNSUPPORTED_FORMAT (-16)
+// a file could not be opened, written or mapped
+#define ERR_IO_ERROR (-17)
 
 
 #include <stddef.h>
@@ -44,6 +44,7 @@
 */
 
 #include "common.h"
+#include "worker_pool.h"
 
 #define DIRECTOR_MAX_LAYERS (64)
 
@@ -52,13 +53,45 @@ extern "C" {
 #endif
 	typedef struct director_s* director_handle_t;
 
+	typedef struct director_analysis_stats_s {
+		/* frames handed to the analysis thread, and those dropped because
+		 * it was a whole queue behind */
+		size_t queued_frames;
+		size_t dropped_frames;
+		/* the most frames that were waiting at once */
+		size_t max_queued_frames;
+		size_t analysed_frames;
+	} director_analysis_stats_t;
+
+	/* what eviction knows about a loop */
+	typedef struct director_loop_stats_s {
+		/* seconds since the loop was published, or first archived */
+		double age_seconds;
+		/* seconds since it last started playing, its age if it never did */
+		double idle_seconds;
+		size_t play_count;
+		/* mean presence of the frames it was recorded with */
+		double presence;
+		/* what its frames take in the frame store */
+		size_t bytes;
+		size_t frame_count;
+	} director_loop_stats_t;
+
+	/* loops with the lowest rank are evicted first */
+	typedef double (*director_eviction_rank_t)(const director_loop_stats_t* p_stats);
+
 	typedef struct director_frame_layers_s {
 		void* video_layers[DIRECTOR_MAX_LAYERS];
 		void* depth_layers[DIRECTOR_MAX_LAYERS];
 		float depth_cutoffs[DIRECTOR_MAX_LAYERS];
+		/* frame_store frames pinned until director_release_layers */
+		struct frame_s* frames[DIRECTOR_MAX_LAYERS];
 		size_t layer_count;
 	} director_frame_layers_t;
 
+	/* max_bytes is split in half: one half holds raw frames, so only about
+	 * max_bytes / 2 / (video + depth frame bytes) can be captured or decoded
+	 * at once, and the other half holds finished loops compressed */
 	status_t director_create(
 		size_t max_layers,
 		size_t max_bytes, 
@@ -72,11 +105,27 @@ extern "C" {
 
 	//TODO: get/set status_t director_set_*
 
+	/* the frames each layer shows at play_time, seconds on a clock that
+	 * only moves forward.  Loops play at the rate they were recorded at
+	 * however often this is called.  Call from one thread only, it never
+	 * waits for loops being published or evicted. */
 	status_t director_playback_layers(
 		director_handle_t handle, 
 		timestamp_t play_time, 
 		director_frame_layers_t* p_layers);
 
+	/* unpins the frames of p_layers once they are no longer displayed */
+	status_t director_release_layers(
+		director_handle_t handle, 
+		director_frame_layers_t* p_layers);
+
+	/* adds the newest captured frame to p_layers as one more layer, pinned
+	 * like the others until director_release_layers.  ERR_EMPTY before
+	 * anything has been captured. */
+	status_t director_live_layer(
+		director_handle_t handle, 
+		director_frame_layers_t* p_layers);
+
 	status_t director_capture_video(
 		director_handle_t handle,
 		void* data,
@@ -88,6 +137,75 @@ extern "C" {
 		float cutoff,
 		timestamp_t timestamp);
 
+	/* capture only stores frames and queues them for the director's
+	 * analysis thread, these count how that keeps up */
+	status_t director_analysis_stats(
+		director_handle_t handle, 
+		director_analysis_stats_t* p_stats);
+
+	/* finished loops are compressed and archived as jobs on the director's
+	 * worker threads, these time them */
+	status_t director_job_stats(
+		director_handle_t handle, 
+		worker_pool_stats_t* p_stats);
+
+	/* where the device should write its next video or depth frame so it is
+	 * captured without a copy, see frame_store_video_target */
+	status_t director_video_target(director_handle_t handle, void** p_data);
+
+	status_t director_depth_target(director_handle_t handle, void** p_data);
+
+	/* once memory is full, loops that are not playing are moved to a spill
+	 * file of up to max_bytes at path before any are evicted */
+	status_t director_set_spill_file(
+		director_handle_t handle, 
+		const char* path, 
+		size_t max_bytes);
+
+	/* checks frames for motion on quarter resolution previews of their
+	 * depth instead of the full frames.  width and height are those of the
+	 * video and depth frames.  Call before capturing. */
+	status_t director_set_previews(
+		director_handle_t handle, 
+		size_t width, 
+		size_t height);
+
+	/* compresses loops keeping only the part of each frame nearer than
+	 * its cutoff, see frame_store_enable_foreground.  width and height are
+	 * those of the video and depth frames.  Call before capturing. */
+	status_t director_set_foreground(
+		director_handle_t handle, 
+		size_t width, 
+		size_t height);
+
+	/* replaces every depth pixel of each finished loop with the median of
+	 * it and the same pixel in the frames either side, before the loop is
+	 * compressed.  16 bit depth only.  Off by default. */
+	status_t director_set_depth_filter(director_handle_t handle, bool_t enabled);
+
+	/* picks which loops that are not playing are evicted first, and
+	 * evicts them whenever the loops kept take more than max_loop_bytes as
+	 * well as when capture runs out of frames.  0 for no budget.  By
+	 * default the oldest loops go and there is no budget. */
+	status_t director_set_eviction(
+		director_handle_t handle, 
+		director_eviction_rank_t rank, 
+		size_t max_loop_bytes);
+
+	/* the oldest loop first */
+	double director_rank_oldest(const director_loop_stats_t* p_stats);
+
+	/* the loop that has gone longest without playing first */
+	double director_rank_lru(const director_loop_stats_t* p_stats);
+
+	/* presence over plays: faint loops and loops that have played often
+	 * go first */
+	double director_rank_score(const director_loop_stats_t* p_stats);
+
+	/* restores the loops archived in dir, creating it if need be, and
+	 * archives every new loop there from now on */
+	status_t director_set_archive(director_handle_t handle, const char* dir);
+
 	/* TODO: settings
 	   - contraints on marking start & end of clip
 	   - constraints on quantizing loops
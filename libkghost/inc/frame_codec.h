@@ -0,0 +1,91 @@
+#ifndef _frame_codec_h_
+#define _frame_codec_h_
+
+#include "common.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/** \addtogroup frame_codec
+	 *  @{
+	 */
+
+	/* Depth is coded losslessly.  Each pixel becomes the zigzagged
+	 * difference to the previous one written as a varint, and a zero
+	 * difference is followed by the number of further zero differences, so
+	 * the large empty and flat regions kinect depth has cost a few bytes. */
+
+	/* largest number of bytes frame_codec_encode_depth can write */
+	size_t frame_codec_depth_bound(size_t pixel_count);
+
+	status_t frame_codec_encode_depth(
+		const unsigned short* depth,
+		size_t pixel_count,
+		unsigned char* data,
+		size_t* p_size);
+
+	status_t frame_codec_decode_depth(
+		const unsigned char* data,
+		size_t size,
+		unsigned short* depth,
+		size_t pixel_count);
+
+	/* RGB video is converted to YCoCg, keeping luma for every pixel and
+	 * one chroma pair for every four pixels of a row (4:1:1).  This halves
+	 * the size at a fixed cost and only loses colour detail. */
+
+	/* number of bytes frame_codec_encode_video writes */
+	size_t frame_codec_video_size(size_t pixel_count);
+
+	status_t frame_codec_encode_video(
+		const unsigned char* rgb,
+		size_t pixel_count,
+		unsigned char* data);
+
+	status_t frame_codec_decode_video(
+		const unsigned char* data,
+		size_t pixel_count,
+		unsigned char* rgb);
+
+	/* A frame is its coded depth followed by its video, of which only the
+	 * pixels mask marks are kept.  Which ones those are is coded as runs
+	 * of dropped and kept pixels, the kept ones are then coded as above as
+	 * if they were next to each other, and dropped pixels decode as black.
+	 * A NULL mask keeps every pixel, otherwise video and depth have to have
+	 * as many pixels. */
+
+	/* largest number of bytes frame_codec_encode_frame can write */
+	size_t frame_codec_frame_bound(size_t video_pixels, size_t depth_pixels);
+
+	status_t frame_codec_encode_frame(
+		const unsigned char* rgb,
+		size_t video_pixels,
+		const unsigned short* depth,
+		size_t depth_pixels,
+		const unsigned char* mask,
+		unsigned char* data,
+		size_t* p_size);
+
+	/* checks how a coded frame is laid out without decoding it,
+	 * ERR_UNSUPPORTED_FORMAT if it is not a whole frame */
+	status_t frame_codec_check_frame(
+		const unsigned char* data,
+		size_t size,
+		size_t video_pixels);
+
+	status_t frame_codec_decode_frame(
+		const unsigned char* data,
+		size_t size,
+		unsigned char* rgb,
+		size_t video_pixels,
+		unsigned short* depth,
+		size_t depth_pixels);
+
+	/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,23 @@
 
 #include <libfreenect/libfreenect.h>
 
+/* frame_store_create flags */
+/* each frame is one chunk holding video, depth and meta */
+#define FRAME_STORE_INTERLEAVED (0)
+/* video and depth are kept in pools of their own, so scanning the depth of
+ * many frames does not pull their video through the cache */
+#define FRAME_STORE_PLANAR (1)
+/* planar, and stored frames can be compressed with
+ * frame_store_compress_frame.  Half of max_bytes holds compressed frames,
+ * the other half the planes of raw and expanded ones.  Needs RGB video and
+ * 16 bit depth. */
+#define FRAME_STORE_COMPRESSED (2)
+
+/* frame_store_preview_frame levels, each halves the resolution */
+#define FRAME_STORE_PREVIEW_HALF (1)
+#define FRAME_STORE_PREVIEW_QUARTER (2)
+#define FRAME_STORE_PREVIEW_LEVELS (2)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -68,12 +85,57 @@ extern "C" {
 
 	extern const frame_id_t invalid_frame_id;
 	typedef struct frame_store_s* frame_store_handle_t;
+	/* a stored frame pinned by frame_store_acquire_frame */
+	typedef struct frame_s* frame_handle_t;
+
+	typedef struct frame_store_compression_stats_s {
+		/* frames held compressed, whether expanded or not, and the bytes of
+		 * their video and depth before and after compression */
+		size_t compressed_frames;
+		size_t raw_bytes;
+		size_t compressed_bytes;
+		/* the part of the above kept on disk, in the spill file or in
+		 * restored frames */
+		size_t spilled_frames;
+		size_t spilled_bytes;
+		/* every frame compressed or decoded so far and the time it took */
+		size_t encoded_frames;
+		double encode_seconds;
+		size_t decoded_frames;
+		double decode_seconds;
+		/* frames whose compressed data frame_store_pack_frames moved */
+		size_t packed_frames;
+	} frame_store_compression_stats_t;
+
+	typedef struct frame_store_capture_stats_s {
+		/* frames stored with all their planes */
+		size_t completed_frames;
+		/* frames dropped before they were complete to make room for newer
+		 * ones */
+		size_t dropped_frames;
+		/* planes that arrived after a newer frame had been started, which
+		 * counts the skew between the streams */
+		size_t late_planes;
+		/* planes captured again for the same timestamp, the later copy is
+		 * kept */
+		size_t repeated_planes;
+		/* frames still being assembled */
+		size_t pending_frames;
+	} frame_store_capture_stats_t;
+
+	/* called from the memory pool's thread, never from inside a capture,
+	 * with the number of frames that should be removed */
+	typedef void (*frame_store_pressure_cb_t)(
+		frame_store_handle_t handle,
+		size_t shortfall_frames,
+		void* user_data);
 
 	status_t frame_store_create(
 		size_t video_bytes,
 		size_t depth_bytes,
 		size_t meta_bytes,
 		size_t max_bytes,
+		unsigned int flags,
 		frame_store_handle_t* p_handle);
 
 	void frame_store_release(frame_store_handle_t handle);
@@ -120,6 +182,225 @@ extern "C" {
 		frame_store_handle_t handle,
 		frame_id_t frame_id);
 
+	/* removes every frame in frame_ids, continuing past (and reporting)
+	 * ids that are invalid or already removed */
+	status_t frame_store_remove_frames(
+		frame_store_handle_t handle,
+		size_t count,
+		const frame_id_t* frame_ids);
+
+	/* the newest frame captured at or before timestamp.  ERR_EMPTY if
+	 * there is none. */
+	status_t frame_store_find_by_time(
+		frame_store_handle_t handle,
+		timestamp_t timestamp,
+		frame_id_t* p_frame_id);
+
+	/* enumerates the frames with low <= timestamp <= high, newest first,
+	 * the way rb_tree_enumerate does.  Start with *p_cursor NULL; it comes
+	 * back NULL once there are no more.  Adding or removing frames ends an
+	 * enumeration. */
+	status_t frame_store_enumerate_by_time(
+		frame_store_handle_t handle,
+		timestamp_t low,
+		timestamp_t high,
+		void** p_cursor,
+		frame_id_t* p_frame_id);
+
+	/* pins a frame so its data stays valid, even if it is removed, until
+	 * frame_store_release_frame.  Like the other calls this needs the
+	 * caller's store lock; release does not. */
+	status_t frame_store_acquire_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id,
+		frame_handle_t* p_frame);
+
+	status_t frame_store_release_frame(
+		frame_store_handle_t handle,
+		frame_handle_t frame);
+
+	/* pins a frame the caller already has pinned once more, which needs
+	 * no lock, so it can be handed to another user */
+	status_t frame_store_retain_frame(
+		frame_store_handle_t handle,
+		frame_handle_t frame);
+
+	/* data of a pinned frame, any output may be NULL */
+	status_t frame_store_frame_data(
+		frame_store_handle_t handle,
+		frame_handle_t frame,
+		void** p_video,
+		void** p_depth,
+		void** p_meta,
+		timestamp_t* p_timestamp);
+
+	/* planes are matched up by timestamp, so a frame is stored once all of
+	 * them have been captured even if planes of later frames came in
+	 * between */
+	status_t frame_store_capture_stats(
+		frame_store_handle_t handle,
+		frame_store_capture_stats_t* p_stats);
+
+	/* planes whose timestamps are at most tolerance apart can make up one
+	 * frame, each going to the pending frame nearest it in time.  The
+	 * frame keeps the timestamp of its first plane.  0, the default,
+	 * matches timestamps exactly. */
+	status_t frame_store_set_capture_tolerance(
+		frame_store_handle_t handle,
+		timestamp_t tolerance);
+
+	/* where a device should write its next video or depth frame so that
+	 * capturing it needs no copy.  ERR_EMPTY when no frame could be claimed,
+	 * in which case captured data is copied as usual. */
+	status_t frame_store_video_target(
+		frame_store_handle_t handle,
+		void** p_data);
+
+	status_t frame_store_depth_target(
+		frame_store_handle_t handle,
+		void** p_data);
+
+	/* compresses a stored frame and hands its planes back, or keeps them
+	 * while the frame is pinned.  Its video and depth are then unavailable
+	 * (NULL from frame_store_frame_data, ERR_EMPTY from
+	 * frame_store_video_frame and frame_store_depth_frame) until
+	 * frame_store_expand_frame.  ERR_FULL once the compressed half of the
+	 * budget is used up. */
+	status_t frame_store_compress_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id);
+
+	/* Foreground compression keeps only the part of a frame the display
+	 * can show: pixels with a depth of at most max_depth and those within
+	 * margin pixels of them, the rest of the video and depth expand as
+	 * zero.  width and height are those of the frames. */
+	status_t frame_store_enable_foreground(
+		frame_store_handle_t handle,
+		size_t width,
+		size_t height,
+		size_t margin);
+
+	/* frame_store_compress_frame keeping only the foreground.  ERR_EMPTY
+	 * unless frame_store_enable_foreground was called. */
+	status_t frame_store_compress_foreground(
+		frame_store_handle_t handle,
+		frame_id_t frame_id,
+		unsigned short max_depth);
+
+	/* decodes a compressed frame into planes of its own again, keeping the
+	 * compressed copy.  Does nothing for frames that have their planes. */
+	status_t frame_store_expand_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id);
+
+	/* drops the planes of an expanded frame.  p_shrunk is FALSE if the
+	 * frame is pinned and has to keep them for now. */
+	status_t frame_store_shrink_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id,
+		bool_t* p_shrunk);
+
+	status_t frame_store_compression_stats(
+		frame_store_handle_t handle,
+		frame_store_compression_stats_t* p_stats);
+
+	/* Compressed frames can be moved out of memory into a spill file at
+	 * path, created for the store and unlinked straight away, that grows
+	 * to at most max_bytes.  Frames are appended to it and read back
+	 * through a mapping, so only the pages being decoded are resident. */
+	status_t frame_store_enable_spill(
+		frame_store_handle_t handle,
+		const char* path,
+		size_t max_bytes);
+
+	/* writes a compressed frame to the spill file and frees its memory.
+	 * ERR_FULL once the file has no room left. */
+	status_t frame_store_spill_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id);
+
+	/* starts reading a spilled frame back in, so a later
+	 * frame_store_expand_frame does not wait on the disk.  Does nothing
+	 * for frames in memory. */
+	status_t frame_store_prefetch_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id);
+
+	/* moves the compressed data of the frames into one allocation, in
+	 * the order given, so reading them in that order is sequential.  Frames
+	 * that are not compressed or are on disk are left as they are.  The
+	 * allocation goes once every frame in it has been removed or spilled. */
+	status_t frame_store_pack_frames(
+		frame_store_handle_t handle,
+		size_t count,
+		const frame_id_t* frame_ids);
+
+	/* the compressed video and depth of a frame, valid until the frame is
+	 * removed, spilled, packed or the caller's lock is dropped.  ERR_EMPTY
+	 * if the frame is not compressed. */
+	status_t frame_store_compressed_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id,
+		const void** p_data,
+		size_t* p_size,
+		timestamp_t* p_timestamp);
+
+	/* stores a frame from data frame_store_compressed_frame gave out
+	 * before, such as a loop archive mapped back in.  The data is used in
+	 * place and has to stay valid until the frame is removed. */
+	status_t frame_store_restore_frame(
+		frame_store_handle_t handle,
+		const void* data,
+		size_t size,
+		const void* meta,
+		timestamp_t timestamp,
+		frame_id_t* p_frame_id);
+
+	/* Frames can carry half and quarter resolution copies of their depth
+	 * and video, made as they are captured, for analysis that does not
+	 * need every pixel.  A depth preview pixel is the nearest valid depth
+	 * of the block it covers, a video preview pixel its average.  width
+	 * and height are those of the full frames, RGB video and 16 bit depth.
+	 * Previews go when the frame's planes do, see
+	 * frame_store_compress_frame. */
+	status_t frame_store_enable_previews(
+		frame_store_handle_t handle,
+		size_t width,
+		size_t height);
+
+	/* ERR_EMPTY unless previews are enabled */
+	status_t frame_store_preview_size(
+		frame_store_handle_t handle,
+		unsigned int level,
+		size_t* p_width,
+		size_t* p_height);
+
+	/* a frame's previews at FRAME_STORE_PREVIEW_HALF or
+	 * FRAME_STORE_PREVIEW_QUARTER, either output may be NULL.  ERR_EMPTY if
+	 * the frame has none. */
+	status_t frame_store_preview_frame(
+		frame_store_handle_t handle,
+		frame_id_t frame_id,
+		unsigned int level,
+		void** p_video,
+		void** p_depth);
+
+	/* makes a frame's previews again after its planes were changed in
+	 * place.  ERR_EMPTY if it has no previews or no planes to make them
+	 * from. */
+	status_t frame_store_update_previews(
+		frame_store_handle_t handle,
+		frame_id_t frame_id);
+
+	/* calls callback whenever fewer than pressure_frames frames could still
+	 * be captured.  A NULL callback removes it; once this returns the old
+	 * callback is no longer running. */
+	status_t frame_store_set_pressure_callback(
+		frame_store_handle_t handle,
+		size_t pressure_frames,
+		frame_store_pressure_cb_t callback,
+		void* user_data);
+
 	/** @} */
 
 #ifdef __cplusplus
@@ -53,6 +53,14 @@ extern "C" {
 			void* depth_data, 
 			timestamp_t timestamp,
 			void* user_data);
+		/* optional.  return where the device should write its next frame,
+		 * or NULL to use the manager's own buffer */
+		void* (*video_buffer_callback)(
+			kinect_manager_handle_t handle,
+			void* user_data);
+		void* (*depth_buffer_callback)(
+			kinect_manager_handle_t handle,
+			void* user_data);
 	} kinect_callbacks_t;
 
 
@@ -70,6 +78,8 @@ extern "C" {
 		void* p_data,
 		size_t data_size);
 
+	/* the manager's own buffers, which only hold the newest frames when
+	 * no buffer callback gives the device somewhere else to write them */
 	status_t kinect_manager_live_video(
 		kinect_manager_handle_t handle,
 		void** pp_data);
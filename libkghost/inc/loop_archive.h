@@ -0,0 +1,95 @@
+#ifndef _loop_archive_h_
+#define _loop_archive_h_
+
+#include "common.h"
+#include <stddef.h>
+
+/* Each archived loop is a file of its own: a header, an index entry per
+ * frame and then the frames as frame_store_compress_frame left them.  It is
+ * written under a temporary name and renamed when complete, so a crash
+ * never leaves a half written loop behind, and it is read back by mapping
+ * it, so opening a loop only touches its header and index. */
+#define LOOP_ARCHIVE_VERSION (2)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/** \addtogroup loop_archive
+	 *  @{
+	 */
+
+	typedef struct loop_archive_s* loop_archive_handle_t;
+	typedef struct loop_archive_writer_s* loop_archive_writer_handle_t;
+
+	typedef struct loop_archive_info_s {
+		unsigned version;
+		/* raw frame sizes the loop was recorded with */
+		size_t video_bytes;
+		size_t depth_bytes;
+		size_t frame_count;
+		/* bytes of compressed frame data */
+		size_t data_bytes;
+		timestamp_t first_timestamp;
+		timestamp_t last_timestamp;
+		/* seconds since the epoch when the loop was archived */
+		double archived_time;
+		/* how much of the frames the recorded person filled on average,
+		 * see loop_archive_writer_set_presence */
+		double presence;
+	} loop_archive_info_t;
+
+	/* starts a loop of frame_count frames that becomes path once
+	 * loop_archive_writer_finish succeeds */
+	status_t loop_archive_writer_create(
+		const char* path,
+		size_t video_bytes,
+		size_t depth_bytes,
+		size_t frame_count,
+		loop_archive_writer_handle_t* p_handle);
+
+	status_t loop_archive_writer_add_frame(
+		loop_archive_writer_handle_t handle,
+		const void* data,
+		size_t size,
+		timestamp_t timestamp,
+		float cutoff);
+
+	/* kept with the loop for whoever decides which loops to keep, 0 if
+	 * never set */
+	status_t loop_archive_writer_set_presence(
+		loop_archive_writer_handle_t handle,
+		double presence);
+
+	/* writes the index, flushes the file to disk and renames it */
+	status_t loop_archive_writer_finish(loop_archive_writer_handle_t handle);
+
+	/* an unfinished loop is deleted */
+	void loop_archive_writer_release(loop_archive_writer_handle_t handle);
+
+	/* maps an archived loop.  ERR_UNSUPPORTED_FORMAT for anything that is
+	 * not a complete loop of a known version. */
+	status_t loop_archive_open(const char* path, loop_archive_handle_t* p_handle);
+
+	/* unmaps the loop, frame data from it must no longer be used */
+	void loop_archive_release(loop_archive_handle_t handle);
+
+	status_t loop_archive_info(
+		loop_archive_handle_t handle,
+		loop_archive_info_t* p_info);
+
+	/* p_data points into the mapping */
+	status_t loop_archive_frame(
+		loop_archive_handle_t handle,
+		size_t index,
+		const void** p_data,
+		size_t* p_size,
+		timestamp_t* p_timestamp,
+		float* p_cutoff);
+
+	/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
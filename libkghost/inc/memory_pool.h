@@ -4,23 +4,65 @@
 #include "common.h"
 #include <unistd.h>
 
+/* memory_pool_create flags */
+/* allocate each chunk with malloc */
+#define MEMORY_POOL_MALLOC (0)
+/* carve chunks from one mapping reserved for maxBytes */
+#define MEMORY_POOL_ARENA (1)
+/* back the arena with huge pages where the system provides them */
+#define MEMORY_POOL_HUGE_PAGES (2)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 	typedef struct memory_pool_s* memory_pool_handle_t;
 
+	/* called from the pool's generator thread with the number of chunks
+	 * that would have to be unclaimed to get back to the pressure level */
+	typedef void (*memory_pool_pressure_cb_t)(
+		memory_pool_handle_t handle,
+		size_t shortfall_chunks,
+		void* user_data);
+
 	status_t memory_pool_create(
 		size_t chunkSize, 
 		size_t minReserveChunks, 
 		size_t maxReserveChunks,
 		size_t maxBytes,
 		useconds_t periodMicroseconds,
+		unsigned int flags,
 		memory_pool_handle_t* p_handle);
 	status_t memory_pool_release(memory_pool_handle_t handle);
 	status_t memory_pool_claim(memory_pool_handle_t handle, void** data);
 	status_t memory_pool_unclaim(memory_pool_handle_t handle, void* data);
 
+	/* claims count chunks into data, or none at all if the pool cannot
+	 * supply every one of them */
+	status_t memory_pool_claim_batch(
+		memory_pool_handle_t handle, 
+		size_t count, 
+		void** data);
+	/* unclaims count chunks; invalid entries are skipped and reported */
+	status_t memory_pool_unclaim_batch(
+		memory_pool_handle_t handle, 
+		size_t count, 
+		void** data);
+
+	/* calls callback whenever fewer than pressureChunks chunks could still be
+	 * claimed, counting those not generated yet.  A NULL callback removes it;
+	 * once this returns the old callback is no longer running. */
+	status_t memory_pool_set_pressure_callback(
+		memory_pool_handle_t handle,
+		size_t pressureChunks,
+		memory_pool_pressure_cb_t callback,
+		void* userData);
+
+	/* number of claims that returned ERR_EMPTY since the pool was created */
+	status_t memory_pool_empty_claim_count(
+		memory_pool_handle_t handle, 
+		size_t* p_count);
+
 #ifdef __cplusplus
 }
 #endif
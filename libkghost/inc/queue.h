@@ -0,0 +1,43 @@
+#ifndef _queue_h_
+#define _queue_h_
+
+#include "common.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/** \addtogroup queue
+	 * @{
+	 */
+
+	/* A bounded FIFO between exactly one thread that pushes and one that
+	 * pops.  Neither side takes a lock or waits on the other, so the
+	 * pushing thread can be one that must never block.  Pushing to a full
+	 * queue fails rather than overwriting. */
+	typedef struct queue_s* queue_handle_t;
+
+	status_t queue_create(
+		size_t capacity,
+		size_t element_size,
+		queue_handle_t* p_handle);
+
+	void queue_release(queue_handle_t handle);
+
+	/* ERR_FULL if capacity elements are queued */
+	status_t queue_push(queue_handle_t handle, const void* p_element);
+
+	/* the oldest element, ERR_EMPTY if there is none */
+	status_t queue_pop(queue_handle_t handle, void* p_element);
+
+	/* exact for the calling side, a snapshot for anyone else */
+	status_t queue_count(queue_handle_t handle, size_t* p_count);
+
+	/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _worker_pool_h_
+#define _worker_pool_h_
+
+#include "common.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/** \addtogroup worker_pool
+	 * @{
+	 */
+
+	/* A fixed set of threads that run jobs from a queue in the order they
+	 * were submitted.  The threads live as long as the pool does, and
+	 * releasing the pool runs every job still queued before joining
+	 * them. */
+	typedef struct worker_pool_s* worker_pool_handle_t;
+
+	typedef void (*worker_pool_job_t)(void* data);
+
+	typedef struct worker_pool_stats_s {
+		size_t submitted_jobs;
+		size_t completed_jobs;
+		/* from submission until the job returned, summed over the
+		 * completed jobs, and the longest of them */
+		double latency_seconds;
+		double max_latency_seconds;
+		/* the part of latency_seconds jobs spent running */
+		double run_seconds;
+	} worker_pool_stats_t;
+
+	status_t worker_pool_create(
+		size_t thread_count,
+		size_t max_jobs,
+		worker_pool_handle_t* p_handle);
+
+	/* runs the queued jobs, then joins the threads */
+	void worker_pool_release(worker_pool_handle_t handle);
+
+	/* queues job to be called with data on one of the threads.  ERR_FULL
+	 * if max_jobs are waiting already. */
+	status_t worker_pool_submit(
+		worker_pool_handle_t handle,
+		worker_pool_job_t job,
+		void* data);
+
+	status_t worker_pool_stats(
+		worker_pool_handle_t handle,
+		worker_pool_stats_t* p_stats);
+
+	/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
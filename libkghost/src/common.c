@@ -33,6 +33,8 @@ const char* error_string(status_t code) {
 			return "failed timer";
 		case ERR_DEVICE_ERROR:
 			return "device error";
+		case ERR_IO_ERROR:
+			return "io error";
 	}
 	return "unhandled error";
 }
@@ -2,28 +2,139 @@
 #include "frame_store.h"
 #include "vector.h"
 #include "motion_detector.h"
+#include "loop_archive.h"
+#include "queue.h"
+#include "worker_pool.h"
 #include "log.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
-/* TODO: add way to remove a loop */
 /* TODO: loops could be more musical.  simple loop logic should do */
 
+/* frames of headroom kept free for capture, about four seconds at 30fps.
+ * below this the director evicts its oldest loops. */
+#define DIRECTOR_PRESSURE_FRAMES (128)
+
+/* Finished loops are compressed by the thread that publishes them.  The
+ * decode thread keeps the next DIRECTOR_DECODE_AHEAD frames of every
+ * playing loop expanded and shrinks frames again once they have been
+ * shown.  Playback only decodes itself when it catches up with it. */
+#define DIRECTOR_DECODE_AHEAD (4)
+
+/* frames of every playing loop read back from the spill file ahead of
+ * decoding, about a second */
+#define DIRECTOR_PREFETCH_AHEAD (30)
+
+/* Finished loops are also written to the archive directory, one
+ * loop_archive file each, and removed from it when they are evicted.  On
+ * startup the loops found there are mapped back in and play straight away,
+ * their frames being read from the files as they are decoded. */
+#define DIRECTOR_ARCHIVE_PATH_BYTES (1024)
+
+/* With director_set_foreground, loops only keep what the display shows:
+ * pixels nearer than their frame's cutoff plus the fade the shader adds to
+ * it, and a margin of twice the radius the shader blurs depth over so the
+ * blurred edges still find the same neighbours. */
+#define DIRECTOR_FOREGROUND_MARGIN (16)
+#define DIRECTOR_CUTOFF_FADE (0.01f)
+
+/* Loops play back at the rate they were recorded at, whatever the rate
+ * playback is asked for frames.  A loop's playhead is the time since it
+ * started playing and selects the last frame recorded at or before it, so
+ * frames are held or skipped as needed.  The last frame is held for as
+ * long as an average one, or for this long in a loop of one frame. */
+#define DIRECTOR_FRAME_SECONDS (1.0 / 30.0)
+
+/* Capture only stores frames and queues their ids, the analysis thread
+ * runs them through the motion detector and builds loops from them.  The
+ * queue holds about a second of frames.  When it is full the frame is
+ * dropped and counted, capture never waits for analysis. */
+#define DIRECTOR_ANALYSIS_QUEUE (32)
+
+/* Finished loops are compressed, packed and archived as jobs on a pool of
+ * worker threads that lives as long as the director.  Two let one loop be
+ * written to disk while the next is compressed. */
+#define DIRECTOR_WORKERS (2)
+#define DIRECTOR_MAX_JOBS (16)
+
+/* what a loop keeps of each of its frames, next to each other so playback
+ * finds all of it in one place.  The frame's data is looked up in the
+ * store every time since compression, decoding and spilling move it. */
+typedef struct loop_frame_s {
+	frame_id_t frame_id;
+	timestamp_t timestamp;
+	float cutoff;
+	/* scored when the loop is trimmed, 0 for restored loops */
+	float presence;
+	float motion;
+} loop_frame_t;
 
 /* loops hold series of frames that can be repeated */
 typedef struct loop_s {
-	vector_handle_t video_addresses;
-	vector_handle_t depth_addresses;
-	vector_handle_t cutoffs;
-	vector_handle_t frame_ids;
+	/* of loop_frame_t */
+	vector_handle_t frames;
+	/* the frame at the playhead, shown until the playhead passes it */
 	size_t next_frame;
 	size_t frame_count;
+	/* play_time the loop started playing at, negative while it is not */
+	timestamp_t play_start;
+	/* moved to the frame store's spill file */
+	bool_t spilled;
+	/* number of the loop's archive file, 0 if it has none */
+	size_t archive_serial;
+	/* restored loops use the frame data in their mapped file */
+	loop_archive_handle_t archive;
+	/* see director_loop_stats_t, times are _director_seconds */
+	double created_time;
+	double last_played;
+	size_t play_count;
+	double presence;
+	size_t bytes;
 } loop_t;
 
 static status_t _loop_create(loop_t** pp_loop);
 static void _loop_release(loop_t* p_loop);
+static status_t _loop_frame_ids(loop_t* p_loop, frame_id_t** p_frame_ids);
+
+/* Playback never takes loops_mutex.  Writers change the loops vector under
+ * it and then publish a copy of it as a new loop list, which playback
+ * picks up at the start of its next pass and only ever reads.  Lists
+ * replaced and loops evicted are retired, and released once playback can
+ * no longer reach them: when a pass started from a newer list, or when it
+ * is between passes and the loop is not on screen. */
+typedef struct loop_list_s {
+	size_t generation;
+	size_t count;
+	loop_t* loops[1];
+} loop_list_t;
+
+typedef struct retired_s {
+	/* of the last list holding it */
+	size_t generation;
+	loop_list_t* list;
+	loop_t* loop;
+} retired_t;
+
+/* a loop picked for the spill file, known by its first frame's id since
+ * the loop may be evicted and its memory reused while it is written */
+typedef struct spill_loop_s {
+	loop_t* loop;
+	frame_id_t first_frame_id;
+	size_t frame_count;
+} spill_loop_t;
+
+static status_t _loop_list_create(
+	vector_handle_t loops, 
+	size_t generation, 
+	loop_list_t** pp_list);
 
 /* director sturcture */
 typedef struct director_s {
@@ -44,28 +155,152 @@ typedef struct director_s {
 	frame_store_handle_t frame_store;
 	vector_handle_t loops;
 	loop_t* p_current_loop;
+	/* see loop_list_t.  retired is guarded by loops_mutex. */
+	loop_list_t* volatile loop_list;
+	vector_handle_t retired;
+	/* only playback touches these */
 	loop_t** playing_loops;
+	size_t reader_generation;
+	/* TRUE while playback is in a pass */
+	volatile int reader_in_pass;
 	motion_detector_handle_t motion_detector;
+	/* frame_store preview level the motion detector runs on, 0 for full
+	 * resolution */
+	unsigned int preview_level;
+	/* pixels of the depth the motion detector is run on */
+	size_t motion_pixel_count;
+	/* see DIRECTOR_FOREGROUND_MARGIN */
+	bool_t foreground;
+	/* see director_set_depth_filter */
+	bool_t depth_filter;
 	pthread_mutex_t loops_mutex;
 	pthread_mutex_t frame_store_mutex;
+
+	/* decode thread, see DIRECTOR_DECODE_AHEAD */
+	pthread_t decode_thread;
+	bool_t decode_thread_running;
+	pthread_mutex_t decode_mutex;
+	pthread_cond_t decode_cond;
+	bool_t decode_requested;
+	bool_t decode_exit;
+	/* frames the decode thread keeps expanded and reads back, only it
+	 * touches these */
+	vector_handle_t expanded_frame_ids;
+	vector_handle_t prefetch_frame_ids;
+	/* frames playback had to expand itself, and what its last pass put
+	 * on screen and from which loop list, guarded by decode_mutex */
+	vector_handle_t late_frame_ids;
+	size_t late_decodes;
+	loop_t* shown_loops[DIRECTOR_MAX_LAYERS];
+	size_t shown_frames[DIRECTOR_MAX_LAYERS];
+	size_t shown_count;
+	size_t shown_generation;
+	/* the newest frame captured, pinned for director_live_layer until a
+	 * newer one replaces it, guarded by frame_store_mutex */
+	frame_handle_t live_frame;
+	frame_id_t live_frame_id;
+
+	/* see DIRECTOR_ARCHIVE_PATH_BYTES, next serial guarded by loops_mutex */
+	char* archive_dir;
+	size_t next_archive_serial;
+
+	/* analysis thread, see DIRECTOR_ANALYSIS_QUEUE.  the thread capture
+	 * is called on is the only one that pushes. */
+	queue_handle_t analysis_queue;
+	pthread_t analysis_thread;
+	bool_t analysis_thread_running;
+	pthread_mutex_t analysis_mutex;
+	pthread_cond_t analysis_cond;
+	bool_t analysis_exit;
+	/* each counter has a single writer, capture or the analysis thread */
+	volatile size_t queued_frames;
+	volatile size_t dropped_frames;
+	volatile size_t max_queued_frames;
+	volatile size_t analysed_frames;
+
+	/* see DIRECTOR_WORKERS */
+	worker_pool_handle_t workers;
+
+	/* see director_set_eviction, guarded by loops_mutex */
+	director_eviction_rank_t eviction_rank;
+	size_t max_loop_bytes;
+	size_t loop_bytes;
 } director_t;
 
 static status_t _director_handle_new_frame(director_t* p_director, frame_id_t frame_id);
+static status_t _director_queue_frame(director_t* p_director, frame_id_t frame_id);
+static void* _director_analysis_thread(void* data);
 static status_t _director_handle_new_loop(director_t* p_director, loop_t* p_loop);
-
-/* thread data used to handle new loops */
-typedef struct thread_data_s {
-	pthread_t thread;
+static status_t _director_publish_loop(director_t* p_director, loop_t* p_loop);
+static void _director_release_loop(director_t* p_director, loop_t* p_loop);
+static size_t _director_evict_loops(
+	director_t* p_director, 
+	size_t shortfall_frames, 
+	loop_t* p_keep, 
+	loop_t** evicted);
+static void _director_enforce_budget(director_t* p_director, loop_t* p_keep);
+static void _director_loop_stats(
+	loop_t* p_loop, 
+	double now, 
+	director_loop_stats_t* p_stats);
+static double _director_seconds(void);
+static void _director_handle_pressure(
+	frame_store_handle_t frame_store,
+	size_t shortfall_frames,
+	void* data);
+static status_t _director_publish_loops(
+	director_t* p_director, 
+	loop_t** evicted, 
+	size_t evicted_count);
+static void _director_reclaim(director_t* p_director);
+static size_t _director_shown_loops(director_t* p_director, loop_t** loops);
+static bool_t _director_find_loop(loop_t** loops, size_t count, loop_t* p_loop);
+static void _director_end_pass(
+	director_t* p_director, 
+	loop_list_t* p_list, 
+	const frame_id_t* late_frame_ids, 
+	size_t late_count);
+static status_t _director_fill_layers(director_t* p_director, loop_list_t* p_list);
+static bool_t _director_advance_loop(loop_t* p_loop, timestamp_t play_time);
+static int _director_motion_cutoff(director_t* p_director, float cutoff);
+static status_t _director_trim_loop(director_t* p_director, loop_t* p_loop);
+static status_t _director_filter_loop(director_t* p_director, loop_t* p_loop);
+static unsigned short _director_median3(
+	unsigned short a, 
+	unsigned short b, 
+	unsigned short c);
+static void _director_compress_loop(director_t* p_director, loop_t* p_loop);
+static void _director_pack_loop(director_t* p_director, loop_t* p_loop);
+static void _director_measure_loop(director_t* p_director, loop_t* p_loop);
+static size_t _director_spill_loops(director_t* p_director, size_t frame_count);
+static void _director_archive_path(
+	director_t* p_director, 
+	size_t serial, 
+	char* path);
+static status_t _director_archive_loop(director_t* p_director, loop_t* p_loop);
+static status_t _director_restore_loop(director_t* p_director, size_t serial);
+static int _director_compare_serials(const void* a, const void* b);
+static void* _director_decode_thread(void* data);
+static void _director_decode_ahead(director_t* p_director);
+static void _director_track_frame(director_t* p_director, frame_id_t frame_id);
+static void _director_set_live_frame(director_t* p_director, frame_id_t frame_id);
+static bool_t _director_find_frame(
+	const frame_id_t* frame_ids, 
+	size_t count, 
+	frame_id_t frame_id);
+
+/* job data used to handle new loops */
+typedef struct job_data_s {
 	director_t* director;
 	loop_t* loop;
-} thread_data_t;
+} job_data_t;
 
-static status_t _thread_data_create(
+static status_t _job_data_create(
 	director_t* p_director,
 	loop_t* p_loop,
-	thread_data_t** pp_td);
-static void _thread_data_release(thread_data_t* p_td);
-static void* _handle_new_loop(void* data);
+	job_data_t** pp_jd);
+static void _job_data_release(job_data_t* p_jd);
+static void _handle_new_loop(void* data);
 
 status_t director_create(
 	size_t max_layers,
@@ -79,6 +314,7 @@ status_t director_create(
 	int pthreadErr = 0;
 	status_t status = NO_ERROR;
 	director_t* p_director = NULL;
+	loop_list_t* p_list = NULL;
 
 	/* check inputs */
 	if (NULL == p_handle) {
@@ -108,20 +344,62 @@ status_t director_create(
 	p_director->invalid_frame_count = 0;
 	p_director->loop_min_frame_count = 10;
 	p_director->is_recording = FALSE;
+	p_director->eviction_rank = &director_rank_oldest;
+	p_director->max_loop_bytes = 0;
 
-	/* create internal storage */
+	/* create internal storage, half of max_bytes goes to compressed loops */
 	status = frame_store_create(
 		bytes_per_video_frame,
 		bytes_per_depth_frame,
 		sizeof(float), // depth cutoff storage
 		max_bytes,
+		FRAME_STORE_PLANAR | FRAME_STORE_COMPRESSED,
 		&(p_director->frame_store));
+	if (NO_ERROR == status) {
+		/* the device stamps video and depth separately, planes up to half
+		 * a frame apart make one frame */
+		status = frame_store_set_capture_tolerance(
+			p_director->frame_store, 
+			DIRECTOR_FRAME_SECONDS / 2.0);
+	}
 	if (NO_ERROR != status) {
 		director_release(p_director);
 		return status;
 	}
 
 	status = vector_create(32, sizeof(loop_t*), &(p_director->loops));
+	if (NO_ERROR == status) {
+		status = vector_create(32, sizeof(retired_t), &(p_director->retired));
+	}
+	if (NO_ERROR == status) {
+		status = _loop_list_create(p_director->loops, 1, &p_list);
+	}
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+	p_director->loop_list = p_list;
+
+	status = vector_create(
+		DIRECTOR_MAX_LAYERS * DIRECTOR_DECODE_AHEAD, 
+		sizeof(frame_id_t), 
+		&(p_director->expanded_frame_ids));
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+	status = vector_create(
+		DIRECTOR_MAX_LAYERS, 
+		sizeof(frame_id_t), 
+		&(p_director->late_frame_ids));
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+	status = vector_create(
+		DIRECTOR_MAX_LAYERS * DIRECTOR_PREFETCH_AHEAD, 
+		sizeof(frame_id_t), 
+		&(p_director->prefetch_frame_ids));
 	if (NO_ERROR != status) {
 		director_release(p_director);
 		return status;
@@ -141,9 +419,10 @@ status_t director_create(
 	}
 
 	/* create motion detector to trigger start of recording */
+	p_director->motion_pixel_count = bytes_per_depth_frame / bytes_per_depth_pixel;
 	status = motion_detector_create(
 		bytes_per_depth_pixel,
-		bytes_per_depth_frame / bytes_per_depth_pixel,
+		p_director->motion_pixel_count,
 		TRUE,
 		&(p_director->motion_detector));
 	if (NO_ERROR != status) {
@@ -158,6 +437,75 @@ status_t director_create(
 		return ERR_FAILED_THREAD_CREATE;
 	}
 
+	/* create mutex guarding the frame store */
+	pthreadErr = pthread_mutex_init(&(p_director->frame_store_mutex), NULL);
+	if (pthreadErr) {
+		director_release(p_director);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+
+	pthreadErr = pthread_mutex_init(&(p_director->decode_mutex), NULL);
+	if (0 == pthreadErr) {
+		pthreadErr = pthread_cond_init(&(p_director->decode_cond), NULL);
+	}
+	if (0 == pthreadErr) {
+		pthreadErr = pthread_create(
+			&(p_director->decode_thread),
+			NULL,
+			&_director_decode_thread,
+			p_director);
+	}
+	if (pthreadErr) {
+		director_release(p_director);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+	p_director->decode_thread_running = TRUE;
+
+	status = worker_pool_create(
+		DIRECTOR_WORKERS, 
+		DIRECTOR_MAX_JOBS, 
+		&(p_director->workers));
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+
+	status = queue_create(
+		DIRECTOR_ANALYSIS_QUEUE, 
+		sizeof(frame_id_t), 
+		&(p_director->analysis_queue));
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+	pthreadErr = pthread_mutex_init(&(p_director->analysis_mutex), NULL);
+	if (0 == pthreadErr) {
+		pthreadErr = pthread_cond_init(&(p_director->analysis_cond), NULL);
+	}
+	if (0 == pthreadErr) {
+		pthreadErr = pthread_create(
+			&(p_director->analysis_thread),
+			NULL,
+			&_director_analysis_thread,
+			p_director);
+	}
+	if (pthreadErr) {
+		director_release(p_director);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+	p_director->analysis_thread_running = TRUE;
+
+	/* evict old loops rather than stop recording when memory runs out */
+	status = frame_store_set_pressure_callback(
+		p_director->frame_store,
+		DIRECTOR_PRESSURE_FRAMES,
+		&_director_handle_pressure,
+		p_director);
+	if (NO_ERROR != status) {
+		director_release(p_director);
+		return status;
+	}
+
 	srand(time(NULL));
 	*p_handle = p_director;
 
@@ -165,33 +513,78 @@ status_t director_create(
 }
 
 void director_release(director_handle_t handle) {
-	/* TODO: some possible troubles with release code in case
-	 * a thread is still running.  we could hold on to references
-	 * of the threads, or have a counter w/ a mutex.
-	 */
+	/* every thread is joined before anything it uses goes */
 	size_t count = 0;
 	size_t i = 0;
 	loop_t* p_loop = NULL;
+	retired_t retired;
 	status_t status = NO_ERROR;
 
 	if (NULL == handle) {
 		return;
 	}
+
+	/* frames still queued go with the frame store */
+	if (TRUE == handle->analysis_thread_running) {
+		pthread_mutex_lock(&(handle->analysis_mutex));
+		handle->analysis_exit = TRUE;
+		pthread_cond_signal(&(handle->analysis_cond));
+		pthread_mutex_unlock(&(handle->analysis_mutex));
+		pthread_join(handle->analysis_thread, NULL);
+		pthread_cond_destroy(&(handle->analysis_cond));
+		pthread_mutex_destroy(&(handle->analysis_mutex));
+	}
+	queue_release(handle->analysis_queue);
+	/* loops still being finished are published, and archived, first */
+	worker_pool_release(handle->workers);
+
+	/* no evictions while loops are being released */
+	frame_store_set_pressure_callback(handle->frame_store, 0, NULL, NULL);
+
+	if (TRUE == handle->decode_thread_running) {
+		pthread_mutex_lock(&(handle->decode_mutex));
+		handle->decode_exit = TRUE;
+		pthread_cond_signal(&(handle->decode_cond));
+		pthread_mutex_unlock(&(handle->decode_mutex));
+		pthread_join(handle->decode_thread, NULL);
+		pthread_cond_destroy(&(handle->decode_cond));
+		pthread_mutex_destroy(&(handle->decode_mutex));
+	}
 	
 	vector_count(handle->loops, &count);
 	for (i = 0; i < count; i++) {
 		status = vector_element_copy(handle->loops, i, (void**)&p_loop);
-		if (NO_ERROR != status) {
+		if (NO_ERROR == status) {
+			/* frames go back with the frame store below */
 			_loop_release(p_loop);
 		}
 	}
+	/* evicted loops still lose their archive files */
+	count = 0;
+	vector_count(handle->retired, &count);
+	for (i = 0; i < count; i++) {
+		if (NO_ERROR == vector_element_copy(handle->retired, i, (void*)&retired)) {
+			free(retired.list);
+			_director_release_loop(handle, retired.loop);
+		}
+	}
+	vector_release(handle->retired);
+	free(handle->loop_list);
 
+	if (NULL != handle->live_frame) {
+		frame_store_release_frame(handle->frame_store, handle->live_frame);
+	}
 	frame_store_release(handle->frame_store);
 	vector_release(handle->loops);
+	vector_release(handle->expanded_frame_ids);
+	vector_release(handle->late_frame_ids);
+	vector_release(handle->prefetch_frame_ids);
 	_loop_release(handle->p_current_loop);
+	free(handle->playing_loops);
 	pthread_mutex_destroy(&(handle->loops_mutex));
 	pthread_mutex_destroy(&(handle->frame_store_mutex));
 	motion_detector_release(handle->motion_detector);
+	free(handle->archive_dir);
 
 	free(handle);
 }
@@ -202,11 +595,15 @@ status_t director_playback_layers(
 	director_frame_layers_t* p_layers)
 {
 	status_t status      = NO_ERROR;
-	size_t   count       = 0;
 	size_t   layer_index = 0;
-	size_t   loop_index  = 0;
 	loop_t   *p_loop     = NULL;
-	/* TODO: use timing information to do playback */
+	loop_list_t* p_list  = NULL;
+	loop_frame_t* p_frame = NULL;
+	loop_t*  finished[DIRECTOR_MAX_LAYERS];
+	size_t   finished_count = 0;
+	frame_id_t late_frame_ids[DIRECTOR_MAX_LAYERS];
+	size_t   late_count = 0;
+	size_t   i = 0;
 
 	if ((NULL == handle) || (NULL == p_layers)) {
 		return ERR_NULL_POINTER;
@@ -214,80 +611,198 @@ status_t director_playback_layers(
 
 	p_layers->layer_count = 0;
 
-	pthread_mutex_lock(&(handle->loops_mutex));
-	status = vector_count(handle->loops, &count);
-	if (NO_ERROR != status) {
-		pthread_mutex_unlock(&(handle->loops_mutex));
-		return status;
+	/* writers that see the pass started leave what it may use alone */
+	handle->reader_in_pass = TRUE;
+	__sync_synchronize();
+	p_list = handle->loop_list;
+
+	/* loops evicted since the last pass stop playing */
+	if (p_list->generation != handle->reader_generation) {
+		for (layer_index = 0; layer_index < handle->max_layers; layer_index++) {
+			if (FALSE == _director_find_loop(
+				p_list->loops, 
+				p_list->count, 
+				handle->playing_loops[layer_index]))
+			{
+				handle->playing_loops[layer_index] = NULL;
+			}
+		}
+		handle->reader_generation = p_list->generation;
 	}
 
-	if (count < 1) {
+	if (p_list->count < 1) {
 		/* nothing to play */
-		pthread_mutex_unlock(&(handle->loops_mutex));
+		_director_end_pass(handle, p_list, NULL, 0);
 		return NO_ERROR;
 	}
 
 
-	/* fill any empty loops */
+	/* loops whose playhead ran past their end make room for new ones.  a
+	 * loop can play on more than one layer, so it is only stopped once
+	 * every layer has been looked at. */
 	for (layer_index = 0; layer_index < handle->max_layers; layer_index++) {
-		if (NULL == handle->playing_loops[layer_index]) {
-			/* choose random loop */
-			loop_index = rand() % count;
-			status = vector_element_copy(
-				handle->loops, 
-				loop_index, 
-				(void*)&(handle->playing_loops[layer_index]));
-			if (NO_ERROR != status) {
-				pthread_mutex_unlock(&(handle->loops_mutex));
-				return status;
-			}
+		p_loop = handle->playing_loops[layer_index];
+		if ((NULL != p_loop) && 
+			(FALSE == _director_advance_loop(p_loop, play_time))) 
+		{
+			finished[finished_count++] = p_loop;
+			handle->playing_loops[layer_index] = NULL;
 		}
 	}
+	for (i = 0; i < finished_count; i++) {
+		finished[i]->next_frame = 0;
+		finished[i]->play_start = -1.0;
+	}
+
+	/* fill any empty loops */
+	status = _director_fill_layers(handle, p_list);
+	if (NO_ERROR != status) {
+		_director_end_pass(handle, p_list, NULL, 0);
+		return status;
+	}
 
 
-	/* assign layers to structure */
+	/* assign layers to structure.  each frame is pinned so eviction cannot
+	 * free it while it is on screen. */
+	pthread_mutex_lock(&(handle->frame_store_mutex));
 	for (layer_index = 0; layer_index < handle->max_layers; layer_index++) {
 		p_loop = handle->playing_loops[layer_index];
+		/* loops that just started are at their first frame */
+		_director_advance_loop(p_loop, play_time);
 
-		/* copy data pointers to output structure */
-		status = vector_element_copy(
-			p_loop->video_addresses,
+		status = vector_element_address(
+			p_loop->frames,
 			p_loop->next_frame,
-			(void*)&(p_layers->video_layers[layer_index]));
-		if (NO_ERROR != status) {
-			pthread_mutex_unlock(&(handle->loops_mutex));
-			return status;
+			(void**)&p_frame);
+		if (NO_ERROR == status) {
+			status = frame_store_acquire_frame(
+				handle->frame_store,
+				p_frame->frame_id,
+				&(p_layers->frames[layer_index]));
 		}
-		status = vector_element_copy(
-			p_loop->depth_addresses,
-			p_loop->next_frame,
-			(void*)&(p_layers->depth_layers[layer_index]));
 		if (NO_ERROR != status) {
-			pthread_mutex_unlock(&(handle->loops_mutex));
+			pthread_mutex_unlock(&(handle->frame_store_mutex));
+			_director_end_pass(handle, p_list, late_frame_ids, late_count);
+			/* unpin the layers already assigned */
+			p_layers->layer_count = layer_index;
+			director_release_layers(handle, p_layers);
 			return status;
 		}
-		status = vector_element_copy(
-			p_loop->cutoffs,
-			p_loop->next_frame,
-			(void*)&(p_layers->depth_cutoffs[layer_index]));
+
+		/* copy data pointers to output structure */
+		status = frame_store_frame_data(
+			handle->frame_store,
+			p_layers->frames[layer_index],
+			&(p_layers->video_layers[layer_index]),
+			&(p_layers->depth_layers[layer_index]),
+			NULL,
+			NULL);
+		if ((NO_ERROR == status) && 
+			(NULL == p_layers->video_layers[layer_index])) 
+		{
+			/* the decode thread has not got this far yet */
+			status = frame_store_expand_frame(handle->frame_store, p_frame->frame_id);
+			if (NO_ERROR == status) {
+				status = frame_store_frame_data(
+					handle->frame_store,
+					p_layers->frames[layer_index],
+					&(p_layers->video_layers[layer_index]),
+					&(p_layers->depth_layers[layer_index]),
+					NULL,
+					NULL);
+			}
+			if (NO_ERROR == status) {
+				/* the decode thread shrinks it again */
+				late_frame_ids[late_count++] = p_frame->frame_id;
+			}
+		}
+		if (NO_ERROR == status) {
+			p_layers->depth_cutoffs[layer_index] = p_frame->cutoff;
+		}
 		if (NO_ERROR != status) {
-			pthread_mutex_unlock(&(handle->loops_mutex));
+			pthread_mutex_unlock(&(handle->frame_store_mutex));
+			_director_end_pass(handle, p_list, late_frame_ids, late_count);
+			p_layers->layer_count = layer_index + 1;
+			director_release_layers(handle, p_layers);
 			return status;
 		}
-
-		p_loop->next_frame++;
-		if (p_loop->next_frame >= p_loop->frame_count) {
-			p_loop->next_frame = 0;
-			handle->playing_loops[layer_index] = NULL;
-		}
 	}
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
 	p_layers->layer_count = handle->max_layers;
-	/* TODO: currently no live screen */
 
-	pthread_mutex_unlock(&(handle->loops_mutex));
+	_director_end_pass(handle, p_list, late_frame_ids, late_count);
 	return NO_ERROR;	
 }
 
+status_t director_release_layers(
+	director_handle_t handle, 
+	director_frame_layers_t* p_layers)
+{
+	status_t status = NO_ERROR;
+	size_t layer_index = 0;
+
+	if ((NULL == handle) || (NULL == p_layers)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* releasing a frame does not need the frame store lock */
+	for (layer_index = 0; layer_index < p_layers->layer_count; layer_index++) {
+		if (NO_ERROR != frame_store_release_frame(
+			handle->frame_store,
+			p_layers->frames[layer_index]))
+		{
+			status = ERR_INVALID_ARGUMENT;
+		}
+		p_layers->frames[layer_index] = NULL;
+	}
+	p_layers->layer_count = 0;
+
+	return status;
+}
+
+status_t director_live_layer(
+	director_handle_t handle, 
+	director_frame_layers_t* p_layers)
+{
+	status_t status = NO_ERROR;
+	size_t layer_index = 0;
+	float* p_cutoff = NULL;
+
+	if ((NULL == handle) || (NULL == p_layers)) {
+		return ERR_NULL_POINTER;
+	}
+	layer_index = p_layers->layer_count;
+	if (layer_index >= DIRECTOR_MAX_LAYERS) {
+		return ERR_FULL;
+	}
+
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	if (NULL == handle->live_frame) {
+		pthread_mutex_unlock(&(handle->frame_store_mutex));
+		return ERR_EMPTY;
+	}
+	/* a pin of the display's own, the director's goes with the next frame */
+	status = frame_store_retain_frame(handle->frame_store, handle->live_frame);
+	if (NO_ERROR == status) {
+		p_layers->frames[layer_index] = handle->live_frame;
+		status = frame_store_frame_data(
+			handle->frame_store,
+			handle->live_frame,
+			&(p_layers->video_layers[layer_index]),
+			&(p_layers->depth_layers[layer_index]),
+			(void**)&p_cutoff,
+			NULL);
+	}
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	p_layers->depth_cutoffs[layer_index] = *p_cutoff;
+	p_layers->layer_count = layer_index + 1;
+	return NO_ERROR;
+}
+
 status_t director_capture_video(
 	director_handle_t handle,
 	void* data,
@@ -306,6 +821,9 @@ status_t director_capture_video(
 		data, 
 		timestamp,
 		&frame_id);
+	if ((NO_ERROR == status) && (invalid_frame_id != frame_id)) {
+		_director_set_live_frame(handle, frame_id);
+	}
 	pthread_mutex_unlock(&(handle->frame_store_mutex));
 	if (NO_ERROR != status) {
 		return status;
@@ -313,7 +831,7 @@ status_t director_capture_video(
 
 	if (invalid_frame_id != frame_id) {
 		/* we have a new frame! */
-		status = _director_handle_new_frame(handle, frame_id);
+		status = _director_queue_frame(handle, frame_id);
 	}
 
 	return status;
@@ -347,6 +865,9 @@ status_t director_capture_depth(
 		(void*)&cutoff, 
 		timestamp,
 		&frame_id);
+	if ((NO_ERROR == status) && (invalid_frame_id != frame_id)) {
+		_director_set_live_frame(handle, frame_id);
+	}
 	pthread_mutex_unlock(&(handle->frame_store_mutex));
 	if (NO_ERROR != status) {
 		return status;
@@ -354,105 +875,475 @@ status_t director_capture_depth(
 
 	if (invalid_frame_id != frame_id) {
 		/* we have a new frame! */
-		status = _director_handle_new_frame(handle, frame_id);
+		status = _director_queue_frame(handle, frame_id);
 	}
 
 	return status;
 }
 
-status_t _loop_create(loop_t** pp_loop) {
+status_t director_analysis_stats(
+	director_handle_t handle, 
+	director_analysis_stats_t* p_stats)
+{
+	if ((NULL == handle) || (NULL == p_stats)) {
+		return ERR_NULL_POINTER;
+	}
+
+	p_stats->queued_frames = handle->queued_frames;
+	p_stats->dropped_frames = handle->dropped_frames;
+	p_stats->max_queued_frames = handle->max_queued_frames;
+	p_stats->analysed_frames = handle->analysed_frames;
+	return NO_ERROR;
+}
+
+status_t director_job_stats(
+	director_handle_t handle, 
+	worker_pool_stats_t* p_stats)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	return worker_pool_stats(handle->workers, p_stats);
+}
+
+status_t director_video_target(director_handle_t handle, void** p_data) {
 	status_t status = NO_ERROR;
-	loop_t* p_loop = NULL;
 
-	if (NULL == pp_loop) {
+	if (NULL == handle) {
 		return ERR_NULL_POINTER;
 	}
 
-	p_loop = (loop_t*)malloc(sizeof(loop_t));
-	if (NULL == p_loop) {
-		return ERR_FAILED_ALLOC;
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	status = frame_store_video_target(handle->frame_store, p_data);
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
+	return status;
+}
+
+status_t director_depth_target(director_handle_t handle, void** p_data) {
+	status_t status = NO_ERROR;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
 	}
-	memset(p_loop, 0, sizeof(loop_t));
 
-	p_loop->frame_count = 0;
-	p_loop->next_frame = 0;
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	status = frame_store_depth_target(handle->frame_store, p_data);
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
+	return status;
+}
 
-	status = vector_create(128, sizeof(void*), &(p_loop->video_addresses));
-	if (NO_ERROR != status) {
-		_loop_release(p_loop);
-		return status;
+status_t director_set_spill_file(
+	director_handle_t handle, 
+	const char* path, 
+	size_t max_bytes)
+{
+	status_t status = NO_ERROR;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
 	}
-	status = vector_create(128, sizeof(void*), &(p_loop->depth_addresses));
-	if (NO_ERROR != status) {
-		_loop_release(p_loop);
-		return status;
+
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	status = frame_store_enable_spill(handle->frame_store, path, max_bytes);
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
+	return status;
+}
+
+status_t director_set_previews(
+	director_handle_t handle, 
+	size_t width, 
+	size_t height)
+{
+	status_t status = NO_ERROR;
+	motion_detector_handle_t motion_detector = NULL;
+	size_t preview_width = 0;
+	size_t preview_height = 0;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	status = frame_store_enable_previews(handle->frame_store, width, height);
+	if (NO_ERROR == status) {
+		status = frame_store_preview_size(
+			handle->frame_store, 
+			FRAME_STORE_PREVIEW_QUARTER, 
+			&preview_width, 
+			&preview_height);
 	}
-	status = vector_create(128, sizeof(frame_id_t), &(p_loop->frame_ids));
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
 	if (NO_ERROR != status) {
-		_loop_release(p_loop);
 		return status;
 	}
-	status = vector_create(128, sizeof(float), &(p_loop->cutoffs));
+
+	/* a sixteenth of the pixels is plenty to tell whether someone moved */
+	status = motion_detector_create(
+		handle->bytes_per_depth_pixel,
+		preview_width * preview_height,
+		TRUE,
+		&motion_detector);
 	if (NO_ERROR != status) {
-		_loop_release(p_loop);
 		return status;
 	}
-	
-	*pp_loop = p_loop;
+	motion_detector_release(handle->motion_detector);
+	handle->motion_detector = motion_detector;
+	handle->motion_pixel_count = preview_width * preview_height;
+	handle->preview_level = FRAME_STORE_PREVIEW_QUARTER;
 	return NO_ERROR;
 }
 
-void _loop_release(loop_t* p_loop) {
-	if (NULL == p_loop) {
-		return;
+status_t director_set_depth_filter(director_handle_t handle, bool_t enabled) {
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
 	}
-	/* TODO: release frames from store */
-
-	vector_release(p_loop->video_addresses);
-	vector_release(p_loop->depth_addresses);
-	vector_release(p_loop->frame_ids);
-	vector_release(p_loop->cutoffs);
-	free(p_loop);
+	handle->depth_filter = enabled;
+	return NO_ERROR;
 }
 
-status_t _director_handle_new_frame(
-	director_t* p_director, 
-	frame_id_t frame_id) 
+status_t director_set_eviction(
+	director_handle_t handle, 
+	director_eviction_rank_t rank, 
+	size_t max_loop_bytes)
 {
-	status_t    status     = NO_ERROR;
-	void*       depth      = NULL;
-	void*       video      = NULL;
-	float       *p_cutoff  = NULL;
-	loop_t*     p_loop     = NULL;
-	unsigned short motion_cutoff = 0;
-	double motion = 0.0;
-	double presence = 0.0;
-	bool_t valid_frame = FALSE;
-	bool_t loop_ended = FALSE;
-	timestamp_t timestamp;
+	if ((NULL == handle) || (NULL == rank)) {
+		return ERR_NULL_POINTER;
+	}
 
-	p_loop = p_director->p_current_loop;
+	pthread_mutex_lock(&(handle->loops_mutex));
+	handle->eviction_rank = rank;
+	handle->max_loop_bytes = max_loop_bytes;
+	pthread_mutex_unlock(&(handle->loops_mutex));
 
-	/* retrieve frame from frame store */
-	pthread_mutex_lock(&(p_director->frame_store_mutex));
-	status = frame_store_video_frame(
-		p_director->frame_store,
-		frame_id,
-		&video,
-		&timestamp);
-	if (NO_ERROR != status) {
-		pthread_mutex_unlock(&(p_director->frame_store_mutex));
-		return status;
+	/* a smaller budget applies straight away */
+	_director_enforce_budget(handle, NULL);
+	return NO_ERROR;
+}
+
+double director_rank_oldest(const director_loop_stats_t* p_stats) {
+	return -p_stats->age_seconds;
+}
+
+double director_rank_lru(const director_loop_stats_t* p_stats) {
+	return -p_stats->idle_seconds;
+}
+
+double director_rank_score(const director_loop_stats_t* p_stats) {
+	return p_stats->presence / (1.0 + (double)p_stats->play_count);
+}
+
+status_t director_set_foreground(
+	director_handle_t handle, 
+	size_t width, 
+	size_t height)
+{
+	status_t status = NO_ERROR;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
 	}
-	status = frame_store_depth_frame(
+
+	pthread_mutex_lock(&(handle->frame_store_mutex));
+	status = frame_store_enable_foreground(
+		handle->frame_store, 
+		width, 
+		height, 
+		DIRECTOR_FOREGROUND_MARGIN);
+	if (NO_ERROR == status) {
+		handle->foreground = TRUE;
+	}
+	pthread_mutex_unlock(&(handle->frame_store_mutex));
+	return status;
+}
+
+status_t director_set_archive(director_handle_t handle, const char* dir) {
+	status_t status = NO_ERROR;
+	vector_handle_t serials = NULL;
+	size_t* p_serials = NULL;
+	size_t serial = 0;
+	size_t count = 0;
+	size_t restored = 0;
+	size_t i = 0;
+	char suffix[8];
+	DIR* p_dir = NULL;
+	struct dirent* p_entry = NULL;
+
+	if ((NULL == handle) || (NULL == dir)) {
+		return ERR_NULL_POINTER;
+	}
+	if ((NULL != handle->archive_dir) || 
+		(strlen(dir) + 32 > DIRECTOR_ARCHIVE_PATH_BYTES)) 
+	{
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	if ((0 != mkdir(dir, 0755)) && (EEXIST != errno)) {
+		return ERR_IO_ERROR;
+	}
+	p_dir = opendir(dir);
+	if (NULL == p_dir) {
+		return ERR_IO_ERROR;
+	}
+	status = vector_create(128, sizeof(size_t), &serials);
+	if (NO_ERROR != status) {
+		closedir(p_dir);
+		return status;
+	}
+
+	/* loops are restored oldest first so they are evicted in order again */
+	while (NULL != (p_entry = readdir(p_dir))) {
+		if ((2 == sscanf(p_entry->d_name, "loop_%zu.%7s", &serial, suffix)) &&
+			(0 == strcmp(suffix, "kgl")) &&
+			(serial > 0))
+		{
+			vector_append(serials, &serial);
+		}
+	}
+	closedir(p_dir);
+	vector_count(serials, &count);
+	if (count > 0) {
+		vector_array(serials, (void**)&p_serials);
+		qsort(p_serials, count, sizeof(size_t), &_director_compare_serials);
+	}
+
+	handle->archive_dir = (char*)malloc(strlen(dir) + 1);
+	if (NULL == handle->archive_dir) {
+		vector_release(serials);
+		return ERR_FAILED_ALLOC;
+	}
+	strcpy(handle->archive_dir, dir);
+	pthread_mutex_lock(&(handle->loops_mutex));
+	handle->next_archive_serial = (count > 0) ? p_serials[count - 1] + 1 : 1;
+	pthread_mutex_unlock(&(handle->loops_mutex));
+
+	for (i = 0; i < count; i++) {
+		status = _director_restore_loop(handle, p_serials[i]);
+		if (NO_ERROR == status) {
+			restored++;
+		}
+		else if (ERR_FULL == status) {
+			LOG_WARNING("archive: no room for %zu more loops", count - i);
+			break;
+		}
+		else {
+			LOG_WARNING(
+				"archive: skipped loop %zu (%s)", 
+				p_serials[i], 
+				error_string(status));
+		}
+	}
+	vector_release(serials);
+
+	LOG_INFO("archive: restored %zu loops from %s", restored, dir);
+	return NO_ERROR;
+}
+
+status_t _loop_create(loop_t** pp_loop) {
+	status_t status = NO_ERROR;
+	loop_t* p_loop = NULL;
+
+	if (NULL == pp_loop) {
+		return ERR_NULL_POINTER;
+	}
+
+	p_loop = (loop_t*)malloc(sizeof(loop_t));
+	if (NULL == p_loop) {
+		return ERR_FAILED_ALLOC;
+	}
+	memset(p_loop, 0, sizeof(loop_t));
+
+	p_loop->frame_count = 0;
+	p_loop->next_frame = 0;
+	p_loop->play_start = -1.0;
+
+	status = vector_create(128, sizeof(loop_frame_t), &(p_loop->frames));
+	if (NO_ERROR != status) {
+		_loop_release(p_loop);
+		return status;
+	}
+	
+	*pp_loop = p_loop;
+	return NO_ERROR;
+}
+
+void _loop_release(loop_t* p_loop) {
+	if (NULL == p_loop) {
+		return;
+	}
+	/* frames are returned to the store by _director_release_loop */
+
+	vector_release(p_loop->frames);
+	loop_archive_release(p_loop->archive);
+	free(p_loop);
+}
+
+status_t _loop_frame_ids(loop_t* p_loop, frame_id_t** p_frame_ids) {
+	status_t status = NO_ERROR;
+	loop_frame_t* frames = NULL;
+	frame_id_t* frame_ids = NULL;
+	size_t i = 0;
+
+	/* for the frame store calls that take a whole series of frames */
+	status = vector_array(p_loop->frames, (void**)&frames);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	frame_ids = (frame_id_t*)malloc((p_loop->frame_count + 1) * sizeof(frame_id_t));
+	if (NULL == frame_ids) {
+		return ERR_FAILED_ALLOC;
+	}
+	for (i = 0; i < p_loop->frame_count; i++) {
+		frame_ids[i] = frames[i].frame_id;
+	}
+
+	*p_frame_ids = frame_ids;
+	return NO_ERROR;
+}
+
+status_t _loop_list_create(
+	vector_handle_t loops, 
+	size_t generation, 
+	loop_list_t** pp_list)
+{
+	status_t status = NO_ERROR;
+	loop_list_t* p_list = NULL;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = vector_count(loops, &count);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	p_list = (loop_list_t*)malloc(
+		sizeof(loop_list_t) + ((count > 0) ? count - 1 : 0) * sizeof(loop_t*));
+	if (NULL == p_list) {
+		return ERR_FAILED_ALLOC;
+	}
+	p_list->generation = generation;
+	p_list->count = count;
+	for (i = 0; (NO_ERROR == status) && (i < count); i++) {
+		status = vector_element_copy(loops, i, (void*)&(p_list->loops[i]));
+	}
+	if (NO_ERROR != status) {
+		free(p_list);
+		return status;
+	}
+
+	*pp_list = p_list;
+	return NO_ERROR;
+}
+
+status_t _director_queue_frame(director_t* p_director, frame_id_t frame_id) {
+	status_t status = NO_ERROR;
+	size_t count = 0;
+
+	status = queue_push(p_director->analysis_queue, &frame_id);
+	if (NO_ERROR != status) {
+		/* analysis is behind, the frame cannot become part of a loop */
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_remove_frame(p_director->frame_store, frame_id);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		p_director->dropped_frames++;
+		return status;
+	}
+	p_director->queued_frames++;
+	queue_count(p_director->analysis_queue, &count);
+	if (count > p_director->max_queued_frames) {
+		p_director->max_queued_frames = count;
+	}
+
+	pthread_mutex_lock(&(p_director->analysis_mutex));
+	pthread_cond_signal(&(p_director->analysis_cond));
+	pthread_mutex_unlock(&(p_director->analysis_mutex));
+	return NO_ERROR;
+}
+
+void* _director_analysis_thread(void* data) {
+	director_t* p_director = (director_t*)data;
+	frame_id_t frame_id = invalid_frame_id;
+	status_t status = NO_ERROR;
+	size_t dropped_frames = 0;
+	size_t count = 0;
+
+	pthread_mutex_lock(&(p_director->analysis_mutex));
+	while (FALSE == p_director->analysis_exit) {
+		queue_count(p_director->analysis_queue, &count);
+		if (0 == count) {
+			pthread_cond_wait(
+				&(p_director->analysis_cond), 
+				&(p_director->analysis_mutex));
+			continue;
+		}
+		pthread_mutex_unlock(&(p_director->analysis_mutex));
+
+		while (NO_ERROR == queue_pop(p_director->analysis_queue, &frame_id)) {
+			status = _director_handle_new_frame(p_director, frame_id);
+			if (NO_ERROR != status) {
+				LOG_WARNING("failed to analyse frame (%s)", error_string(status));
+			}
+			p_director->analysed_frames++;
+		}
+		/* logged here rather than where capture drops them */
+		if (p_director->dropped_frames != dropped_frames) {
+			dropped_frames = p_director->dropped_frames;
+			LOG_WARNING("analysis fell behind, %zu frames dropped", dropped_frames);
+		}
+
+		pthread_mutex_lock(&(p_director->analysis_mutex));
+	}
+	pthread_mutex_unlock(&(p_director->analysis_mutex));
+	return NULL;
+}
+
+status_t _director_handle_new_frame(
+	director_t* p_director, 
+	frame_id_t frame_id) 
+{
+	status_t    status     = NO_ERROR;
+	void*       depth      = NULL;
+	void*       video      = NULL;
+	float       *p_cutoff  = NULL;
+	loop_t*     p_loop     = NULL;
+	double motion = 0.0;
+	double presence = 0.0;
+	bool_t valid_frame = FALSE;
+	bool_t loop_ended = FALSE;
+	timestamp_t timestamp;
+	loop_frame_t frame;
+
+	p_loop = p_director->p_current_loop;
+
+	/* retrieve frame from frame store */
+	pthread_mutex_lock(&(p_director->frame_store_mutex));
+	status = frame_store_video_frame(
 		p_director->frame_store,
 		frame_id,
-		&depth,
+		&video,
 		&timestamp);
 	if (NO_ERROR != status) {
 		pthread_mutex_unlock(&(p_director->frame_store_mutex));
 		return status;
 	}
+	if (0 != p_director->preview_level) {
+		status = frame_store_preview_frame(
+			p_director->frame_store,
+			frame_id,
+			p_director->preview_level,
+			NULL,
+			&depth);
+	}
+	else {
+		status = frame_store_depth_frame(
+			p_director->frame_store,
+			frame_id,
+			&depth,
+			&timestamp);
+	}
+	if (NO_ERROR != status) {
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		return status;
+	}
 	status = frame_store_meta_frame(
 		p_director->frame_store,
 		frame_id,
@@ -465,11 +1356,10 @@ status_t _director_handle_new_frame(
 	pthread_mutex_unlock(&(p_director->frame_store_mutex));
 
 	/* run through motion detector */
-	motion_cutoff = (short)((unsigned)(*p_cutoff * 65536) / p_director->depth_scale);
 	status = motion_detector_detect(
 		p_director->motion_detector,
 		depth,
-		motion_cutoff,
+		_director_motion_cutoff(p_director, *p_cutoff),
 		&motion,
 		&presence);
 
@@ -494,23 +1384,12 @@ status_t _director_handle_new_frame(
 	}
 	
 	if (p_director->is_recording) {
-		/* append pointrs if recording */
-		status = vector_append(p_loop->video_addresses, &video);
-		if (NO_ERROR != status) {
-			return status;
-		}
-
-		status = vector_append(p_loop->depth_addresses, &depth);
-		if (NO_ERROR != status) {
-			return status;
-		}
-
-		status = vector_append(p_loop->cutoffs, (void*)p_cutoff);
-		if (NO_ERROR != status) {
-			return status;
-		}
-
-		status = vector_append(p_loop->frame_ids, (void*)&frame_id);
+		/* append frame if recording */
+		memset(&frame, 0, sizeof(loop_frame_t));
+		frame.frame_id = frame_id;
+		frame.timestamp = timestamp;
+		frame.cutoff = *p_cutoff;
+		status = vector_append(p_loop->frames, (void*)&frame);
 		if (NO_ERROR != status) {
 			return status;
 		}
@@ -525,17 +1404,20 @@ status_t _director_handle_new_frame(
 	}
 
 	if (TRUE == loop_ended) {
+		p_director->p_current_loop = NULL;
 		if (p_loop->frame_count >= p_director->loop_min_frame_count) {
+			/* the loop is released on failure */
 			status = _director_handle_new_loop(p_director, p_loop);
-			if (NO_ERROR != status) {
-				return status;
-			}
 		}
 		else {
-			_loop_release(p_loop);	
+			_director_release_loop(p_director, p_loop);
+		}
+		if (NO_ERROR == status) {
+			status = _loop_create(&(p_director->p_current_loop));
+		}
+		else {
+			_loop_create(&(p_director->p_current_loop));
 		}
-		p_director->p_current_loop = NULL;
-		status = _loop_create(&(p_director->p_current_loop));
 	}
 	
 	return status;
@@ -543,115 +1425,1375 @@ status_t _director_handle_new_frame(
 
 status_t _director_handle_new_loop(director_t* p_director, loop_t* p_loop) {
 	status_t status = NO_ERROR;
-	thread_data_t* p_thread_data = NULL;
-	int pthread_error = 0;
+	job_data_t* p_job_data = NULL;
 
-	status = _thread_data_create(p_director, p_loop, &p_thread_data);
+	status = _job_data_create(p_director, p_loop, &p_job_data);
 	if (NO_ERROR != status) {
-		_loop_release(p_loop);
+		_director_release_loop(p_director, p_loop);
 		return status;
 	}
 
-	pthread_error = pthread_create(
-		&(p_thread_data->thread),
-		NULL,
-		&_handle_new_loop,
-		p_thread_data);
-	
-	if (0 != pthread_error) {
-		_loop_release(p_loop);
-		return ERR_FAILED_THREAD_CREATE;
+	status = worker_pool_submit(
+		p_director->workers, 
+		&_handle_new_loop, 
+		p_job_data);
+	if (NO_ERROR != status) {
+		_job_data_release(p_job_data);
+		_director_release_loop(p_director, p_loop);
+		return status;
 	}
 
 	return NO_ERROR;
 }
 
-status_t _thread_data_create(
-	director_t* p_director,
-	loop_t* p_loop,
-	thread_data_t** pp_td)
+void _director_handle_pressure(
+	frame_store_handle_t frame_store,
+	size_t shortfall_frames,
+	void* data)
 {
-	thread_data_t* p_thread_data = NULL;
-	if (NULL == pp_td) {
-		return ERR_NULL_POINTER;
+	director_t* p_director = (director_t*)data;
+	loop_t* evicted[DIRECTOR_MAX_LAYERS];
+	size_t evicted_count = 0;
+	size_t evicted_frames = 0;
+	size_t i = 0;
+
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	evicted_count = _director_evict_loops(
+		p_director, 
+		shortfall_frames, 
+		NULL, 
+		evicted);
+	for (i = 0; i < evicted_count; i++) {
+		evicted_frames += evicted[i]->frame_count;
+	}
+	if (evicted_count > 0) {
+		_director_publish_loops(p_director, evicted, evicted_count);
+	}
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+
+	/* frames come back once playback cannot reach them any more, right
+	 * away unless it is in the middle of a pass */
+	_director_reclaim(p_director);
+
+	if (evicted_count > 0) {
+		LOG_DEBUG(
+			"evicted %zu loops (%zu frames) for a shortfall of %zu frames",
+			evicted_count,
+			evicted_frames,
+			shortfall_frames);
 	}
+}
 
-	p_thread_data = malloc(sizeof(thread_data_t));
-	if (NULL == p_thread_data) {
-		return ERR_FAILED_ALLOC;
+/* Loops that are not playing are evicted when capture runs short of
+ * frames and, with director_set_eviction, whenever the loops kept take
+ * more than a byte budget.  The eviction rank picks which go first, p_keep
+ * is the loop just published, never evicted to make room for itself. */
+size_t _director_evict_loops(
+	director_t* p_director, 
+	size_t shortfall_frames, 
+	loop_t* p_keep, 
+	loop_t** evicted)
+{
+	director_loop_stats_t stats;
+	loop_t* p_loop = NULL;
+	size_t evicted_count = 0;
+	size_t evicted_frames = 0;
+	size_t victim = 0;
+	size_t count = 0;
+	size_t i = 0;
+	double rank = 0.0;
+	double lowest = 0.0;
+	double now = _director_seconds();
+	loop_t* shown[DIRECTOR_MAX_LAYERS];
+	size_t shown_count = 0;
+
+	/* called with loops_mutex held.  loops on screen are left alone, among
+	 * equal ranks the oldest loop goes first. */
+	shown_count = _director_shown_loops(p_director, shown);
+	vector_count(p_director->loops, &count);
+	while ((evicted_count < DIRECTOR_MAX_LAYERS) && 
+		((evicted_frames < shortfall_frames) || 
+		 ((0 != p_director->max_loop_bytes) && 
+		  (p_director->loop_bytes > p_director->max_loop_bytes))))
+	{
+		victim = count;
+		for (i = 0; i < count; i++) {
+			if (NO_ERROR != vector_element_copy(p_director->loops, i, (void*)&p_loop)) {
+				continue;
+			}
+			if ((p_keep == p_loop) || 
+				(TRUE == _director_find_loop(shown, shown_count, p_loop))) 
+			{
+				continue;
+			}
+			_director_loop_stats(p_loop, now, &stats);
+			rank = p_director->eviction_rank(&stats);
+			if ((victim == count) || (rank < lowest)) {
+				victim = i;
+				lowest = rank;
+			}
+		}
+		if ((victim == count) || 
+			(NO_ERROR != vector_element_copy(p_director->loops, victim, (void*)&p_loop)) ||
+			(NO_ERROR != vector_remove(p_director->loops, victim))) 
+		{
+			break;
+		}
+		count--;
+		p_director->loop_bytes -= p_loop->bytes;
+		evicted[evicted_count++] = p_loop;
+		evicted_frames += p_loop->frame_count;
 	}
-	memset(p_thread_data, 0, sizeof(thread_data_t));
+	return evicted_count;
+}
 
-	p_thread_data->thread = 0;
-	p_thread_data->director = p_director;
-	p_thread_data->loop = p_loop;
+void _director_enforce_budget(director_t* p_director, loop_t* p_keep) {
+	loop_t* evicted[DIRECTOR_MAX_LAYERS];
+	size_t evicted_count = 0;
 
-	*pp_td = p_thread_data;
+	do {
+		pthread_mutex_lock(&(p_director->loops_mutex));
+		evicted_count = _director_evict_loops(p_director, 0, p_keep, evicted);
+		if (evicted_count > 0) {
+			_director_publish_loops(p_director, evicted, evicted_count);
+		}
+		pthread_mutex_unlock(&(p_director->loops_mutex));
 
-	return NO_ERROR;
+		if (evicted_count > 0) {
+			LOG_DEBUG("evicted %zu loops to stay within the loop budget", evicted_count);
+		}
+	} while (DIRECTOR_MAX_LAYERS == evicted_count);
+	_director_reclaim(p_director);
 }
 
-void _thread_data_release(thread_data_t* p_td) {
-	if (NULL != p_td) {
-		free(p_td);
-	}
+void _director_loop_stats(
+	loop_t* p_loop, 
+	double now, 
+	director_loop_stats_t* p_stats)
+{
+	p_stats->age_seconds = now - p_loop->created_time;
+	p_stats->idle_seconds = now - 
+		((p_loop->play_count > 0) ? p_loop->last_played : p_loop->created_time);
+	p_stats->play_count = p_loop->play_count;
+	p_stats->presence = p_loop->presence;
+	p_stats->bytes = p_loop->bytes;
+	p_stats->frame_count = p_loop->frame_count;
 }
 
+double _director_seconds(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
 
-void* _handle_new_loop(void* data) {
+status_t _director_publish_loops(
+	director_t* p_director, 
+	loop_t** evicted, 
+	size_t evicted_count)
+{
 	status_t status = NO_ERROR;
-	thread_data_t* p_td = (thread_data_t*)data;
-	//motion_detector_handle_t motion_detector = NULL;
-	size_t pixel_count = 0;
-	//size_t frame_count = 0;
-	//size_t i = 0;
-	director_t* director = NULL;
+	loop_list_t* p_list = NULL;
+	loop_list_t* p_old_list = p_director->loop_list;
+	retired_t retired;
+	size_t i = 0;
 
-	if (NULL == p_td) {
-		LOG_ERROR("null thread data")
-		pthread_exit(NULL);
+	/* called with loops_mutex held.  without a new list the evicted loops
+	 * stay reachable and are retired with the current one. */
+	status = _loop_list_create(
+		p_director->loops, 
+		p_old_list->generation + 1, 
+		&p_list);
+	if (NO_ERROR == status) {
+		__sync_synchronize();
+		p_director->loop_list = p_list;
+		__sync_synchronize();
+
+		memset(&retired, 0, sizeof(retired_t));
+		retired.generation = p_old_list->generation;
+		retired.list = p_old_list;
+		if (NO_ERROR != vector_append(p_director->retired, &retired)) {
+			LOG_ERROR("failed to retire loop list");
+		}
 	}
 
-	director = p_td->director;
-	pixel_count = director->bytes_per_depth_frame / director->bytes_per_depth_pixel;
-
-	/* create motion detector 
-	status = motion_detector_create(
-		p_td->director->bytes_per_depth_pixel,
-		pixel_count,
-		TRUE,
-		&motion_detector);
-	if (NO_ERROR != status) {
-		LOG_ERROR("failed to create motion detector");
-		return NULL;
+	for (i = 0; i < evicted_count; i++) {
+		memset(&retired, 0, sizeof(retired_t));
+		retired.generation = p_old_list->generation;
+		retired.loop = evicted[i];
+		if (NO_ERROR != vector_append(p_director->retired, &retired)) {
+			LOG_ERROR("failed to retire evicted loop");
+		}
 	}
+	return status;
+}
 
-		*/
+void _director_reclaim(director_t* p_director) {
+	retired_t retired;
+	loop_t* released[DIRECTOR_MAX_LAYERS];
+	size_t released_count = 0;
+	loop_t* shown[DIRECTOR_MAX_LAYERS];
+	size_t shown_count = 0;
+	size_t shown_generation = 0;
+	size_t generation = 0;
+	int in_pass = FALSE;
+	size_t count = 0;
+	size_t i = 0;
 
-	/* TODO: trim frames at beginning and end w/o enough presence or motion */
-	/* TODO: remove old loops if too many loops exist */
-	/*
-	for (i = 0; i < frame_count; i++) {
-		status_t motion_detector_detect(
-			motion_detector_handle_t handle,
-			void* depth, 
-			int cutoff, 
-			double* p_motion, 
-			double* p_presence);
-	}
-	*/
+	do {
+		released_count = 0;
+		pthread_mutex_lock(&(p_director->loops_mutex));
+		/* the pass flag first, a pass that starts later sees the newest
+		 * list */
+		__sync_synchronize();
+		in_pass = p_director->reader_in_pass;
+		__sync_synchronize();
+		pthread_mutex_lock(&(p_director->decode_mutex));
+		shown_generation = p_director->shown_generation;
+		shown_count = p_director->shown_count;
+		memcpy(shown, p_director->shown_loops, shown_count * sizeof(loop_t*));
+		pthread_mutex_unlock(&(p_director->decode_mutex));
+		generation = p_director->loop_list->generation;
+
+		vector_count(p_director->retired, &count);
+		i = count;
+		while ((i > 0) && (released_count < DIRECTOR_MAX_LAYERS)) {
+			i--;
+			if (NO_ERROR != vector_element_copy(p_director->retired, i, (void*)&retired)) {
+				continue;
+			}
+			if ((retired.generation >= generation) || 
+				((shown_generation <= retired.generation) && 
+				 ((TRUE == in_pass) || 
+				  (TRUE == _director_find_loop(shown, shown_count, retired.loop)))))
+			{
+				/* playback may still use it */
+				continue;
+			}
+			vector_remove(p_director->retired, i);
+			free(retired.list);
+			if (NULL != retired.loop) {
+				released[released_count++] = retired.loop;
+			}
+		}
+		pthread_mutex_unlock(&(p_director->loops_mutex));
 
-	pthread_mutex_lock(&(director->loops_mutex));
-	status = vector_append(director->loops, (void*)&(p_td->loop));
-	pthread_mutex_unlock(&(director->loops_mutex));
+		/* frames are returned outside the loops lock */
+		for (i = 0; i < released_count; i++) {
+			_director_release_loop(p_director, released[i]);
+		}
+	} while (DIRECTOR_MAX_LAYERS == released_count);
+}
 
-	if (NO_ERROR != status) {
-		_loop_release(p_td->loop);
-		LOG_ERROR("failed to append loop to loops");
-		_thread_data_release(p_td);
-		pthread_exit(NULL);
+size_t _director_shown_loops(director_t* p_director, loop_t** loops) {
+	size_t count = 0;
+
+	pthread_mutex_lock(&(p_director->decode_mutex));
+	count = p_director->shown_count;
+	memcpy(loops, p_director->shown_loops, count * sizeof(loop_t*));
+	pthread_mutex_unlock(&(p_director->decode_mutex));
+	return count;
+}
+
+bool_t _director_find_loop(loop_t** loops, size_t count, loop_t* p_loop) {
+	size_t i = 0;
+
+	if (NULL == p_loop) {
+		return FALSE;
+	}
+	for (i = 0; i < count; i++) {
+		if (p_loop == loops[i]) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+void _director_end_pass(
+	director_t* p_director, 
+	loop_list_t* p_list, 
+	const frame_id_t* late_frame_ids, 
+	size_t late_count)
+{
+	loop_t* p_loop = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	size_t layer_index = 0;
+	size_t i = 0;
+
+	/* the decode thread works from what is on screen now */
+	pthread_mutex_lock(&(p_director->decode_mutex));
+	p_director->shown_count = 0;
+	for (layer_index = 0; layer_index < p_director->max_layers; layer_index++) {
+		p_loop = p_director->playing_loops[layer_index];
+		if (NULL != p_loop) {
+			p_director->shown_loops[p_director->shown_count] = p_loop;
+			p_director->shown_frames[p_director->shown_count] = p_loop->next_frame;
+			p_director->shown_count++;
+		}
+	}
+	p_director->shown_generation = p_list->generation;
+	for (i = 0; i < late_count; i++) {
+		frame_id = late_frame_ids[i];
+		vector_append(p_director->late_frame_ids, &frame_id);
+	}
+	p_director->late_decodes += late_count;
+	p_director->decode_requested = TRUE;
+	pthread_cond_signal(&(p_director->decode_cond));
+	pthread_mutex_unlock(&(p_director->decode_mutex));
+
+	__sync_synchronize();
+	p_director->reader_in_pass = FALSE;
+	__sync_synchronize();
+}
+
+status_t _director_fill_layers(director_t* p_director, loop_list_t* p_list) {
+	loop_t* p_loop = NULL;
+	size_t layer_index = 0;
+	size_t loop_index = 0;
+	double now = 0.0;
+
+	for (layer_index = 0; layer_index < p_director->max_layers; layer_index++) {
+		if (NULL == p_director->playing_loops[layer_index]) {
+			/* choose random loop */
+			loop_index = rand() % p_list->count;
+			p_loop = p_list->loops[loop_index];
+			if (0.0 == now) {
+				now = _director_seconds();
+			}
+			p_loop->play_count++;
+			p_loop->last_played = now;
+			p_director->playing_loops[layer_index] = p_loop;
+		}
+	}
+	return NO_ERROR;
+}
+
+bool_t _director_advance_loop(loop_t* p_loop, timestamp_t play_time) {
+	loop_frame_t* frames = NULL;
+	timestamp_t playhead = 0.0;
+	timestamp_t length = 0.0;
+	size_t count = p_loop->frame_count;
+	size_t low = 0;
+	size_t high = 0;
+	size_t middle = 0;
+
+	if ((0 == count) || 
+		(NO_ERROR != vector_array(p_loop->frames, (void**)&frames))) 
+	{
+		return FALSE;
+	}
+	if (p_loop->play_start < 0.0) {
+		p_loop->play_start = play_time;
+	}
+
+	length = (count > 1) ? 
+		(frames[count - 1].timestamp - frames[0].timestamp) * (double)count / (double)(count - 1) : 
+		DIRECTOR_FRAME_SECONDS;
+	playhead = play_time - p_loop->play_start;
+	if (playhead >= length) {
+		return FALSE;
+	}
+	playhead += frames[0].timestamp;
+
+	/* the last frame recorded at or before the playhead */
+	low = 0;
+	high = count;
+	while (high - low > 1) {
+		middle = low + (high - low) / 2;
+		if (frames[middle].timestamp <= playhead) {
+			low = middle;
+		}
+		else {
+			high = middle;
+		}
+	}
+	p_loop->next_frame = low;
+	return TRUE;
+}
+
+int _director_motion_cutoff(director_t* p_director, float cutoff) {
+	return (short)((unsigned)(cutoff * 65536) / p_director->depth_scale);
+}
+
+/* Before a loop is compressed its frames are scored again and those at
+ * either end without enough presence or motion are dropped, such as the
+ * patience frames recording always ends with. */
+status_t _director_trim_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+	motion_detector_handle_t motion_detector = NULL;
+	loop_frame_t* frames = NULL;
+	frame_id_t* frame_ids = NULL;
+	void* depth = NULL;
+	timestamp_t timestamp = 0.0;
+	double motion = 0.0;
+	double presence = 0.0;
+	double presence_sum = 0.0;
+	size_t presence_count = 0;
+	bool_t present = FALSE;
+	bool_t moving = FALSE;
+	bool_t first_present = FALSE;
+	bool_t second_moving = TRUE;
+	bool_t first_scored = FALSE;
+	size_t count = p_loop->frame_count;
+	size_t first = count;
+	size_t end = 0;
+	size_t i = 0;
+
+	status = motion_detector_create(
+		p_director->bytes_per_depth_pixel,
+		p_director->motion_pixel_count,
+		TRUE,
+		&motion_detector);
+	if (NO_ERROR == status) {
+		status = vector_array(p_loop->frames, (void**)&frames);
+	}
+	if (NO_ERROR != status) {
+		/* the loop is kept as it was recorded */
+		motion_detector_release(motion_detector);
+		return NO_ERROR;
+	}
+
+	/* the loop is not published yet, so its frames stay where they are
+	 * once looked up.  first and end bound the frames after the first that
+	 * are kept, the first frame is decided once the second is scored. */
+	for (i = 0; i < count; i++) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		if (0 != p_director->preview_level) {
+			status = frame_store_preview_frame(
+				p_director->frame_store, 
+				frames[i].frame_id, 
+				p_director->preview_level, 
+				NULL, 
+				&depth);
+		}
+		else {
+			status = frame_store_depth_frame(
+				p_director->frame_store, 
+				frames[i].frame_id, 
+				&depth, 
+				&timestamp);
+		}
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		if (NO_ERROR == status) {
+			status = motion_detector_detect(
+				motion_detector, 
+				depth, 
+				_director_motion_cutoff(p_director, frames[i].cutoff), 
+				&motion, 
+				&presence);
+		}
+		if (NO_ERROR != status) {
+			/* a frame that cannot be scored is kept */
+			motion_detector_reset(motion_detector);
+			present = TRUE;
+			moving = TRUE;
+		}
+		else {
+			frames[i].presence = (float)presence;
+			frames[i].motion = (float)motion;
+			present = (presence >= p_director->valid_frame_min_presence);
+			moving = (motion >= p_director->valid_frame_min_motion);
+		}
+
+		if (0 == i) {
+			first_present = present;
+			first_scored = (NO_ERROR == status);
+			continue;
+		}
+		if (1 == i) {
+			second_moving = moving;
+		}
+		if ((TRUE == present) && (TRUE == moving)) {
+			if (NO_ERROR == status) {
+				presence_sum += presence;
+				presence_count++;
+			}
+			if (first > i) {
+				first = i;
+			}
+			end = i + 1;
+		}
+	}
+	motion_detector_release(motion_detector);
+
+	/* the first frame has nothing before it to move against, so it takes
+	 * the second's motion */
+	if ((count > 0) && (TRUE == first_present) && (TRUE == second_moving)) {
+		if (TRUE == first_scored) {
+			presence_sum += frames[0].presence;
+			presence_count++;
+		}
+		first = 0;
+		if (0 == end) {
+			end = 1;
+		}
+	}
+	if (presence_count > 0) {
+		p_loop->presence = presence_sum / (double)presence_count;
+	}
+
+	if ((first >= end) || (end - first < p_director->loop_min_frame_count)) {
+		return ERR_EMPTY;
+	}
+	if ((0 == first) && (end == count)) {
+		return NO_ERROR;
+	}
+
+	/* dead frames go back to the store */
+	status = _loop_frame_ids(p_loop, &frame_ids);
+	if (NO_ERROR != status) {
+		/* kept as it was recorded */
+		return NO_ERROR;
+	}
+	pthread_mutex_lock(&(p_director->frame_store_mutex));
+	frame_store_remove_frames(p_director->frame_store, first, frame_ids);
+	frame_store_remove_frames(
+		p_director->frame_store, 
+		count - end, 
+		&(frame_ids[end]));
+	pthread_mutex_unlock(&(p_director->frame_store_mutex));
+	free(frame_ids);
+
+	/* the frames kept move to the front in one go */
+	if (first > 0) {
+		memmove(frames, &(frames[first]), (end - first) * sizeof(loop_frame_t));
+	}
+	for (i = end - first; i < count; i++) {
+		vector_pop(p_loop->frames);
+	}
+	p_loop->frame_count = end - first;
+	return NO_ERROR;
+}
+
+/* With director_set_depth_filter every depth pixel of a finished loop
+ * becomes the median of itself and the same pixel in the frames either
+ * side, which stops single frame flicker at the edges of the cutoff.  The
+ * first and last frames have only one neighbour and are left as they are. */
+status_t _director_filter_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+	loop_frame_t* frames = NULL;
+	size_t pixel_count = p_director->bytes_per_depth_frame / 2;
+	unsigned short* scratch = NULL;
+	unsigned short* before = NULL;
+	unsigned short* current = NULL;
+	unsigned short* swap = NULL;
+	unsigned short* next = NULL;
+	unsigned short* output = NULL;
+	timestamp_t timestamp = 0.0;
+	size_t i = 0;
+	size_t j = 0;
+
+	if (2 != p_director->bytes_per_depth_pixel) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	if (p_loop->frame_count < 3) {
+		return NO_ERROR;
+	}
+	status = vector_array(p_loop->frames, (void**)&frames);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* the frames are written as the window moves on, so the window keeps
+	 * copies of the unfiltered frames before and at the one written */
+	scratch = (unsigned short*)malloc(2 * p_director->bytes_per_depth_frame);
+	if (NULL == scratch) {
+		return ERR_FAILED_ALLOC;
+	}
+	before = scratch;
+	current = &(scratch[pixel_count]);
+
+	pthread_mutex_lock(&(p_director->frame_store_mutex));
+	status = frame_store_depth_frame(
+		p_director->frame_store, 
+		frames[0].frame_id, 
+		(void**)&next, 
+		&timestamp);
+	if (NO_ERROR == status) {
+		memcpy(before, next, p_director->bytes_per_depth_frame);
+		status = frame_store_depth_frame(
+			p_director->frame_store, 
+			frames[1].frame_id, 
+			(void**)&output, 
+			&timestamp);
+	}
+	if (NO_ERROR == status) {
+		memcpy(current, output, p_director->bytes_per_depth_frame);
+	}
+	pthread_mutex_unlock(&(p_director->frame_store_mutex));
+
+	/* filtered in place, the frames are not shared until published */
+	for (i = 1; (NO_ERROR == status) && (i + 1 < p_loop->frame_count); i++) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_depth_frame(
+			p_director->frame_store, 
+			frames[i + 1].frame_id, 
+			(void**)&next, 
+			&timestamp);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		if (NO_ERROR != status) {
+			break;
+		}
+
+		for (j = 0; j < pixel_count; j++) {
+			output[j] = _director_median3(before[j], current[j], next[j]);
+		}
+
+		/* previews made from the unfiltered depth no longer match it */
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		frame_store_update_previews(p_director->frame_store, frames[i].frame_id);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+
+		swap = before;
+		before = current;
+		current = swap;
+		memcpy(current, next, p_director->bytes_per_depth_frame);
+		output = next;
+	}
+	free(scratch);
+	return status;
+}
+
+unsigned short _director_median3(
+	unsigned short a, 
+	unsigned short b, 
+	unsigned short c)
+{
+	unsigned short low = (a < b) ? a : b;
+	unsigned short high = (a < b) ? b : a;
+
+	/* the larger of the smaller pair and the smaller of the rest */
+	high = (high < c) ? high : c;
+	return (low > high) ? low : high;
+}
+
+void _director_compress_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+	loop_frame_t frame;
+	frame_store_compression_stats_t stats;
+	bool_t made_room = FALSE;
+	size_t late_decodes = 0;
+	float max_depth = 0.0f;
+	size_t i = 0;
+
+	/* one frame at a time so capture is not held up for the whole loop */
+	for (i = 0; i < p_loop->frame_count; i++) {
+		status = vector_element_copy(p_loop->frames, i, (void*)&frame);
+		if (NO_ERROR != status) {
+			break;
+		}
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		if (p_director->foreground) {
+			/* in raw depth units, as the motion cutoff */
+			max_depth = (frame.cutoff + DIRECTOR_CUTOFF_FADE) * 65536.0f / p_director->depth_scale;
+			status = frame_store_compress_foreground(
+				p_director->frame_store, 
+				frame.frame_id, 
+				(max_depth < 65535.0f) ? (unsigned short)max_depth : 0xffff);
+		}
+		else {
+			status = frame_store_compress_frame(p_director->frame_store, frame.frame_id);
+		}
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+
+		if ((ERR_FULL == status) && (FALSE == made_room)) {
+			/* move cold loops to disk, or evict them the same way as when
+			 * capture runs short once the disk is full too */
+			made_room = TRUE;
+			if (_director_spill_loops(p_director, p_loop->frame_count - i) < 
+				p_loop->frame_count - i) 
+			{
+				_director_handle_pressure(
+					p_director->frame_store, 
+					p_loop->frame_count - i, 
+					p_director);
+			}
+			i--;
+			continue;
+		}
+		if (NO_ERROR != status) {
+			/* the rest of the loop stays uncompressed */
+			LOG_WARNING("failed to compress loop frame (%s)", error_string(status));
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&(p_director->decode_mutex));
+	late_decodes = p_director->late_decodes;
+	pthread_mutex_unlock(&(p_director->decode_mutex));
+	pthread_mutex_lock(&(p_director->frame_store_mutex));
+	status = frame_store_compression_stats(p_director->frame_store, &stats);
+	pthread_mutex_unlock(&(p_director->frame_store_mutex));
+	if ((NO_ERROR == status) && (stats.compressed_bytes > 0)) {
+		LOG_INFO(
+			"compressed %zu frames %.2f:1, %.2f ms encode, %.2f ms decode per frame, %zu late",
+			stats.compressed_frames,
+			(double)stats.raw_bytes / (double)stats.compressed_bytes,
+			stats.encode_seconds * 1000.0 / (double)stats.encoded_frames,
+			(stats.decoded_frames > 0) ? 
+				stats.decode_seconds * 1000.0 / (double)stats.decoded_frames : 
+				0.0,
+			late_decodes);
+	}
+}
+
+void _director_pack_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+	frame_id_t* frame_ids = NULL;
+
+	/* frames were compressed in whatever order the allocator handed out
+	 * memory.  one copy in playback order lets decoding, spilling and
+	 * archiving read the loop front to back. */
+	status = _loop_frame_ids(p_loop, &frame_ids);
+	if (NO_ERROR == status) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_pack_frames(
+			p_director->frame_store, 
+			p_loop->frame_count, 
+			frame_ids);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		free(frame_ids);
+	}
+	if (NO_ERROR != status) {
+		LOG_WARNING("failed to pack loop frames (%s)", error_string(status));
+	}
+}
+
+void _director_measure_loop(director_t* p_director, loop_t* p_loop) {
+	loop_frame_t* frames = NULL;
+	const void* data = NULL;
+	size_t size = 0;
+	size_t i = 0;
+
+	/* what the loop's frames hold in the store, raw if not compressed */
+	p_loop->bytes = 0;
+	if (NO_ERROR != vector_array(p_loop->frames, (void**)&frames)) {
+		return;
+	}
+	for (i = 0; i < p_loop->frame_count; i++) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		if (NO_ERROR != frame_store_compressed_frame(
+			p_director->frame_store, 
+			frames[i].frame_id, 
+			&data, 
+			&size, 
+			NULL)) 
+		{
+			size = p_director->bytes_per_video_frame + p_director->bytes_per_depth_frame;
+		}
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		p_loop->bytes += size;
+	}
+}
+
+size_t _director_spill_loops(director_t* p_director, size_t frame_count) {
+	status_t status = NO_ERROR;
+	vector_handle_t frame_ids = NULL;
+	vector_handle_t spill_loops = NULL;
+	spill_loop_t spill_loop;
+	frame_id_t frame_id = invalid_frame_id;
+	loop_frame_t* p_frame = NULL;
+	loop_t* p_loop = NULL;
+	size_t loop_count = 0;
+	size_t count = 0;
+	size_t spilled = 0;
+	size_t loop_spilled = 0;
+	size_t spill_count = 0;
+	size_t whole_loops = 0;
+	size_t i = 0;
+	size_t j = 0;
+	loop_t* shown[DIRECTOR_MAX_LAYERS];
+	size_t shown_count = 0;
+
+	status = vector_create(128, sizeof(frame_id_t), &frame_ids);
+	if (NO_ERROR == status) {
+		status = vector_create(8, sizeof(spill_loop_t), &spill_loops);
+	}
+	if (NO_ERROR != status) {
+		vector_release(frame_ids);
+		return 0;
+	}
+
+	/* pick the oldest loops not playing.  the writing happens without
+	 * loops_mutex so publishing is not held up by the disk, ids of loops
+	 * evicted meanwhile are rejected.  loops are only marked spilled once
+	 * all their frames made it, a loop cut short is picked again later. */
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	shown_count = _director_shown_loops(p_director, shown);
+	vector_count(p_director->loops, &loop_count);
+	for (i = 0; (i < loop_count) && (count < frame_count); i++) {
+		vector_element_copy(p_director->loops, i, (void*)&p_loop);
+		if ((TRUE == p_loop->spilled) || 
+			(TRUE == _director_find_loop(shown, shown_count, p_loop))) 
+		{
+			continue;
+		}
+		if ((0 == p_loop->frame_count) || 
+			(NO_ERROR != vector_element_address(p_loop->frames, 0, (void**)&p_frame)))
+		{
+			continue;
+		}
+		spill_loop.loop = p_loop;
+		spill_loop.first_frame_id = p_frame->frame_id;
+		spill_loop.frame_count = p_loop->frame_count;
+		if (NO_ERROR != vector_append(spill_loops, &spill_loop)) {
+			break;
+		}
+		for (j = 0; j < p_loop->frame_count; j++) {
+			vector_element_address(p_loop->frames, j, (void**)&p_frame);
+			vector_append(frame_ids, &(p_frame->frame_id));
+		}
+		count += p_loop->frame_count;
+	}
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+
+	/* frames of one loop follow each other in frame_ids */
+	vector_count(spill_loops, &spill_count);
+	vector_count(frame_ids, &count);
+	i = 0;
+	for (whole_loops = 0; whole_loops < spill_count; whole_loops++) {
+		vector_element_copy(spill_loops, whole_loops, (void*)&spill_loop);
+		loop_spilled = 0;
+		for (; (loop_spilled < spill_loop.frame_count) && (i < count); i++) {
+			vector_element_copy(frame_ids, i, (void*)&frame_id);
+			pthread_mutex_lock(&(p_director->frame_store_mutex));
+			status = frame_store_spill_frame(p_director->frame_store, frame_id);
+			pthread_mutex_unlock(&(p_director->frame_store_mutex));
+			if ((ERR_FULL == status) || 
+				(ERR_IO_ERROR == status) || 
+				(ERR_UNSUPPORTED_FORMAT == status)) 
+			{
+				/* no spill file or no room left in it */
+				break;
+			}
+			/* frames removed meanwhile need no spilling either */
+			spilled += (NO_ERROR == status) ? 1 : 0;
+			loop_spilled++;
+		}
+		if (loop_spilled < spill_loop.frame_count) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	vector_count(p_director->loops, &loop_count);
+	for (j = 0; j < whole_loops; j++) {
+		vector_element_copy(spill_loops, j, (void*)&spill_loop);
+		for (i = 0; i < loop_count; i++) {
+			vector_element_copy(p_director->loops, i, (void*)&p_loop);
+			if ((p_loop == spill_loop.loop) && 
+				(NO_ERROR == vector_element_address(p_loop->frames, 0, (void**)&p_frame)) &&
+				(p_frame->frame_id == spill_loop.first_frame_id))
+			{
+				p_loop->spilled = TRUE;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+	vector_release(spill_loops);
+	vector_release(frame_ids);
+
+	if (spilled > 0) {
+		LOG_INFO("spilled %zu frames to disk", spilled);
+	}
+	return spilled;
+}
+
+void* _director_decode_thread(void* data) {
+	director_t* p_director = (director_t*)data;
+
+	pthread_mutex_lock(&(p_director->decode_mutex));
+	while (FALSE == p_director->decode_exit) {
+		if (FALSE == p_director->decode_requested) {
+			pthread_cond_wait(
+				&(p_director->decode_cond), 
+				&(p_director->decode_mutex));
+			continue;
+		}
+		p_director->decode_requested = FALSE;
+		pthread_mutex_unlock(&(p_director->decode_mutex));
+
+		_director_decode_ahead(p_director);
+		/* and release what playback has moved past */
+		_director_reclaim(p_director);
+
+		pthread_mutex_lock(&(p_director->decode_mutex));
+	}
+	pthread_mutex_unlock(&(p_director->decode_mutex));
+	return NULL;
+}
+
+void _director_decode_ahead(director_t* p_director) {
+	frame_id_t window[DIRECTOR_MAX_LAYERS * DIRECTOR_DECODE_AHEAD];
+	size_t window_count = 0;
+	frame_id_t frame_id = invalid_frame_id;
+	loop_t* p_loop = NULL;
+	loop_frame_t frame;
+	loop_t* shown[DIRECTOR_MAX_LAYERS];
+	size_t next_frames[DIRECTOR_MAX_LAYERS];
+	size_t shown_count = 0;
+	size_t layer_index = 0;
+	size_t count = 0;
+	size_t i = 0;
+	status_t status = NO_ERROR;
+	bool_t shrunk = FALSE;
+
+	/* the frames each loop playback last showed shows next.  holding
+	 * loops_mutex keeps them from being released meanwhile. */
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	pthread_mutex_lock(&(p_director->decode_mutex));
+	shown_count = p_director->shown_count;
+	memcpy(shown, p_director->shown_loops, shown_count * sizeof(loop_t*));
+	memcpy(next_frames, p_director->shown_frames, shown_count * sizeof(size_t));
+	/* take over the frames playback expanded */
+	vector_count(p_director->late_frame_ids, &count);
+	for (i = 0; i < count; i++) {
+		if (NO_ERROR == vector_element_copy(
+			p_director->late_frame_ids, 
+			i, 
+			(void*)&frame_id))
+		{
+			_director_track_frame(p_director, frame_id);
+		}
+	}
+	vector_clear(p_director->late_frame_ids);
+	pthread_mutex_unlock(&(p_director->decode_mutex));
+
+	for (layer_index = 0; layer_index < shown_count; layer_index++) {
+		p_loop = shown[layer_index];
+		for (i = next_frames[layer_index]; 
+			(i < p_loop->frame_count) && 
+			(i < next_frames[layer_index] + DIRECTOR_PREFETCH_AHEAD); 
+			i++)
+		{
+			if (NO_ERROR != vector_element_copy(
+				p_loop->frames, 
+				i, 
+				(void*)&frame)) 
+			{
+				continue;
+			}
+			frame_id = frame.frame_id;
+			if (i < next_frames[layer_index] + DIRECTOR_DECODE_AHEAD) {
+				window[window_count++] = frame_id;
+			}
+			else if (TRUE == p_loop->spilled) {
+				vector_append(p_director->prefetch_frame_ids, &frame_id);
+			}
+		}
+	}
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+
+	/* have the disk read further ahead while the window is decoded */
+	vector_count(p_director->prefetch_frame_ids, &count);
+	for (i = 0; i < count; i++) {
+		vector_element_copy(p_director->prefetch_frame_ids, i, (void*)&frame_id);
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		frame_store_prefetch_frame(p_director->frame_store, frame_id);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+	}
+	vector_clear(p_director->prefetch_frame_ids);
+
+	/* expand the window.  ids of evicted loops are simply rejected. */
+	for (i = 0; i < window_count; i++) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_expand_frame(p_director->frame_store, window[i]);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		if (NO_ERROR == status) {
+			_director_track_frame(p_director, window[i]);
+		}
+	}
+
+	/* shrink what has been shown, frames still on screen are pinned and
+	 * stay until a later pass */
+	vector_count(p_director->expanded_frame_ids, &count);
+	i = count;
+	while (i > 0) {
+		i--;
+		vector_element_copy(p_director->expanded_frame_ids, i, (void*)&frame_id);
+		if (TRUE == _director_find_frame(window, window_count, frame_id)) {
+			continue;
+		}
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_shrink_frame(
+			p_director->frame_store, 
+			frame_id, 
+			&shrunk);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		if ((NO_ERROR != status) || (TRUE == shrunk)) {
+			vector_remove(p_director->expanded_frame_ids, i);
+		}
+	}
+}
+
+void _director_track_frame(director_t* p_director, frame_id_t frame_id) {
+	frame_id_t* frame_ids = NULL;
+	size_t count = 0;
+
+	vector_count(p_director->expanded_frame_ids, &count);
+	vector_array(p_director->expanded_frame_ids, (void**)&frame_ids);
+	if (FALSE == _director_find_frame(frame_ids, count, frame_id)) {
+		vector_append(p_director->expanded_frame_ids, &frame_id);
+	}
+}
+
+bool_t _director_find_frame(
+	const frame_id_t* frame_ids, 
+	size_t count, 
+	frame_id_t frame_id)
+{
+	size_t i = 0;
+
+	for (i = 0; i < count; i++) {
+		if (frame_id == frame_ids[i]) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+void _director_set_live_frame(director_t* p_director, frame_id_t frame_id) {
+	/* called with frame_store_mutex held */
+	frame_handle_t frame = NULL;
+	bool_t shrunk = FALSE;
+
+	if (NO_ERROR != frame_store_acquire_frame(
+		p_director->frame_store, 
+		frame_id, 
+		&frame))
+	{
+		return;
+	}
+	if (NULL != p_director->live_frame) {
+		frame_store_release_frame(p_director->frame_store, p_director->live_frame);
+		/* a loop compressed while its frame was live left the planes */
+		frame_store_shrink_frame(
+			p_director->frame_store, 
+			p_director->live_frame_id, 
+			&shrunk);
+	}
+	p_director->live_frame = frame;
+	p_director->live_frame_id = frame_id;
+}
+
+void _director_release_loop(director_t* p_director, loop_t* p_loop) {
+	frame_id_t* frame_ids = NULL;
+	char path[DIRECTOR_ARCHIVE_PATH_BYTES];
+
+	if (NULL == p_loop) {
+		return;
+	}
+
+	/* return every frame of the loop to the store in one call */
+	if (NO_ERROR == _loop_frame_ids(p_loop, &frame_ids)) {
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		frame_store_remove_frames(
+			p_director->frame_store, 
+			p_loop->frame_count, 
+			frame_ids);
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		free(frame_ids);
+	}
+
+	/* an evicted loop is not restored either.  loops released with the
+	 * director keep their files. */
+	if (0 != p_loop->archive_serial) {
+		_director_archive_path(p_director, p_loop->archive_serial, path);
+		unlink(path);
+	}
+
+	_loop_release(p_loop);
+}
+
+void _director_archive_path(
+	director_t* p_director, 
+	size_t serial, 
+	char* path)
+{
+	snprintf(
+		path, 
+		DIRECTOR_ARCHIVE_PATH_BYTES, 
+		"%s/loop_%08zu.kgl", 
+		p_director->archive_dir, 
+		serial);
+}
+
+status_t _director_archive_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+	loop_archive_writer_handle_t writer = NULL;
+	char path[DIRECTOR_ARCHIVE_PATH_BYTES];
+	loop_frame_t frame;
+	const void* data = NULL;
+	size_t size = 0;
+	unsigned char* copy = NULL;
+	unsigned char* grown = NULL;
+	size_t copy_bytes = 0;
+	timestamp_t timestamp = 0;
+	size_t serial = 0;
+	size_t i = 0;
+
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	serial = p_director->next_archive_serial++;
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+
+	_director_archive_path(p_director, serial, path);
+	status = loop_archive_writer_create(
+		path,
+		p_director->bytes_per_video_frame,
+		p_director->bytes_per_depth_frame,
+		p_loop->frame_count,
+		&writer);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* compressed data only stays put while the store is locked, so it is
+	 * copied out and written once the lock is dropped */
+	for (i = 0; (NO_ERROR == status) && (i < p_loop->frame_count); i++) {
+		status = vector_element_copy(p_loop->frames, i, (void*)&frame);
+		if (NO_ERROR != status) {
+			break;
+		}
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_compressed_frame(
+			p_director->frame_store,
+			frame.frame_id,
+			&data,
+			&size,
+			&timestamp);
+		if ((NO_ERROR == status) && (size > copy_bytes)) {
+			grown = (unsigned char*)realloc(copy, size);
+			if (NULL == grown) {
+				status = ERR_FAILED_ALLOC;
+			}
+			else {
+				copy = grown;
+				copy_bytes = size;
+			}
+		}
+		if (NO_ERROR == status) {
+			memcpy(copy, data, size);
+		}
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+
+		if (NO_ERROR == status) {
+			status = loop_archive_writer_add_frame(
+				writer, 
+				copy, 
+				size, 
+				timestamp, 
+				frame.cutoff);
+		}
+	}
+	free(copy);
+	if (NO_ERROR == status) {
+		status = loop_archive_writer_set_presence(writer, p_loop->presence);
+	}
+	if (NO_ERROR == status) {
+		status = loop_archive_writer_finish(writer);
+	}
+	loop_archive_writer_release(writer);
+
+	if (NO_ERROR == status) {
+		p_loop->archive_serial = serial;
+	}
+	return status;
+}
+
+status_t _director_restore_loop(director_t* p_director, size_t serial) {
+	status_t status = NO_ERROR;
+	loop_t* p_loop = NULL;
+	loop_archive_info_t info;
+	char path[DIRECTOR_ARCHIVE_PATH_BYTES];
+	loop_frame_t frame;
+	const void* data = NULL;
+	size_t size = 0;
+	timestamp_t timestamp = 0;
+	float cutoff = 0.0f;
+	size_t i = 0;
+
+	status = _loop_create(&p_loop);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	_director_archive_path(p_director, serial, path);
+	status = loop_archive_open(path, &(p_loop->archive));
+	if (NO_ERROR == status) {
+		status = loop_archive_info(p_loop->archive, &info);
+	}
+	if ((NO_ERROR == status) && 
+		((info.video_bytes != p_director->bytes_per_video_frame) ||
+		 (info.depth_bytes != p_director->bytes_per_depth_frame)))
+	{
+		/* recorded at another resolution */
+		status = ERR_UNSUPPORTED_FORMAT;
+	}
+	if (NO_ERROR != status) {
+		_loop_release(p_loop);
+		return status;
+	}
+
+	/* the frames point into the mapping, only the index is read here */
+	for (i = 0; (NO_ERROR == status) && (i < info.frame_count); i++) {
+		status = loop_archive_frame(
+			p_loop->archive, 
+			i, 
+			&data, 
+			&size, 
+			&timestamp, 
+			&cutoff);
+		if (NO_ERROR != status) {
+			break;
+		}
+		memset(&frame, 0, sizeof(loop_frame_t));
+		pthread_mutex_lock(&(p_director->frame_store_mutex));
+		status = frame_store_restore_frame(
+			p_director->frame_store,
+			data,
+			size,
+			&cutoff,
+			timestamp,
+			&(frame.frame_id));
+		pthread_mutex_unlock(&(p_director->frame_store_mutex));
+		if (NO_ERROR == status) {
+			frame.timestamp = timestamp;
+			frame.cutoff = cutoff;
+			status = vector_append(p_loop->frames, &frame);
+		}
+		if (NO_ERROR == status) {
+			p_loop->frame_count++;
+		}
+	}
+	/* restored frames sit in the file and count as spilled */
+	p_loop->spilled = TRUE;
+	p_loop->created_time = info.archived_time;
+	p_loop->presence = info.presence;
+	p_loop->bytes = info.data_bytes;
+
+	if (NO_ERROR == status) {
+		p_loop->archive_serial = serial;
+		status = _director_publish_loop(p_director, p_loop);
+	}
+	if (NO_ERROR != status) {
+		/* keeps the file, it may fit next time */
+		p_loop->archive_serial = 0;
+		_director_release_loop(p_director, p_loop);
+		return status;
+	}
+	return NO_ERROR;
+}
+
+status_t _director_publish_loop(director_t* p_director, loop_t* p_loop) {
+	status_t status = NO_ERROR;
+
+	/* restored loops keep the time they were first archived */
+	if (0.0 == p_loop->created_time) {
+		p_loop->created_time = _director_seconds();
+	}
+
+	pthread_mutex_lock(&(p_director->loops_mutex));
+	status = vector_append(p_director->loops, (void*)&p_loop);
+	if (NO_ERROR == status) {
+		status = _director_publish_loops(p_director, NULL, 0);
+		if (NO_ERROR != status) {
+			vector_pop(p_director->loops);
+		}
+	}
+	if (NO_ERROR == status) {
+		p_director->loop_bytes += p_loop->bytes;
+	}
+	pthread_mutex_unlock(&(p_director->loops_mutex));
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	_director_enforce_budget(p_director, p_loop);
+	return NO_ERROR;
+}
+
+int _director_compare_serials(const void* a, const void* b) {
+	size_t serial_a = *(const size_t*)a;
+	size_t serial_b = *(const size_t*)b;
+
+	return (serial_a > serial_b) - (serial_a < serial_b);
+}
+
+status_t _job_data_create(
+	director_t* p_director,
+	loop_t* p_loop,
+	job_data_t** pp_jd)
+{
+	job_data_t* p_job_data = NULL;
+	if (NULL == pp_jd) {
+		return ERR_NULL_POINTER;
+	}
+
+	p_job_data = malloc(sizeof(job_data_t));
+	if (NULL == p_job_data) {
+		return ERR_FAILED_ALLOC;
+	}
+	memset(p_job_data, 0, sizeof(job_data_t));
+
+	p_job_data->director = p_director;
+	p_job_data->loop = p_loop;
+
+	*pp_jd = p_job_data;
+
+	return NO_ERROR;
+}
+
+void _job_data_release(job_data_t* p_jd) {
+	if (NULL != p_jd) {
+		free(p_jd);
+	}
+}
+
+
+void _handle_new_loop(void* data) {
+	status_t status = NO_ERROR;
+	job_data_t* p_jd = (job_data_t*)data;
+	director_t* director = NULL;
+
+	if (NULL == p_jd) {
+		LOG_ERROR("null job data")
+		return;
+	}
+
+	director = p_jd->director;
+
+	/* the loop is released if nothing worth playing is left of it */
+	status = _director_trim_loop(director, p_jd->loop);
+	if (NO_ERROR != status) {
+		_director_release_loop(director, p_jd->loop);
+		_job_data_release(p_jd);
+		return;
+	}
+	if (TRUE == director->depth_filter) {
+		status = _director_filter_loop(director, p_jd->loop);
+		if (NO_ERROR != status) {
+			LOG_WARNING("failed to filter loop depth (%s)", error_string(status));
+		}
+	}
+
+	_director_compress_loop(director, p_jd->loop);
+	_director_pack_loop(director, p_jd->loop);
+	_director_measure_loop(director, p_jd->loop);
+	/* before publishing, an evicted loop could be gone while writing */
+	if (NULL != director->archive_dir) {
+		status = _director_archive_loop(director, p_jd->loop);
+		if (NO_ERROR != status) {
+			LOG_WARNING("failed to archive loop (%s)", error_string(status));
+		}
+	}
+
+	status = _director_publish_loop(director, p_jd->loop);
+	if (NO_ERROR != status) {
+		_director_release_loop(director, p_jd->loop);
+		LOG_ERROR("failed to append loop to loops");
+		_job_data_release(p_jd);
+		return;
 	}
-	_thread_data_release(p_td);
-	pthread_exit(NULL);
+	_job_data_release(p_jd);
 }
 
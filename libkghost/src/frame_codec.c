@@ -0,0 +1,531 @@
+#include "frame_codec.h"
+#include "common.h"
+
+#include <string.h>
+
+/* pixels sharing one chroma pair */
+#define FRAME_CODEC_CHROMA_GROUP (4)
+/* luma for the group followed by Co and Cg */
+#define FRAME_CODEC_GROUP_BYTES (FRAME_CODEC_CHROMA_GROUP + 2)
+
+/* where the parts of a coded frame are */
+typedef struct frame_codec_layout_s {
+	size_t depth_pos;
+	size_t depth_size;
+	size_t runs_pos;
+	size_t groups_pos;
+} frame_codec_layout_t;
+
+static size_t _put_varint(unsigned char* data, unsigned long value);
+static status_t _get_varint(
+	const unsigned char* data,
+	size_t size,
+	size_t* p_pos,
+	unsigned long* p_value);
+static unsigned char _clamp(int value);
+static void _encode_group(
+	const unsigned char** pixels,
+	size_t n,
+	unsigned char* data);
+static void _decode_group(
+	const unsigned char* data,
+	unsigned char** pixels,
+	size_t n);
+static size_t _put_runs(
+	const unsigned char* mask,
+	size_t pixel_count,
+	unsigned char* data);
+static status_t _frame_layout(
+	const unsigned char* data,
+	size_t size,
+	size_t video_pixels,
+	frame_codec_layout_t* p_layout);
+
+size_t frame_codec_depth_bound(size_t pixel_count) {
+	/* a difference needs at most 3 varint bytes, a run of one pixel 2 */
+	return 3 * pixel_count;
+}
+
+status_t frame_codec_encode_depth(
+	const unsigned short* depth,
+	size_t pixel_count,
+	unsigned char* data,
+	size_t* p_size)
+{
+	size_t pos = 0;
+	size_t i = 0;
+	size_t run = 0;
+	int previous = 0;
+	int delta = 0;
+	unsigned long zigzag = 0;
+
+	if ((NULL == depth) || (NULL == data) || (NULL == p_size)) {
+		return ERR_NULL_POINTER;
+	}
+
+	i = 0;
+	while (i < pixel_count) {
+		delta = (int)depth[i] - previous;
+		if (0 == delta) {
+			/* count the remaining pixels of the run */
+			run = 1;
+			while ((i + run < pixel_count) && (depth[i + run] == depth[i])) {
+				run++;
+			}
+			data[pos++] = 0;
+			pos += _put_varint(&(data[pos]), (unsigned long)(run - 1));
+			i += run;
+			continue;
+		}
+
+		zigzag = (delta < 0) ?
+			(((unsigned long)(-delta) << 1) - 1) :
+			((unsigned long)delta << 1);
+		pos += _put_varint(&(data[pos]), zigzag);
+		previous = (int)depth[i];
+		i++;
+	}
+
+	*p_size = pos;
+	return NO_ERROR;
+}
+
+status_t frame_codec_decode_depth(
+	const unsigned char* data,
+	size_t size,
+	unsigned short* depth,
+	size_t pixel_count)
+{
+	status_t status = NO_ERROR;
+	size_t pos = 0;
+	size_t i = 0;
+	unsigned long value = 0;
+	long current = 0;
+
+	if ((NULL == data) || (NULL == depth)) {
+		return ERR_NULL_POINTER;
+	}
+
+	while (i < pixel_count) {
+		status = _get_varint(data, size, &pos, &value);
+		if (NO_ERROR != status) {
+			return status;
+		}
+
+		if (0 == value) {
+			status = _get_varint(data, size, &pos, &value);
+			if (NO_ERROR != status) {
+				return status;
+			}
+			if (value >= pixel_count - i) {
+				return ERR_UNSUPPORTED_FORMAT;
+			}
+			value++;
+			while (value > 0) {
+				depth[i++] = (unsigned short)current;
+				value--;
+			}
+			continue;
+		}
+
+		if (value & 1) {
+			current -= (long)((value + 1) >> 1);
+		}
+		else {
+			current += (long)(value >> 1);
+		}
+		if ((current < 0) || (current > 0xffff)) {
+			return ERR_UNSUPPORTED_FORMAT;
+		}
+		depth[i++] = (unsigned short)current;
+	}
+
+	if (pos != size) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	return NO_ERROR;
+}
+
+size_t frame_codec_video_size(size_t pixel_count) {
+	return ((pixel_count + FRAME_CODEC_CHROMA_GROUP - 1)
+		/ FRAME_CODEC_CHROMA_GROUP) * FRAME_CODEC_GROUP_BYTES;
+}
+
+status_t frame_codec_encode_video(
+	const unsigned char* rgb,
+	size_t pixel_count,
+	unsigned char* data)
+{
+	const unsigned char* pixels[FRAME_CODEC_CHROMA_GROUP];
+	size_t i = 0;
+	size_t n = 0;
+
+	if ((NULL == rgb) || (NULL == data)) {
+		return ERR_NULL_POINTER;
+	}
+
+	for (i = 0; i < pixel_count; i += FRAME_CODEC_CHROMA_GROUP) {
+		for (n = 0; (n < FRAME_CODEC_CHROMA_GROUP) && (i + n < pixel_count); n++) {
+			pixels[n] = &(rgb[(i + n) * 3]);
+		}
+		_encode_group(pixels, n, data);
+		data += FRAME_CODEC_GROUP_BYTES;
+	}
+
+	return NO_ERROR;
+}
+
+status_t frame_codec_decode_video(
+	const unsigned char* data,
+	size_t pixel_count,
+	unsigned char* rgb)
+{
+	unsigned char* pixels[FRAME_CODEC_CHROMA_GROUP];
+	size_t i = 0;
+	size_t n = 0;
+
+	if ((NULL == data) || (NULL == rgb)) {
+		return ERR_NULL_POINTER;
+	}
+
+	for (i = 0; i < pixel_count; i += FRAME_CODEC_CHROMA_GROUP) {
+		for (n = 0; (n < FRAME_CODEC_CHROMA_GROUP) && (i + n < pixel_count); n++) {
+			pixels[n] = &(rgb[(i + n) * 3]);
+		}
+		_decode_group(data, pixels, n);
+		data += FRAME_CODEC_GROUP_BYTES;
+	}
+
+	return NO_ERROR;
+}
+
+size_t frame_codec_frame_bound(size_t video_pixels, size_t depth_pixels) {
+	/* varints for the depth size and the kept count, then the runs.  A
+	 * pair of runs costs at most a byte per pixel it covers plus two, and
+	 * there are at most half as many pairs as pixels, plus one. */
+	return 15 + frame_codec_depth_bound(depth_pixels) + 
+		2 * video_pixels + 2 + frame_codec_video_size(video_pixels);
+}
+
+status_t frame_codec_encode_frame(
+	const unsigned char* rgb,
+	size_t video_pixels,
+	const unsigned short* depth,
+	size_t depth_pixels,
+	const unsigned char* mask,
+	unsigned char* data,
+	size_t* p_size)
+{
+	status_t status = NO_ERROR;
+	const unsigned char* pixels[FRAME_CODEC_CHROMA_GROUP];
+	unsigned char* depth_data = NULL;
+	size_t depth_size = 0;
+	size_t kept = 0;
+	size_t pos = 0;
+	size_t i = 0;
+	size_t n = 0;
+
+	if ((NULL == rgb) || (NULL == depth) || (NULL == data) || (NULL == p_size)) {
+		return ERR_NULL_POINTER;
+	}
+	if ((NULL != mask) && (video_pixels != depth_pixels)) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	/* the depth goes after its size, which is only known once coded */
+	depth_data = &(data[10]);
+	status = frame_codec_encode_depth(depth, depth_pixels, depth_data, &depth_size);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	pos = _put_varint(data, (unsigned long)depth_size);
+	memmove(&(data[pos]), depth_data, depth_size);
+	pos += depth_size;
+
+	kept = video_pixels;
+	if (NULL != mask) {
+		kept = 0;
+		for (i = 0; i < video_pixels; i++) {
+			kept += (0 != mask[i]);
+		}
+	}
+	pos += _put_varint(&(data[pos]), (unsigned long)kept);
+	pos += _put_runs(mask, video_pixels, &(data[pos]));
+
+	/* the kept pixels are grouped as if they were next to each other */
+	n = 0;
+	for (i = 0; i < video_pixels; i++) {
+		if ((NULL != mask) && (0 == mask[i])) {
+			continue;
+		}
+		pixels[n++] = &(rgb[i * 3]);
+		if (FRAME_CODEC_CHROMA_GROUP == n) {
+			_encode_group(pixels, n, &(data[pos]));
+			pos += FRAME_CODEC_GROUP_BYTES;
+			n = 0;
+		}
+	}
+	if (n > 0) {
+		_encode_group(pixels, n, &(data[pos]));
+		pos += FRAME_CODEC_GROUP_BYTES;
+	}
+
+	*p_size = pos;
+	return NO_ERROR;
+}
+
+status_t frame_codec_check_frame(
+	const unsigned char* data,
+	size_t size,
+	size_t video_pixels)
+{
+	frame_codec_layout_t layout;
+
+	if (NULL == data) {
+		return ERR_NULL_POINTER;
+	}
+	return _frame_layout(data, size, video_pixels, &layout);
+}
+
+status_t frame_codec_decode_frame(
+	const unsigned char* data,
+	size_t size,
+	unsigned char* rgb,
+	size_t video_pixels,
+	unsigned short* depth,
+	size_t depth_pixels)
+{
+	status_t status = NO_ERROR;
+	frame_codec_layout_t layout;
+	unsigned char* pixels[FRAME_CODEC_CHROMA_GROUP];
+	const unsigned char* groups = NULL;
+	unsigned long skip = 0;
+	unsigned long run = 0;
+	size_t pos = 0;
+	size_t i = 0;
+	size_t n = 0;
+
+	if ((NULL == data) || (NULL == rgb) || (NULL == depth)) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_layout(data, size, video_pixels, &layout);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	status = frame_codec_decode_depth(
+		&(data[layout.depth_pos]), 
+		layout.depth_size, 
+		depth, 
+		depth_pixels);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* the runs were checked, dropped pixels are black */
+	groups = &(data[layout.groups_pos]);
+	pos = layout.runs_pos;
+	i = 0;
+	n = 0;
+	while (i < video_pixels) {
+		_get_varint(data, size, &pos, &skip);
+		_get_varint(data, size, &pos, &run);
+		memset(&(rgb[i * 3]), 0, skip * 3);
+		i += skip;
+		for (; run > 0; run--) {
+			pixels[n++] = &(rgb[(i++) * 3]);
+			if (FRAME_CODEC_CHROMA_GROUP == n) {
+				_decode_group(groups, pixels, n);
+				groups += FRAME_CODEC_GROUP_BYTES;
+				n = 0;
+			}
+		}
+	}
+	if (n > 0) {
+		_decode_group(groups, pixels, n);
+	}
+
+	return NO_ERROR;
+}
+
+status_t _frame_layout(
+	const unsigned char* data,
+	size_t size,
+	size_t video_pixels,
+	frame_codec_layout_t* p_layout)
+{
+	status_t status = NO_ERROR;
+	unsigned long depth_size = 0;
+	unsigned long kept = 0;
+	unsigned long skip = 0;
+	unsigned long run = 0;
+	size_t covered = 0;
+	size_t runs_kept = 0;
+	size_t pos = 0;
+
+	status = _get_varint(data, size, &pos, &depth_size);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	if (depth_size > size - pos) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	p_layout->depth_pos = pos;
+	p_layout->depth_size = (size_t)depth_size;
+	pos += depth_size;
+
+	status = _get_varint(data, size, &pos, &kept);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_layout->runs_pos = pos;
+
+	while (covered < video_pixels) {
+		status = _get_varint(data, size, &pos, &skip);
+		if (NO_ERROR == status) {
+			status = _get_varint(data, size, &pos, &run);
+		}
+		if (NO_ERROR != status) {
+			return status;
+		}
+		if ((0 == skip + run) || (skip + run > video_pixels - covered)) {
+			return ERR_UNSUPPORTED_FORMAT;
+		}
+		covered += skip + run;
+		runs_kept += run;
+	}
+	if ((runs_kept != kept) || (frame_codec_video_size(kept) != size - pos)) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	p_layout->groups_pos = pos;
+	return NO_ERROR;
+}
+
+void _encode_group(
+	const unsigned char** pixels,
+	size_t n,
+	unsigned char* data)
+{
+	size_t j = 0;
+	int co = 0;
+	int cg = 0;
+	int t = 0;
+	int co_sum = 0;
+	int cg_sum = 0;
+
+	for (j = 0; j < FRAME_CODEC_CHROMA_GROUP; j++) {
+		if (j >= n) {
+			data[j] = 0;
+			continue;
+		}
+		co = (int)pixels[j][0] - (int)pixels[j][2];
+		t = (int)pixels[j][2] + (co >> 1);
+		cg = (int)pixels[j][1] - t;
+		data[j] = (unsigned char)(t + (cg >> 1));
+		co_sum += co;
+		cg_sum += cg;
+	}
+
+	/* the averages are within [-255, 255], stored at half precision */
+	data[FRAME_CODEC_CHROMA_GROUP] =
+		(unsigned char)(((co_sum / (int)n) >> 1) + 128);
+	data[FRAME_CODEC_CHROMA_GROUP + 1] =
+		(unsigned char)(((cg_sum / (int)n) >> 1) + 128);
+}
+
+void _decode_group(
+	const unsigned char* data,
+	unsigned char** pixels,
+	size_t n)
+{
+	size_t j = 0;
+	int co = ((int)data[FRAME_CODEC_CHROMA_GROUP] - 128) * 2;
+	int cg = ((int)data[FRAME_CODEC_CHROMA_GROUP + 1] - 128) * 2;
+	int t = 0;
+	int g = 0;
+	int b = 0;
+
+	for (j = 0; j < n; j++) {
+		t = (int)data[j] - (cg >> 1);
+		g = cg + t;
+		b = t - (co >> 1);
+		pixels[j][0] = _clamp(b + co);
+		pixels[j][1] = _clamp(g);
+		pixels[j][2] = _clamp(b);
+	}
+}
+
+size_t _put_runs(
+	const unsigned char* mask,
+	size_t pixel_count,
+	unsigned char* data)
+{
+	size_t pos = 0;
+	size_t i = 0;
+	size_t skip = 0;
+	size_t run = 0;
+
+	if (NULL == mask) {
+		pos += _put_varint(&(data[pos]), 0);
+		pos += _put_varint(&(data[pos]), (unsigned long)pixel_count);
+		return pos;
+	}
+
+	/* pairs of dropped and kept run lengths, the last kept run may be
+	 * empty */
+	while (i < pixel_count) {
+		for (skip = 0; (i < pixel_count) && (0 == mask[i]); i++) {
+			skip++;
+		}
+		for (run = 0; (i < pixel_count) && (0 != mask[i]); i++) {
+			run++;
+		}
+		pos += _put_varint(&(data[pos]), (unsigned long)skip);
+		pos += _put_varint(&(data[pos]), (unsigned long)run);
+	}
+	return pos;
+}
+
+size_t _put_varint(unsigned char* data, unsigned long value) {
+	size_t count = 0;
+
+	while (value >= 0x80) {
+		data[count++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	data[count++] = (unsigned char)value;
+	return count;
+}
+
+status_t _get_varint(
+	const unsigned char* data,
+	size_t size,
+	size_t* p_pos,
+	unsigned long* p_value)
+{
+	size_t pos = *p_pos;
+	unsigned long value = 0;
+	unsigned shift = 0;
+
+	do {
+		if ((pos >= size) || (shift > 28)) {
+			return ERR_UNSUPPORTED_FORMAT;
+		}
+		value |= (unsigned long)(data[pos] & 0x7f) << shift;
+		shift += 7;
+	} while (data[pos++] & 0x80);
+
+	*p_pos = pos;
+	*p_value = value;
+	return NO_ERROR;
+}
+
+unsigned char _clamp(int value) {
+	if (value < 0) {
+		return 0;
+	}
+	if (value > 255) {
+		return 255;
+	}
+	return (unsigned char)value;
+}
@@ -1,11 +1,18 @@
 #include "frame_store.h"
 #include "vector.h"
 #include "memory_pool.h"
+#include "rb_tree.h"
+#include "frame_codec.h"
 #include "log.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 
 #define FREEREC_DEFAULT_CLIP_CAPACITY (128)
 #define FREEREC_DEFAULT_FRAME_CAPACITY (128)
@@ -547,49 +554,300 @@ status_t _frame_store_clear_current_frame(frame_store_handle_t handle) {
 
 const frame_id_t invalid_frame_id = (frame_id_t)-1;
 
+/* Compressed data of frames packed by frame_store_pack_frames shares one
+ * allocation, freed with the last frame still in it.  Frames can go from
+ * any thread, so the count is only changed atomically. */
+typedef struct frame_extent_s {
+	volatile int frames;
+	/* the data follows */
+} frame_extent_t;
+
+/* Every stored frame starts with a header holding its reference count.  The
+ * store owns one reference from the moment the frame is captured until it is
+ * removed, and frame_store_acquire_frame adds one for each user, so a frame
+ * that is removed while it is still being displayed stays valid until the
+ * last user releases it.  The count is only changed atomically, which lets
+ * frames be released from any thread without the store's lock. */
+typedef struct frame_s {
+	volatile int refcount;
+	/* the compressed data is not the store's, see
+	 * frame_store_restore_frame */
+	bool_t borrowed;
+	/* the video and depth planes, inside this chunk when interleaved or in
+	 * the plane pools when planar */
+	unsigned char* video;
+	unsigned char* depth;
+	/* FRAME_STORE_COMPRESSED only: the coded video followed by the coded
+	 * depth, once the frame has been compressed */
+	unsigned char* compressed;
+	size_t compressed_size;
+	/* where the compressed data lives once packed, NULL while it is an
+	 * allocation of its own */
+	frame_extent_t* extent;
+	/* frame_store_enable_previews only, NULL if the preview pool was
+	 * empty when the frame was captured */
+	unsigned char* preview;
+} frame_t;
+
+/* keeps the frame data aligned the way the memory pool aligns chunks */
+#define FRAME_STORE_HEADER_BYTES (48)
+
+/* Compressed frames only keep their small frame chunk, so a compressed
+ * store has room for this many times the frames its planes can hold. */
+#define FRAME_STORE_MAX_RATIO (8)
+
+/* The spill file is split into segments.  Frames are appended to the
+ * current segment and a segment is only reused once every frame in it has
+ * been removed, which old loops being removed first makes the usual case. */
+#define FRAME_STORE_SPILL_SEGMENT (16 * 1024 * 1024)
+
+/* Capture can avoid copying altogether.  frame_store_video_target and
+ * frame_store_depth_target tell the device where to write its next frame:
+ * the oldest frame being assembled that is still missing that plane,
+ * otherwise a spare frame claimed ahead of time.  When captured data already sits at
+ * that address nothing is copied; data landing in the spare with a new
+ * timestamp simply swaps the spare in as the frame being assembled.  Data
+ * from anywhere else is copied as before. */
+#define FRAME_STORE_VIDEO_PLANE (1u)
+#define FRAME_STORE_DEPTH_PLANE (2u)
+#define FRAME_STORE_META_PLANE (4u)
+
+/* Frames are kept in a slot map.  A frame id carries the slot index in its
+ * low half and the slot's generation in its high half.  Removing a frame
+ * frees its slot for the next capture and bumps the generation, so ids of
+ * removed frames are rejected instead of finding whatever frame reuses the
+ * slot, and the slot array only grows with the number of live frames. */
+#define FRAME_STORE_INDEX_BITS (sizeof(frame_id_t) * 4)
+#define FRAME_STORE_INDEX_MASK \
+	((((frame_id_t)1) << FRAME_STORE_INDEX_BITS) - 1)
+/* end of the free slot list, never a valid index */
+#define FRAME_STORE_NO_SLOT FRAME_STORE_INDEX_MASK
+
+typedef struct frame_slot_s {
+	/* NULL while the slot is free */
+	unsigned char* frame;
+	frame_id_t generation;
+	/* next free slot while this one is free */
+	frame_id_t next_free;
+	/* the frame's entry in time_index */
+	rb_tree_node_handle_t time_node;
+} frame_slot_t;
+
+/* Video and depth come from separate streams, so planes of one frame can
+ * arrive interleaved with planes of the next.  Frames are assembled in a
+ * small table keyed by timestamp, a plane going to the pending frame
+ * nearest it within the capture tolerance since each stream has its own
+ * timestamps.  Streams deliver in order, so a frame older than one just
+ * completed is dropped, as is the entry started first when a new
+ * timestamp finds the table full. */
+#define FRAME_STORE_ASSEMBLY_SLOTS (4)
+
+typedef struct frame_assembly_s {
+	bool_t pending;
+	/* kept by a free entry once its frame is dropped, a device may still
+	 * be writing one of its planes */
+	unsigned char* frame;
+	/* planes captured so far */
+	unsigned int planes;
+	timestamp_t timestamp;
+	/* the order entries were started in */
+	size_t sequence;
+} frame_assembly_t;
+
 typedef struct frame_store_s {
 	size_t video_bytes;
 	size_t depth_bytes;
 	size_t meta_bytes;
+	/* frame_slot_t for every live frame and every free slot */
 	vector_handle_t frames;
+	frame_id_t free_slot;
+	/* live frames keyed by the timestamp in their chunk, the frame id is
+	 * the node's data */
+	rb_tree_handle_t time_index;
 	size_t video_offset;
 	size_t depth_offset;
 	size_t meta_offset;
 	size_t timestamp_offset;
-	unsigned char* current_frame;
+	frame_assembly_t assembly[FRAME_STORE_ASSEMBLY_SLOTS];
+	size_t assembly_sequence;
+	/* see frame_store_set_capture_tolerance */
+	timestamp_t capture_tolerance;
+	/* the planes that make a frame complete */
+	unsigned int frame_planes;
+	frame_store_capture_stats_t capture_stats;
+	/* claimed ahead so a device can write the next frame in place */
+	unsigned char* spare_frame;
 	size_t frame_size;
-	size_t current_frame_stored_size;
 	size_t frame_count;
 	memory_pool_handle_t memory_pool;
+	/* FRAME_STORE_PLANAR only, indexed by the frame's own chunk */
+	memory_pool_handle_t video_pool;
+	memory_pool_handle_t depth_pool;
+	/* frames the budget holds with their planes */
+	size_t raw_frames;
+	/* frame_store_enable_previews only.  A preview chunk holds the depth
+	 * of every level followed by the video of every level. */
+	memory_pool_handle_t preview_pool;
+	size_t preview_width[FRAME_STORE_PREVIEW_LEVELS];
+	size_t preview_height[FRAME_STORE_PREVIEW_LEVELS];
+	size_t preview_video_offset[FRAME_STORE_PREVIEW_LEVELS];
+	size_t preview_depth_offset[FRAME_STORE_PREVIEW_LEVELS];
+	unsigned int flags;
+	/* FRAME_STORE_COMPRESSED only */
+	size_t compressed_budget;
+	size_t page_bytes;
+	unsigned char* codec_buffer;
+	/* frame_store_enable_foreground only, the masked depth and a mask
+	 * twice the pixel count for dilating it */
+	size_t foreground_width;
+	size_t foreground_height;
+	size_t foreground_margin;
+	unsigned short* foreground_depth;
+	unsigned char* foreground_mask;
+	frame_store_compression_stats_t compression_stats;
+	/* frame_store_enable_spill only */
+	int spill_fd;
+	unsigned char* spill_base;
+	size_t spill_bytes;
+	size_t spill_segment_bytes;
+	size_t spill_segment_count;
+	/* bytes of live frames in each segment */
+	size_t* spill_live;
+	/* the segment being appended to and where the next frame goes */
+	size_t spill_segment;
+	size_t spill_end;
+	frame_store_pressure_cb_t pressure_callback;
+	void* pressure_user_data;
 } frame_store_t;
 
 static status_t _frame_store_capture_data(
 	frame_store_handle_t handle,
-	size_t frame_data_offset,
+	unsigned int plane,
 	size_t data_size,
 	void* data,
 	timestamp_t timestamp,
 	frame_id_t* p_frame_id);
 
+static status_t _frame_store_target(
+	frame_store_handle_t handle,
+	unsigned int plane,
+	void** p_data);
 
-static status_t _frame_store_new_frame(frame_store_handle_t handle);
-static status_t _frame_store_clear_current_frame(frame_store_handle_t handle);
+static void _frame_store_pressure(
+	memory_pool_handle_t pool, 
+	size_t shortfall_chunks, 
+	void* data);
+
+
+/* frames returned to the memory pool per unclaim batch */
+#define FRAME_STORE_REMOVE_BATCH (64)
+
+static status_t _frame_store_claim_spare(frame_store_handle_t handle);
+static status_t _frame_store_start_frame(
+	frame_store_handle_t handle,
+	unsigned int plane,
+	void* data,
+	timestamp_t timestamp,
+	frame_assembly_t** p_entry);
+static void _frame_store_drop_frames(
+	frame_store_handle_t handle,
+	timestamp_t timestamp);
+static void _frame_store_reset_frame(
+	frame_store_handle_t handle, 
+	unsigned char* frame);
+static bool_t _frame_store_unref(frame_t* p_frame);
+static status_t _frame_store_slot(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	frame_slot_t** p_slot);
+static status_t _frame_store_add_slot(
+	frame_store_handle_t handle,
+	unsigned char* frame,
+	frame_id_t* p_frame_id);
+static void _frame_store_free_slot(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	frame_slot_t* p_slot);
 static status_t _frame_store_sub_frame(
 	frame_store_handle_t handle,
 	frame_id_t frame_id,
-	size_t data_offset,
+	unsigned int plane,
 	void** p_data,
 	timestamp_t* p_timestamp);
+static unsigned char* _frame_store_plane(
+	frame_store_handle_t handle,
+	unsigned char* frame,
+	unsigned int plane);
+static status_t _frame_store_claim_frame(
+	frame_store_handle_t handle,
+	unsigned char** p_frame);
+static status_t _frame_store_claim_planes(
+	frame_store_handle_t handle,
+	void** p_video,
+	void** p_depth);
+static bool_t _frame_store_shrink(frame_store_handle_t handle, frame_t* p_frame);
+static status_t _frame_store_compress(
+	frame_store_handle_t handle,
+	frame_t* p_frame,
+	const unsigned short* depth,
+	const unsigned char* mask);
+static void _frame_store_foreground(
+	frame_store_handle_t handle,
+	const unsigned short* depth,
+	unsigned short max_depth);
+static void _frame_store_dilate(
+	const unsigned char* mask,
+	size_t step,
+	size_t length,
+	size_t lines,
+	size_t line_step,
+	size_t radius,
+	unsigned char* dilated);
+static void _frame_store_make_previews(
+	frame_store_handle_t handle, 
+	frame_t* p_frame);
+static void _frame_store_pool_depth(
+	const unsigned short* depth,
+	size_t width,
+	size_t height,
+	unsigned short* preview);
+static void _frame_store_pool_video(
+	const unsigned char* video,
+	size_t width,
+	size_t height,
+	unsigned char* preview);
+static void _frame_store_forget(frame_store_handle_t handle, frame_t* p_frame);
+static void _frame_store_free_compressed(frame_t* p_frame);
+static bool_t _frame_store_spilled(
+	frame_store_handle_t handle, 
+	const unsigned char* data);
+static bool_t _frame_store_on_disk(frame_store_handle_t handle, frame_t* p_frame);
+static status_t _frame_store_spill_space(
+	frame_store_handle_t handle,
+	size_t size,
+	size_t* p_offset);
+static double _frame_store_seconds(void);
+static int _frame_store_compare_time(const void* a, const void* b);
+static status_t _frame_store_share(void* in, void** copy);
+static status_t _frame_store_unshare(void* data);
+static status_t _frame_store_unclaim_frames(
+	frame_store_handle_t handle,
+	size_t count,
+	void** frames);
 
 status_t frame_store_create(
 	size_t video_bytes,
 	size_t depth_bytes,
 	size_t meta_bytes,
 	size_t max_bytes,
+	unsigned int flags,
 	frame_store_handle_t* p_handle)
 {
 	status_t err = NO_ERROR;
 	frame_store_t* p_frame_store = NULL;
+	size_t chunk_size = 0;
+	size_t max_frames = 0;
+	size_t raw_bytes = 0;
 
 	if (NULL == p_handle) {
 		return ERR_NULL_POINTER;
@@ -603,36 +861,126 @@ status_t frame_store_create(
 
 	/* hopefuly you can just copy these over without some sort of copy
 	 * function to get dynamically allocated data */
+	if (FRAME_STORE_COMPRESSED & flags) {
+		/* the codec works on RGB video and 16 bit depth planes */
+		if ((0 != (video_bytes % 3)) || (0 != (depth_bytes % 2))) {
+			free(p_frame_store);
+			return ERR_INVALID_ARGUMENT;
+		}
+		flags |= FRAME_STORE_PLANAR;
+	}
+
 	p_frame_store->frame_count = 0;
+	p_frame_store->flags = flags;
 	p_frame_store->video_bytes = video_bytes;
 	p_frame_store->depth_bytes = depth_bytes;
-	p_frame_store->depth_offset = video_bytes;
 	p_frame_store->meta_bytes = meta_bytes;
-	p_frame_store->meta_offset = video_bytes + depth_bytes;
-	p_frame_store->timestamp_offset = video_bytes + depth_bytes + meta_bytes;
+	if (FRAME_STORE_PLANAR & flags) {
+		/* frame chunks only hold meta and timestamp */
+		p_frame_store->video_offset = 0;
+		p_frame_store->depth_offset = 0;
+		p_frame_store->meta_offset = FRAME_STORE_HEADER_BYTES;
+	}
+	else {
+		p_frame_store->video_offset = FRAME_STORE_HEADER_BYTES;
+		p_frame_store->depth_offset = p_frame_store->video_offset + video_bytes;
+		p_frame_store->meta_offset = p_frame_store->depth_offset + depth_bytes;
+	}
+	p_frame_store->timestamp_offset = p_frame_store->meta_offset + meta_bytes;
 	p_frame_store->frame_size = 
 		video_bytes + depth_bytes + meta_bytes + sizeof(timestamp_t);
+	chunk_size = p_frame_store->timestamp_offset + sizeof(timestamp_t);
+	p_frame_store->frame_planes = 
+		FRAME_STORE_VIDEO_PLANE | FRAME_STORE_DEPTH_PLANE;
+	if (meta_bytes > 0) {
+		p_frame_store->frame_planes |= FRAME_STORE_META_PLANE;
+	}
+
+	if (FRAME_STORE_PLANAR & flags) {
+		raw_bytes = max_bytes;
+		if (FRAME_STORE_COMPRESSED & flags) {
+			/* half the budget holds compressed frames */
+			raw_bytes = max_bytes / 2;
+			p_frame_store->compressed_budget = max_bytes - raw_bytes;
+			p_frame_store->page_bytes = (size_t)sysconf(_SC_PAGESIZE);
+			p_frame_store->codec_buffer = (unsigned char*)malloc(
+				frame_codec_frame_bound(video_bytes / 3, depth_bytes / 2));
+			if (NULL == p_frame_store->codec_buffer) {
+				frame_store_release(p_frame_store);
+				return ERR_FAILED_ALLOC;
+			}
+		}
+
+		/* split the rest so every pool runs out at the same frame count */
+		max_frames = raw_bytes / (chunk_size + video_bytes + depth_bytes);
+
+		err = memory_pool_create(
+			video_bytes,
+			64,
+			128,
+			max_frames * video_bytes,
+			100000,
+			MEMORY_POOL_ARENA | MEMORY_POOL_HUGE_PAGES,
+			&(p_frame_store->video_pool));
+		if (NO_ERROR != err) {
+			frame_store_release(p_frame_store);
+			return err;
+		}
+		err = memory_pool_create(
+			depth_bytes,
+			64,
+			128,
+			max_frames * depth_bytes,
+			100000,
+			MEMORY_POOL_ARENA | MEMORY_POOL_HUGE_PAGES,
+			&(p_frame_store->depth_pool));
+		if (NO_ERROR != err) {
+			frame_store_release(p_frame_store);
+			return err;
+		}
+		max_bytes = max_frames * chunk_size;
+		p_frame_store->raw_frames = max_frames;
+		if (FRAME_STORE_COMPRESSED & flags) {
+			max_bytes *= FRAME_STORE_MAX_RATIO;
+		}
+	}
+	else {
+		p_frame_store->raw_frames = max_bytes / chunk_size;
+	}
 
 	err = memory_pool_create(
-		p_frame_store->frame_size,
+		chunk_size,
 		64,
 		128,
 		max_bytes,
 		100000,
+		MEMORY_POOL_ARENA | MEMORY_POOL_HUGE_PAGES,
 		&(p_frame_store->memory_pool));
 	if (NO_ERROR != err) {
 		frame_store_release(p_frame_store);
 		return err;
 	}
 
-	err = vector_create(32, sizeof(unsigned char*), &p_frame_store->frames);
+	p_frame_store->free_slot = FRAME_STORE_NO_SLOT;
+	err = vector_create(32, sizeof(frame_slot_t), &p_frame_store->frames);
+	if (NO_ERROR != err) {
+		frame_store_release(p_frame_store);
+		return err;
+	}
+	err = rb_tree_create(
+		&_frame_store_compare_time,
+		&_frame_store_share,
+		&_frame_store_unshare,
+		&_frame_store_share,
+		&_frame_store_unshare,
+		&p_frame_store->time_index);
 	if (NO_ERROR != err) {
 		frame_store_release(p_frame_store);
 		return err;
 	}
 
-	/* create current frame holder */
-	err = _frame_store_new_frame(p_frame_store);
+	/* the first frame starts in the spare */
+	err = _frame_store_claim_spare(p_frame_store);
 	if (NO_ERROR != err) {
 		frame_store_release(p_frame_store);
 		return err;
@@ -643,6 +991,9 @@ status_t frame_store_create(
 }
 
 void frame_store_release(frame_store_handle_t handle) {
+	frame_slot_t* slots = NULL;
+	size_t count = 0;
+	size_t index = 0;
 
 	if (NULL == handle) {
 		return; 
@@ -661,8 +1012,44 @@ void frame_store_release(frame_store_handle_t handle) {
 	}
 	*/
 
+	/* make sure the pressure callback is not running during release */
+	if (NULL != handle->memory_pool) {
+		memory_pool_set_pressure_callback(handle->memory_pool, 0, NULL, NULL);
+	}
+	if (NULL != handle->video_pool) {
+		memory_pool_set_pressure_callback(handle->video_pool, 0, NULL, NULL);
+	}
+
+	/* the pools take the frames with them, but not their compressed data */
+	if ((NULL != handle->frames) && 
+		(NO_ERROR == vector_count(handle->frames, &count)) &&
+		(NO_ERROR == vector_array(handle->frames, (void**)&slots)))
+	{
+		for (index = 0; index < count; index++) {
+			if ((NULL != slots[index].frame) && 
+				(FALSE == _frame_store_on_disk(
+					handle, 
+					(frame_t*)slots[index].frame)))
+			{
+				_frame_store_free_compressed((frame_t*)slots[index].frame);
+			}
+		}
+	}
+
 	vector_release(handle->frames);
+	rb_tree_release(handle->time_index);
 	memory_pool_release(handle->memory_pool);
+	memory_pool_release(handle->video_pool);
+	memory_pool_release(handle->depth_pool);
+	memory_pool_release(handle->preview_pool);
+	free(handle->codec_buffer);
+	free(handle->foreground_depth);
+	free(handle->foreground_mask);
+	if (NULL != handle->spill_base) {
+		munmap(handle->spill_base, handle->spill_bytes);
+		close(handle->spill_fd);
+	}
+	free(handle->spill_live);
 	free(handle);
 }
 
@@ -680,25 +1067,29 @@ status_t frame_store_frame_count(frame_store_handle_t handle, size_t* p_count) {
 status_t _frame_store_sub_frame(
 	frame_store_handle_t handle,
 	frame_id_t frame_id,
-	size_t data_offset,
+	unsigned int plane,
 	void** p_data,
 	timestamp_t* p_timestamp)
 {
 	status_t err = NO_ERROR;
-	unsigned char** p_frame_data = NULL;
+	frame_slot_t* p_slot = NULL;
 	unsigned char* frame_data = NULL;
 
 	if ((NULL == handle) || (NULL == p_data) || (NULL == p_timestamp)) {
 		return ERR_NULL_POINTER;
 	}
 
-	err = vector_element_address(handle->frames, frame_id, (void**)&p_frame_data);
+	err = _frame_store_slot(handle, frame_id, &p_slot);
 	if (NO_ERROR != err) {
 		return err;
 	}
-	frame_data = *p_frame_data;
+	frame_data = p_slot->frame;
 
-	*p_data = (void*)&(frame_data[data_offset]);
+	*p_data = (void*)_frame_store_plane(handle, frame_data, plane);
+	if (NULL == *p_data) {
+		/* compressed, see frame_store_expand_frame */
+		return ERR_EMPTY;
+	}
 	*p_timestamp = *((timestamp_t*)&(frame_data[handle->timestamp_offset]));
 
 	return NO_ERROR;
@@ -716,7 +1107,7 @@ status_t frame_store_video_frame(
 	return _frame_store_sub_frame(
 		handle, 
 		frame_id, 
-		handle->video_offset, 
+		FRAME_STORE_VIDEO_PLANE, 
 		p_data, 
 		p_timestamp);
 }
@@ -733,7 +1124,7 @@ status_t frame_store_depth_frame(
 	return _frame_store_sub_frame(
 		handle, 
 		frame_id, 
-		handle->depth_offset, 
+		FRAME_STORE_DEPTH_PLANE, 
 		p_data, 
 		p_timestamp);
 }
@@ -750,7 +1141,7 @@ status_t frame_store_meta_frame(
 	return _frame_store_sub_frame(
 		handle, 
 		frame_id, 
-		handle->meta_offset, 
+		FRAME_STORE_META_PLANE, 
 		p_data, 
 		p_timestamp);
 }
@@ -767,7 +1158,7 @@ status_t frame_store_capture_video(
 	}
 	status = _frame_store_capture_data(
 		handle, 
-		handle->video_offset, 
+		FRAME_STORE_VIDEO_PLANE,
 		handle->video_bytes,
 		data, 
 		timestamp,
@@ -792,7 +1183,7 @@ status_t frame_store_capture_depth(
 	}
 	status = _frame_store_capture_data(
 		handle, 
-		handle->depth_offset, 
+		FRAME_STORE_DEPTH_PLANE,
 		handle->depth_bytes,
 		data, 
 		timestamp,
@@ -817,7 +1208,7 @@ status_t frame_store_capture_meta(
 	}
 	status = _frame_store_capture_data(
 		handle, 
-		handle->meta_offset, 
+		FRAME_STORE_META_PLANE,
 		handle->meta_bytes,
 		data, 
 		timestamp,
@@ -834,120 +1225,1842 @@ status_t frame_store_remove_frame(
 	frame_id_t frame_id)
 {
 	status_t       status  = NO_ERROR;
-	void**         p_frame = NULL;
+	frame_slot_t*  p_slot  = NULL;
+	unsigned char* frame   = NULL;
 
 	if (NULL == handle) {
 		return ERR_NULL_POINTER;
 	}
 
-	status = vector_element_address(handle->frames, frame_id, (void**)&p_frame);
+	/* fails for ids that were already removed */
+	status = _frame_store_slot(handle, frame_id, &p_slot);
 	if (NO_ERROR != status) {
 		return status;
 	}
+	frame = p_slot->frame;
+	_frame_store_free_slot(handle, frame_id, p_slot);
+	_frame_store_forget(handle, (frame_t*)frame);
 	handle->frame_count--;
 
-	status = memory_pool_unclaim(handle->memory_pool, (void*)*p_frame);
+	/* drop the store's reference, the frame lives on while it is acquired */
+	if (TRUE == _frame_store_unref((frame_t*)frame)) {
+		status = _frame_store_unclaim_frames(handle, 1, (void**)&frame);
+	}
+	return status;
+}
+
+status_t frame_store_remove_frames(
+	frame_store_handle_t handle,
+	size_t count,
+	const frame_id_t* frame_ids)
+{
+	status_t status = NO_ERROR;
+	status_t result = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	void*    frames[FRAME_STORE_REMOVE_BATCH];
+	size_t   frame_count = 0;
+	size_t   i = 0;
+
+	if ((NULL == handle) || (NULL == frame_ids)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* hand frames back to the pool a batch at a time rather than one
+	 * unclaim per frame */
+	for (i = 0; i < count; i++) {
+		status = _frame_store_slot(handle, frame_ids[i], &p_slot);
+		if (NO_ERROR != status) {
+			result = status;
+			continue;
+		}
+		_frame_store_forget(handle, (frame_t*)p_slot->frame);
+		if (TRUE == _frame_store_unref((frame_t*)p_slot->frame)) {
+			frames[frame_count++] = p_slot->frame;
+		}
+		_frame_store_free_slot(handle, frame_ids[i], p_slot);
+		handle->frame_count--;
+
+		if (FRAME_STORE_REMOVE_BATCH == frame_count) {
+			status = _frame_store_unclaim_frames(
+				handle, 
+				frame_count, 
+				frames);
+			if (NO_ERROR != status) {
+				result = status;
+			}
+			frame_count = 0;
+		}
+	}
+
+	if (frame_count > 0) {
+		status = _frame_store_unclaim_frames(
+			handle, 
+			frame_count, 
+			frames);
+		if (NO_ERROR != status) {
+			result = status;
+		}
+	}
+
+	return result;
+}
+
+status_t frame_store_find_by_time(
+	frame_store_handle_t handle,
+	timestamp_t timestamp,
+	frame_id_t* p_frame_id)
+{
+	status_t status = NO_ERROR;
+	rb_tree_node_handle_t node = NULL;
+	void* data = NULL;
+
+	if ((NULL == handle) || (NULL == p_frame_id)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* the first node of an enumeration is the newest within range */
+	status = rb_tree_enumerate(
+		handle->time_index, 
+		NULL, 
+		(void*)&timestamp, 
+		NULL, 
+		&node);
 	if (NO_ERROR != status) {
 		return status;
 	}
-	*p_frame = NULL;
-	/* TODO: double check, used to release this here, but now that we're using 
-	 * frame_ids, removing an element would screw up the ID space.
-		vector_remove((*p_clip)->frames, frame_index);
-	*/
+	if (NULL == node) {
+		return ERR_EMPTY;
+	}
+	rb_tree_node_data(node, &data);
+	*p_frame_id = (frame_id_t)data;
 	return NO_ERROR;
 }
 
-status_t _frame_store_capture_data(
+status_t frame_store_enumerate_by_time(
 	frame_store_handle_t handle,
-	size_t frame_data_offset,
-	size_t data_size,
-	void* data,
-	timestamp_t timestamp,
+	timestamp_t low,
+	timestamp_t high,
+	void** p_cursor,
 	frame_id_t* p_frame_id)
 {
-	timestamp_t current_timestamp = 0;
-	status_t    err               = NO_ERROR;
+	status_t status = NO_ERROR;
+	rb_tree_node_handle_t node = NULL;
+	void* data = NULL;
 
-	if ((NULL == handle) || (NULL == data) || (NULL == p_frame_id)) {
+	if ((NULL == handle) || (NULL == p_cursor) || (NULL == p_frame_id)) {
 		return ERR_NULL_POINTER;
 	}
 
-	*p_frame_id = invalid_frame_id;
-	current_timestamp = 
-		*((timestamp_t*)&(handle->current_frame[handle->timestamp_offset]));
-	//if (timestamp > current_timestamp) {
-    if (timestamp != current_timestamp) {
-		/* copy data and wait for other half */
-		memcpy(
-			&(handle->current_frame[handle->timestamp_offset]),
-			&timestamp,
-			sizeof(timestamp_t));
-		memcpy(
-			&(handle->current_frame[frame_data_offset]),
-			data,
-			data_size);
-		handle->current_frame_stored_size = data_size + sizeof(timestamp_t);
+	status = rb_tree_enumerate(
+		handle->time_index,
+		(void*)&low,
+		(void*)&high,
+		(rb_tree_node_handle_t)*p_cursor,
+		&node);
+	if (NO_ERROR != status) {
+		return status;
 	}
-	else if (timestamp == current_timestamp) {
-		/* copy data and store */
-		memcpy(
-			&(handle->current_frame[frame_data_offset]),
-			data,
-			data_size);
-		handle->current_frame_stored_size += data_size;
-
-		if (handle->current_frame_stored_size == handle->frame_size) {
-			/* we've collected all the necessary data, so time to
-			 * store the frame */
-            err = vector_count(handle->frames, p_frame_id);
-			if (NO_ERROR != err) {
-				return err;
-			}
-			err = vector_append(
-				handle->frames, 
-				(void*)&(handle->current_frame));
-			if (NO_ERROR != err) {
-				return err;
-			}
-			handle->frame_count++;
-			err = _frame_store_new_frame(handle);
-			if (NO_ERROR != err) {
-				return err;
-			}
-			memcpy(
-				&(handle->current_frame[handle->timestamp_offset]),
-				&timestamp,
-				sizeof(timestamp_t));
-		}
+	*p_cursor = (void*)node;
+	if (NULL != node) {
+		rb_tree_node_data(node, &data);
+		*p_frame_id = (frame_id_t)data;
 	}
-    /*
-	else {
-		memset(handle->current_frame, 0, handle->frame_size);
-		return ERR_INVALID_TIMESTAMP;
+	return NO_ERROR;
+}
+
+status_t frame_store_acquire_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	frame_handle_t* p_frame)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+
+	if ((NULL == handle) || (NULL == p_frame)) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
 	}
-    */
+
+	/* the store's own reference keeps the count above zero here */
+	__sync_fetch_and_add(&(((frame_t*)p_slot->frame)->refcount), 1);
+	*p_frame = (frame_t*)p_slot->frame;
+
 	return NO_ERROR;
 }
 
-status_t _frame_store_new_frame(frame_store_handle_t handle) {
-	status_t err = NO_ERROR;
-	err = memory_pool_claim(
-		handle->memory_pool, 
-		(void**)&(handle->current_frame));
-	if (NO_ERROR != err) {
-		return err;
+status_t frame_store_release_frame(
+	frame_store_handle_t handle,
+	frame_handle_t frame)
+{
+	if ((NULL == handle) || (NULL == frame)) {
+		return ERR_NULL_POINTER;
 	}
-	return _frame_store_clear_current_frame(handle);
+
+	if (TRUE == _frame_store_unref(frame)) {
+		return _frame_store_unclaim_frames(handle, 1, (void**)&frame);
+	}
+
+	return NO_ERROR;
 }
 
-status_t _frame_store_clear_current_frame(frame_store_handle_t handle) {
-	memset(handle->current_frame, 0, handle->frame_size);
-	/* set timestamp to negative value to make sure it doesn't get confused
-	 * with a timestamp of zero */
-	timestamp_t* p_timestamp = 
-		((timestamp_t*)&(handle->current_frame[handle->timestamp_offset]));
-	*p_timestamp = (timestamp_t)-1;
+status_t frame_store_retain_frame(
+	frame_store_handle_t handle,
+	frame_handle_t frame)
+{
+	if ((NULL == handle) || (NULL == frame)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* the caller's reference keeps the count above zero here */
+	__sync_fetch_and_add(&(frame->refcount), 1);
+	return NO_ERROR;
+}
+
+status_t frame_store_frame_data(
+	frame_store_handle_t handle,
+	frame_handle_t frame,
+	void** p_video,
+	void** p_depth,
+	void** p_meta,
+	timestamp_t* p_timestamp)
+{
+	unsigned char* frame_data = (unsigned char*)frame;
+
+	if ((NULL == handle) || (NULL == frame)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* any output may be skipped with NULL */
+	if (NULL != p_video) {
+		*p_video = (void*)frame->video;
+	}
+	if (NULL != p_depth) {
+		*p_depth = (void*)frame->depth;
+	}
+	if (NULL != p_meta) {
+		*p_meta = (void*)&(frame_data[handle->meta_offset]);
+	}
+	if (NULL != p_timestamp) {
+		*p_timestamp = *((timestamp_t*)&(frame_data[handle->timestamp_offset]));
+	}
+
+	return NO_ERROR;
+}
+
+status_t frame_store_video_target(
+	frame_store_handle_t handle,
+	void** p_data)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	return _frame_store_target(
+		handle, 
+		FRAME_STORE_VIDEO_PLANE, 
+		p_data);
+}
+
+status_t frame_store_depth_target(
+	frame_store_handle_t handle,
+	void** p_data)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	return _frame_store_target(
+		handle, 
+		FRAME_STORE_DEPTH_PLANE, 
+		p_data);
+}
+
+status_t frame_store_compress_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (0 == (FRAME_STORE_COMPRESSED & handle->flags)) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if (NULL != p_frame->compressed) {
+		return NO_ERROR;
+	}
+	return _frame_store_compress(handle, p_frame, (const unsigned short*)p_frame->depth, NULL);
+}
+
+status_t frame_store_enable_foreground(
+	frame_store_handle_t handle,
+	size_t width,
+	size_t height,
+	size_t margin)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (0 == (FRAME_STORE_COMPRESSED & handle->flags)) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	/* the mask made from depth has to fit the video */
+	if ((width * height * 3 != handle->video_bytes) || 
+		(width * height * 2 != handle->depth_bytes) ||
+		(NULL != handle->foreground_mask))
+	{
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	handle->foreground_depth = (unsigned short*)malloc(handle->depth_bytes);
+	handle->foreground_mask = (unsigned char*)malloc(2 * width * height);
+	if ((NULL == handle->foreground_depth) || (NULL == handle->foreground_mask)) {
+		free(handle->foreground_depth);
+		free(handle->foreground_mask);
+		handle->foreground_depth = NULL;
+		handle->foreground_mask = NULL;
+		return ERR_FAILED_ALLOC;
+	}
+	handle->foreground_width = width;
+	handle->foreground_height = height;
+	handle->foreground_margin = margin;
 	return NO_ERROR;
 }
 
+status_t frame_store_compress_foreground(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	unsigned short max_depth)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (NULL == handle->foreground_mask) {
+		return ERR_EMPTY;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if (NULL != p_frame->compressed) {
+		return NO_ERROR;
+	}
+
+	_frame_store_foreground(handle, (const unsigned short*)p_frame->depth, max_depth);
+	return _frame_store_compress(
+		handle, 
+		p_frame, 
+		handle->foreground_depth, 
+		handle->foreground_mask);
+}
+
+status_t frame_store_expand_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+	void* video = NULL;
+	void* depth = NULL;
+	double start = 0.0;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if (NULL != p_frame->video) {
+		/* never compressed or already expanded */
+		return NO_ERROR;
+	}
+
+	status = _frame_store_claim_planes(handle, &video, &depth);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	start = _frame_store_seconds();
+	status = frame_codec_decode_frame(
+		p_frame->compressed, 
+		p_frame->compressed_size,
+		(unsigned char*)video,
+		handle->video_bytes / 3, 
+		(unsigned short*)depth,
+		handle->depth_bytes / 2);
+	if (NO_ERROR != status) {
+		memory_pool_unclaim(handle->video_pool, video);
+		memory_pool_unclaim(handle->depth_pool, depth);
+		return status;
+	}
+	p_frame->video = (unsigned char*)video;
+	p_frame->depth = (unsigned char*)depth;
+
+	handle->compression_stats.decoded_frames++;
+	handle->compression_stats.decode_seconds += _frame_store_seconds() - start;
+	return NO_ERROR;
+}
+
+status_t frame_store_shrink_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	bool_t* p_shrunk)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	bool_t shrunk = FALSE;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	shrunk = _frame_store_shrink(handle, (frame_t*)p_slot->frame);
+	if (NULL != p_shrunk) {
+		*p_shrunk = shrunk;
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_compression_stats(
+	frame_store_handle_t handle,
+	frame_store_compression_stats_t* p_stats)
+{
+	if ((NULL == handle) || (NULL == p_stats)) {
+		return ERR_NULL_POINTER;
+	}
+	*p_stats = handle->compression_stats;
+	return NO_ERROR;
+}
+
+status_t frame_store_capture_stats(
+	frame_store_handle_t handle,
+	frame_store_capture_stats_t* p_stats)
+{
+	size_t i = 0;
+
+	if ((NULL == handle) || (NULL == p_stats)) {
+		return ERR_NULL_POINTER;
+	}
+	*p_stats = handle->capture_stats;
+	p_stats->pending_frames = 0;
+	for (i = 0; i < FRAME_STORE_ASSEMBLY_SLOTS; i++) {
+		if (handle->assembly[i].pending) {
+			p_stats->pending_frames++;
+		}
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_set_capture_tolerance(
+	frame_store_handle_t handle,
+	timestamp_t tolerance)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (tolerance < 0) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	handle->capture_tolerance = tolerance;
+	return NO_ERROR;
+}
+
+status_t frame_store_enable_spill(
+	frame_store_handle_t handle,
+	const char* path,
+	size_t max_bytes)
+{
+	size_t segment_bytes = 0;
+	size_t segment_count = 0;
+	size_t page_bytes = 0;
+	size_t* live = NULL;
+	void* base = MAP_FAILED;
+	int fd = -1;
+
+	if ((NULL == handle) || (NULL == path)) {
+		return ERR_NULL_POINTER;
+	}
+	if (0 == (FRAME_STORE_COMPRESSED & handle->flags)) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	if (NULL != handle->spill_base) {
+		return ERR_INVALID_ARGUMENT;
+	}
+	page_bytes = handle->page_bytes;
+
+	/* a segment has to hold at least the largest compressed frame */
+	segment_bytes = frame_codec_frame_bound(
+		handle->video_bytes / 3, 
+		handle->depth_bytes / 2);
+	if (segment_bytes < FRAME_STORE_SPILL_SEGMENT) {
+		segment_bytes = FRAME_STORE_SPILL_SEGMENT;
+	}
+	segment_bytes = (segment_bytes + page_bytes - 1) & ~(page_bytes - 1);
+	segment_count = max_bytes / segment_bytes;
+	if (0 == segment_count) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	live = (size_t*)calloc(segment_count, sizeof(size_t));
+	if (NULL == live) {
+		return ERR_FAILED_ALLOC;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		free(live);
+		return ERR_IO_ERROR;
+	}
+	/* nothing else needs the file, it goes away with the store */
+	unlink(path);
+
+	/* sparse, the disk fills as frames are written */
+	if (0 == ftruncate(fd, (off_t)(segment_count * segment_bytes))) {
+		base = mmap(
+			NULL, 
+			segment_count * segment_bytes, 
+			PROT_READ, 
+			MAP_SHARED, 
+			fd, 
+			0);
+	}
+	if (MAP_FAILED == base) {
+		close(fd);
+		free(live);
+		return ERR_IO_ERROR;
+	}
+
+	handle->spill_fd = fd;
+	handle->spill_base = (unsigned char*)base;
+	handle->spill_bytes = segment_count * segment_bytes;
+	handle->spill_segment_bytes = segment_bytes;
+	handle->spill_segment_count = segment_count;
+	handle->spill_live = live;
+	handle->spill_segment = 0;
+	handle->spill_end = 0;
+	return NO_ERROR;
+}
+
+status_t frame_store_enable_previews(
+	frame_store_handle_t handle,
+	size_t width,
+	size_t height)
+{
+	status_t status = NO_ERROR;
+	size_t offset = 0;
+	size_t level = 0;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	/* RGB video and 16 bit depth of the same size */
+	if ((width * height * 3 != handle->video_bytes) || 
+		(width * height * 2 != handle->depth_bytes) ||
+		((width >> FRAME_STORE_PREVIEW_LEVELS) < 1) ||
+		((height >> FRAME_STORE_PREVIEW_LEVELS) < 1))
+	{
+		return ERR_INVALID_ARGUMENT;
+	}
+	if (NULL != handle->preview_pool) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	/* depth first keeps it aligned whatever the video sizes are */
+	for (level = 0; level < FRAME_STORE_PREVIEW_LEVELS; level++) {
+		handle->preview_width[level] = width >> (level + 1);
+		handle->preview_height[level] = height >> (level + 1);
+		handle->preview_depth_offset[level] = offset;
+		offset += handle->preview_width[level] * 
+			handle->preview_height[level] * 2;
+	}
+	for (level = 0; level < FRAME_STORE_PREVIEW_LEVELS; level++) {
+		handle->preview_video_offset[level] = offset;
+		offset += handle->preview_width[level] * 
+			handle->preview_height[level] * 3;
+	}
+
+	/* only frames with their planes have previews */
+	status = memory_pool_create(
+		offset,
+		64,
+		128,
+		handle->raw_frames * offset,
+		100000,
+		MEMORY_POOL_ARENA | MEMORY_POOL_HUGE_PAGES,
+		&(handle->preview_pool));
+	if (NO_ERROR != status) {
+		handle->preview_pool = NULL;
+		return status;
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_preview_size(
+	frame_store_handle_t handle,
+	unsigned int level,
+	size_t* p_width,
+	size_t* p_height)
+{
+	if ((NULL == handle) || (NULL == p_width) || (NULL == p_height)) {
+		return ERR_NULL_POINTER;
+	}
+	if ((level < 1) || (level > FRAME_STORE_PREVIEW_LEVELS)) {
+		return ERR_RANGE_ERROR;
+	}
+	if (NULL == handle->preview_pool) {
+		return ERR_EMPTY;
+	}
+
+	*p_width = handle->preview_width[level - 1];
+	*p_height = handle->preview_height[level - 1];
+	return NO_ERROR;
+}
+
+status_t frame_store_preview_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	unsigned int level,
+	void** p_video,
+	void** p_depth)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	unsigned char* preview = NULL;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if ((level < 1) || (level > FRAME_STORE_PREVIEW_LEVELS)) {
+		return ERR_RANGE_ERROR;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	preview = ((frame_t*)p_slot->frame)->preview;
+	if (NULL == preview) {
+		return ERR_EMPTY;
+	}
+
+	if (NULL != p_video) {
+		*p_video = (void*)&(preview[handle->preview_video_offset[level - 1]]);
+	}
+	if (NULL != p_depth) {
+		*p_depth = (void*)&(preview[handle->preview_depth_offset[level - 1]]);
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_update_previews(
+	frame_store_handle_t handle,
+	frame_id_t frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if ((NULL == p_frame->preview) || 
+		(NULL == p_frame->video) || 
+		(NULL == p_frame->depth)) 
+	{
+		return ERR_EMPTY;
+	}
+
+	/* the chunk just given back is claimed again, failing that the frame
+	 * is left without previews rather than with stale ones */
+	memory_pool_unclaim(handle->preview_pool, (void*)p_frame->preview);
+	p_frame->preview = NULL;
+	_frame_store_make_previews(handle, p_frame);
+	return NO_ERROR;
+}
+
+status_t frame_store_spill_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+	size_t offset = 0;
+	size_t written = 0;
+	ssize_t result = 0;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (NULL == handle->spill_base) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if (NULL == p_frame->compressed) {
+		/* only compressed frames are spilled */
+		return ERR_INVALID_ARGUMENT;
+	}
+	if (TRUE == _frame_store_on_disk(handle, p_frame)) {
+		return NO_ERROR;
+	}
+
+	status = _frame_store_spill_space(handle, p_frame->compressed_size, &offset);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	while (written < p_frame->compressed_size) {
+		result = pwrite(
+			handle->spill_fd, 
+			&(p_frame->compressed[written]), 
+			p_frame->compressed_size - written, 
+			(off_t)(offset + written));
+		if (result <= 0) {
+			if ((result < 0) && (EINTR == errno)) {
+				continue;
+			}
+			/* the segment space is simply used again */
+			return ERR_IO_ERROR;
+		}
+		written += (size_t)result;
+	}
+
+	/* the page cache backs the mapping, so the data is there at once */
+	handle->spill_end = offset + p_frame->compressed_size;
+	handle->spill_live[offset / handle->spill_segment_bytes] += 
+		p_frame->compressed_size;
+	if (NULL != p_frame->extent) {
+		handle->compression_stats.packed_frames--;
+	}
+	_frame_store_free_compressed(p_frame);
+	p_frame->compressed = &(handle->spill_base[offset]);
+	p_frame->extent = NULL;
+
+	handle->compression_stats.spilled_frames++;
+	handle->compression_stats.spilled_bytes += p_frame->compressed_size;
+	return NO_ERROR;
+}
+
+status_t frame_store_prefetch_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+	size_t start = 0;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if ((FALSE == _frame_store_on_disk(handle, p_frame)) ||
+		(NULL != p_frame->video))
+	{
+		return NO_ERROR;
+	}
+
+	/* madvise wants whole pages */
+	start = (size_t)p_frame->compressed & ~(handle->page_bytes - 1);
+	if (0 != madvise(
+		(void*)start, 
+		(size_t)p_frame->compressed + p_frame->compressed_size - start, 
+		MADV_WILLNEED))
+	{
+		return ERR_IO_ERROR;
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_pack_frames(
+	frame_store_handle_t handle,
+	size_t count,
+	const frame_id_t* frame_ids)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+	frame_extent_t* extent = NULL;
+	unsigned char* data = NULL;
+	size_t size = 0;
+	size_t packed = 0;
+	size_t i = 0;
+
+	if ((NULL == handle) || (NULL == frame_ids)) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* frames on disk are left where they are */
+	for (i = 0; i < count; i++) {
+		status = _frame_store_slot(handle, frame_ids[i], &p_slot);
+		if (NO_ERROR != status) {
+			return status;
+		}
+		p_frame = (frame_t*)p_slot->frame;
+		if ((NULL != p_frame->compressed) && 
+			(FALSE == _frame_store_on_disk(handle, p_frame))) 
+		{
+			size += p_frame->compressed_size;
+			packed++;
+		}
+	}
+	if (packed < 2) {
+		/* already as contiguous as it gets */
+		return NO_ERROR;
+	}
+
+	extent = (frame_extent_t*)malloc(sizeof(frame_extent_t) + size);
+	if (NULL == extent) {
+		return ERR_FAILED_ALLOC;
+	}
+	extent->frames = (int)packed;
+	data = (unsigned char*)&(extent[1]);
+
+	for (i = 0; i < count; i++) {
+		/* every id was found above */
+		_frame_store_slot(handle, frame_ids[i], &p_slot);
+		p_frame = (frame_t*)p_slot->frame;
+		if ((NULL == p_frame->compressed) || 
+			(TRUE == _frame_store_on_disk(handle, p_frame))) 
+		{
+			continue;
+		}
+		memcpy(data, p_frame->compressed, p_frame->compressed_size);
+		if (NULL == p_frame->extent) {
+			handle->compression_stats.packed_frames++;
+		}
+		_frame_store_free_compressed(p_frame);
+		p_frame->compressed = data;
+		p_frame->extent = extent;
+		data += p_frame->compressed_size;
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_set_pressure_callback(
+	frame_store_handle_t handle,
+	size_t pressure_frames,
+	frame_store_pressure_cb_t callback,
+	void* user_data)
+{
+	status_t status = NO_ERROR;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* removing the pool's callback first means ours is not running while
+	 * it is swapped */
+	status = memory_pool_set_pressure_callback(
+		handle->memory_pool, 
+		0, 
+		NULL, 
+		NULL);
+	if ((NO_ERROR == status) && (NULL != handle->video_pool)) {
+		status = memory_pool_set_pressure_callback(
+			handle->video_pool, 
+			0, 
+			NULL, 
+			NULL);
+	}
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	handle->pressure_callback = callback;
+	handle->pressure_user_data = user_data;
+	if (NULL == callback) {
+		return NO_ERROR;
+	}
+
+	/* frames and chunks are one to one.  planar stores can also run out of
+	 * planes first, the depth pool runs out along with the video pool. */
+	status = memory_pool_set_pressure_callback(
+		handle->memory_pool, 
+		pressure_frames, 
+		&_frame_store_pressure, 
+		handle);
+	if ((NO_ERROR == status) && (NULL != handle->video_pool)) {
+		status = memory_pool_set_pressure_callback(
+			handle->video_pool, 
+			pressure_frames, 
+			&_frame_store_pressure, 
+			handle);
+	}
+	return status;
+}
+
+void _frame_store_pressure(
+	memory_pool_handle_t pool, 
+	size_t shortfall_chunks, 
+	void* data)
+{
+	frame_store_t* p_frame_store = (frame_store_t*)data;
+
+	p_frame_store->pressure_callback(
+		p_frame_store, 
+		shortfall_chunks, 
+		p_frame_store->pressure_user_data);
+}
+
+status_t _frame_store_capture_data(
+	frame_store_handle_t handle,
+	unsigned int plane,
+	size_t data_size,
+	void* data,
+	timestamp_t timestamp,
+	frame_id_t* p_frame_id)
+{
+	status_t    err               = NO_ERROR;
+	frame_assembly_t* p_entry     = NULL;
+	unsigned char* plane_data     = NULL;
+	timestamp_t distance          = 0;
+	timestamp_t nearest           = 0;
+	size_t      i                 = 0;
+
+	if ((NULL == handle) || (NULL == data) || (NULL == p_frame_id)) {
+		return ERR_NULL_POINTER;
+	}
+
+	*p_frame_id = invalid_frame_id;
+	for (i = 0; i < FRAME_STORE_ASSEMBLY_SLOTS; i++) {
+		if (!handle->assembly[i].pending) {
+			continue;
+		}
+		distance = timestamp - handle->assembly[i].timestamp;
+		if (distance < 0) {
+			distance = -distance;
+		}
+		if ((distance <= handle->capture_tolerance) && 
+			((NULL == p_entry) || (distance < nearest)))
+		{
+			p_entry = &(handle->assembly[i]);
+			nearest = distance;
+		}
+	}
+
+	if (NULL == p_entry) {
+		err = _frame_store_start_frame(handle, plane, data, timestamp, &p_entry);
+		if (NO_ERROR != err) {
+			return err;
+		}
+	}
+	else if (p_entry->planes & plane) {
+		/* the later copy of the plane is kept */
+		handle->capture_stats.repeated_planes++;
+	}
+	else if (p_entry->sequence != handle->assembly_sequence) {
+		/* a newer frame was started before this one was complete */
+		handle->capture_stats.late_planes++;
+	}
+
+	/* data written in place into another frame is copied */
+	plane_data = _frame_store_plane(handle, p_entry->frame, plane);
+	if (data != (void*)plane_data) {
+		memcpy(plane_data, data, data_size);
+	}
+	p_entry->planes |= plane;
+	if (p_entry->planes != handle->frame_planes) {
+		return NO_ERROR;
+	}
+
+	/* we've collected all the necessary data, so time to store the frame */
+	if (NULL != handle->preview_pool) {
+		_frame_store_make_previews(handle, (frame_t*)p_entry->frame);
+	}
+	err = _frame_store_add_slot(handle, p_entry->frame, p_frame_id);
+	if (NO_ERROR != err) {
+		return err;
+	}
+	handle->frame_count++;
+	/* the store's reference */
+	((frame_t*)p_entry->frame)->refcount = 1;
+	p_entry->frame = NULL;
+	p_entry->pending = FALSE;
+	handle->capture_stats.completed_frames++;
+	_frame_store_drop_frames(handle, p_entry->timestamp);
+	return NO_ERROR;
+}
+
+void _frame_store_drop_frames(
+	frame_store_handle_t handle,
+	timestamp_t timestamp)
+{
+	size_t i = 0;
+
+	for (i = 0; i < FRAME_STORE_ASSEMBLY_SLOTS; i++) {
+		if (handle->assembly[i].pending && 
+			(handle->assembly[i].timestamp < timestamp))
+		{
+			handle->assembly[i].pending = FALSE;
+			handle->capture_stats.dropped_frames++;
+		}
+	}
+}
+
+status_t _frame_store_start_frame(
+	frame_store_handle_t handle,
+	unsigned int plane,
+	void* data,
+	timestamp_t timestamp,
+	frame_assembly_t** p_entry)
+{
+	status_t err = NO_ERROR;
+	frame_assembly_t* p_oldest = NULL;
+	unsigned char* frame = NULL;
+	size_t i = 0;
+
+	for (i = 0; i < FRAME_STORE_ASSEMBLY_SLOTS; i++) {
+		if (!handle->assembly[i].pending) {
+			p_oldest = &(handle->assembly[i]);
+			break;
+		}
+		if ((NULL == p_oldest) || 
+			(handle->assembly[i].sequence < p_oldest->sequence))
+		{
+			p_oldest = &(handle->assembly[i]);
+		}
+	}
+	if (p_oldest->pending) {
+		handle->capture_stats.dropped_frames++;
+	}
+
+	/* data written in place into the spare starts the frame there, and
+	 * the entry's chunk, if it kept one, becomes the spare */
+	frame = p_oldest->frame;
+	if ((NULL != handle->spare_frame) && 
+		(data == (void*)_frame_store_plane(
+			handle, 
+			handle->spare_frame, 
+			plane)))
+	{
+		p_oldest->frame = handle->spare_frame;
+		handle->spare_frame = frame;
+		if (NULL != frame) {
+			_frame_store_reset_frame(handle, frame);
+		}
+	}
+	else if (NULL == frame) {
+		err = _frame_store_claim_frame(handle, &(p_oldest->frame));
+		if (NO_ERROR != err) {
+			p_oldest->frame = NULL;
+			return err;
+		}
+	}
+
+	_frame_store_reset_frame(handle, p_oldest->frame);
+	memcpy(
+		&(p_oldest->frame[handle->timestamp_offset]),
+		&timestamp,
+		sizeof(timestamp_t));
+	p_oldest->pending = TRUE;
+	p_oldest->planes = 0;
+	p_oldest->timestamp = timestamp;
+	p_oldest->sequence = ++(handle->assembly_sequence);
+
+	/* capture still works by copying if there is no spare */
+	_frame_store_claim_spare(handle);
+
+	*p_entry = p_oldest;
+	return NO_ERROR;
+}
+
+status_t _frame_store_target(
+	frame_store_handle_t handle,
+	unsigned int plane,
+	void** p_data)
+{
+	frame_assembly_t* p_entry = NULL;
+	size_t i = 0;
+
+	if (NULL == p_data) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* each stream delivers its frames in order, so its next plane belongs
+	 * to the oldest frame still missing it or to a new one */
+	for (i = 0; i < FRAME_STORE_ASSEMBLY_SLOTS; i++) {
+		if (handle->assembly[i].pending && 
+			(0 == (handle->assembly[i].planes & plane)) &&
+			((NULL == p_entry) || 
+				(handle->assembly[i].sequence < p_entry->sequence)))
+		{
+			p_entry = &(handle->assembly[i]);
+		}
+	}
+	if (NULL != p_entry) {
+		*p_data = (void*)_frame_store_plane(handle, p_entry->frame, plane);
+		return NO_ERROR;
+	}
+
+	if (NO_ERROR != _frame_store_claim_spare(handle)) {
+		/* the device keeps its own buffer and capture copies */
+		return ERR_EMPTY;
+	}
+	*p_data = (void*)_frame_store_plane(handle, handle->spare_frame, plane);
+	return NO_ERROR;
+}
+
+status_t _frame_store_claim_spare(frame_store_handle_t handle) {
+	status_t err = NO_ERROR;
+
+	if (NULL != handle->spare_frame) {
+		return NO_ERROR;
+	}
+	err = _frame_store_claim_frame(handle, &(handle->spare_frame));
+	if (NO_ERROR != err) {
+		handle->spare_frame = NULL;
+		return err;
+	}
+	_frame_store_reset_frame(handle, handle->spare_frame);
+	return NO_ERROR;
+}
+
+void _frame_store_reset_frame(
+	frame_store_handle_t handle, 
+	unsigned char* frame)
+{
+	/* only the header and timestamp need resetting; completeness is tracked
+	 * by the frame's assembly entry, so the planes are left as they are */
+	timestamp_t* p_timestamp = 
+		((timestamp_t*)&(frame[handle->timestamp_offset]));
+
+	((frame_t*)frame)->refcount = 0;
+	/* set timestamp to negative value to make sure it doesn't get confused
+	 * with a timestamp of zero */
+	*p_timestamp = (timestamp_t)-1;
+}
+
+unsigned char* _frame_store_plane(
+	frame_store_handle_t handle,
+	unsigned char* frame,
+	unsigned int plane)
+{
+	switch (plane) {
+		case FRAME_STORE_VIDEO_PLANE:
+			return ((frame_t*)frame)->video;
+		case FRAME_STORE_DEPTH_PLANE:
+			return ((frame_t*)frame)->depth;
+		default:
+			return &(frame[handle->meta_offset]);
+	}
+}
+
+status_t _frame_store_claim_frame(
+	frame_store_handle_t handle,
+	unsigned char** p_frame)
+{
+	status_t status = NO_ERROR;
+	unsigned char* frame = NULL;
+	void* video = NULL;
+	void* depth = NULL;
+
+	status = memory_pool_claim(handle->memory_pool, (void**)&frame);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	if (FRAME_STORE_PLANAR & handle->flags) {
+		status = _frame_store_claim_planes(handle, &video, &depth);
+		if (NO_ERROR != status) {
+			memory_pool_unclaim(handle->memory_pool, frame);
+			return status;
+		}
+	}
+	else {
+		video = (void*)&(frame[handle->video_offset]);
+		depth = (void*)&(frame[handle->depth_offset]);
+	}
+
+	((frame_t*)frame)->video = (unsigned char*)video;
+	((frame_t*)frame)->depth = (unsigned char*)depth;
+	((frame_t*)frame)->compressed = NULL;
+	((frame_t*)frame)->compressed_size = 0;
+	((frame_t*)frame)->extent = NULL;
+	((frame_t*)frame)->borrowed = FALSE;
+	((frame_t*)frame)->preview = NULL;
+	*p_frame = frame;
+	return NO_ERROR;
+}
+
+status_t _frame_store_claim_planes(
+	frame_store_handle_t handle,
+	void** p_video,
+	void** p_depth)
+{
+	status_t status = NO_ERROR;
+
+	status = memory_pool_claim(handle->video_pool, p_video);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	status = memory_pool_claim(handle->depth_pool, p_depth);
+	if (NO_ERROR != status) {
+		memory_pool_unclaim(handle->video_pool, *p_video);
+		return status;
+	}
+	return NO_ERROR;
+}
+
+status_t _frame_store_compress(
+	frame_store_handle_t handle,
+	frame_t* p_frame,
+	const unsigned short* depth,
+	const unsigned char* mask)
+{
+	status_t status = NO_ERROR;
+	unsigned char* compressed = NULL;
+	size_t size = 0;
+	double start = 0.0;
+
+	start = _frame_store_seconds();
+	status = frame_codec_encode_frame(
+		p_frame->video, 
+		handle->video_bytes / 3, 
+		depth,
+		handle->depth_bytes / 2,
+		mask,
+		handle->codec_buffer,
+		&size);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* spilled frames do not count against the budget */
+	if (handle->compression_stats.compressed_bytes - 
+		handle->compression_stats.spilled_bytes + 
+		size > handle->compressed_budget)
+	{
+		return ERR_FULL;
+	}
+	compressed = (unsigned char*)malloc(size);
+	if (NULL == compressed) {
+		return ERR_FAILED_ALLOC;
+	}
+	memcpy(compressed, handle->codec_buffer, size);
+	p_frame->compressed = compressed;
+	p_frame->compressed_size = size;
+
+	handle->compression_stats.compressed_frames++;
+	handle->compression_stats.raw_bytes += 
+		handle->video_bytes + handle->depth_bytes;
+	handle->compression_stats.compressed_bytes += p_frame->compressed_size;
+	handle->compression_stats.encoded_frames++;
+	handle->compression_stats.encode_seconds += _frame_store_seconds() - start;
+
+	/* pinned frames keep their planes until frame_store_shrink_frame */
+	_frame_store_shrink(handle, p_frame);
+	return NO_ERROR;
+}
+
+void _frame_store_foreground(
+	frame_store_handle_t handle,
+	const unsigned short* depth,
+	unsigned short max_depth)
+{
+	size_t width = handle->foreground_width;
+	size_t height = handle->foreground_height;
+	size_t pixel_count = width * height;
+	unsigned char* mask = handle->foreground_mask;
+	unsigned char* rows = &(handle->foreground_mask[pixel_count]);
+	size_t i = 0;
+
+	for (i = 0; i < pixel_count; i++) {
+		mask[i] = (0 != depth[i]) && (depth[i] <= max_depth);
+	}
+
+	/* a square around every visible pixel, along the rows and then down
+	 * the columns */
+	_frame_store_dilate(mask, 1, width, height, width, handle->foreground_margin, rows);
+	_frame_store_dilate(rows, width, height, width, 1, handle->foreground_margin, mask);
+
+	for (i = 0; i < pixel_count; i++) {
+		handle->foreground_depth[i] = mask[i] ? depth[i] : 0;
+	}
+}
+
+void _frame_store_dilate(
+	const unsigned char* mask,
+	size_t step,
+	size_t length,
+	size_t lines,
+	size_t line_step,
+	size_t radius,
+	unsigned char* dilated)
+{
+	const unsigned char* in = NULL;
+	unsigned char* out = NULL;
+	size_t distance = 0;
+	size_t line = 0;
+	size_t i = 0;
+
+	for (line = 0; line < lines; line++) {
+		in = &(mask[line * line_step]);
+		out = &(dilated[line * line_step]);
+
+		/* distance to the nearest set pixel before, then after */
+		distance = radius + 1;
+		for (i = 0; i < length; i++) {
+			if (in[i * step]) {
+				distance = 0;
+			}
+			else if (distance <= radius) {
+				distance++;
+			}
+			out[i * step] = (distance <= radius);
+		}
+		distance = radius + 1;
+		for (i = length; i-- > 0; ) {
+			if (in[i * step]) {
+				distance = 0;
+			}
+			else if (distance <= radius) {
+				distance++;
+			}
+			if (distance <= radius) {
+				out[i * step] = 1;
+			}
+		}
+	}
+}
+
+bool_t _frame_store_shrink(frame_store_handle_t handle, frame_t* p_frame) {
+	if ((NULL == p_frame->compressed) || (NULL == p_frame->video)) {
+		/* nothing that could be dropped */
+		return TRUE;
+	}
+	/* only the store's own reference, and new ones need the caller's lock */
+	if (p_frame->refcount > 1) {
+		return FALSE;
+	}
+
+	memory_pool_unclaim(handle->video_pool, (void*)p_frame->video);
+	memory_pool_unclaim(handle->depth_pool, (void*)p_frame->depth);
+	p_frame->video = NULL;
+	p_frame->depth = NULL;
+	/* previews go with the planes they were made from */
+	if (NULL != p_frame->preview) {
+		memory_pool_unclaim(handle->preview_pool, (void*)p_frame->preview);
+		p_frame->preview = NULL;
+	}
+	return TRUE;
+}
+
+void _frame_store_make_previews(
+	frame_store_handle_t handle, 
+	frame_t* p_frame)
+{
+	unsigned char* preview = NULL;
+	size_t level = 0;
+
+	/* the frame is still stored, just without previews */
+	if (NO_ERROR != memory_pool_claim(handle->preview_pool, (void**)&preview)) {
+		return;
+	}
+
+	/* each level is made from the one above it */
+	_frame_store_pool_depth(
+		(const unsigned short*)p_frame->depth,
+		handle->preview_width[0] * 2,
+		handle->preview_height[0] * 2,
+		(unsigned short*)&(preview[handle->preview_depth_offset[0]]));
+	_frame_store_pool_video(
+		p_frame->video,
+		handle->preview_width[0] * 2,
+		handle->preview_height[0] * 2,
+		&(preview[handle->preview_video_offset[0]]));
+	for (level = 1; level < FRAME_STORE_PREVIEW_LEVELS; level++) {
+		_frame_store_pool_depth(
+			(const unsigned short*)&(preview[handle->preview_depth_offset[level - 1]]),
+			handle->preview_width[level - 1],
+			handle->preview_height[level - 1],
+			(unsigned short*)&(preview[handle->preview_depth_offset[level]]));
+		_frame_store_pool_video(
+			&(preview[handle->preview_video_offset[level - 1]]),
+			handle->preview_width[level - 1],
+			handle->preview_height[level - 1],
+			&(preview[handle->preview_video_offset[level]]));
+	}
+	p_frame->preview = preview;
+}
+
+void _frame_store_pool_depth(
+	const unsigned short* depth,
+	size_t width,
+	size_t height,
+	unsigned short* preview)
+{
+	const unsigned short* row = NULL;
+	unsigned int value = 0;
+	unsigned int nearest = 0;
+	size_t x = 0;
+	size_t y = 0;
+	size_t i = 0;
+
+	/* zero is no reading, so a block is as near as its nearest valid
+	 * pixel and zero only if it has none */
+	for (y = 0; y < height / 2; y++) {
+		row = &(depth[2 * y * width]);
+		for (x = 0; x < width / 2; x++) {
+			nearest = 0x10000;
+			for (i = 0; i < 4; i++) {
+				value = row[(i >> 1) * width + 2 * x + (i & 1)];
+				if ((0 != value) && (value < nearest)) {
+					nearest = value;
+				}
+			}
+			*preview++ = (0x10000 == nearest) ? 0 : (unsigned short)nearest;
+		}
+	}
+}
+
+void _frame_store_pool_video(
+	const unsigned char* video,
+	size_t width,
+	size_t height,
+	unsigned char* preview)
+{
+	const unsigned char* top = NULL;
+	const unsigned char* bottom = NULL;
+	size_t x = 0;
+	size_t y = 0;
+	size_t c = 0;
+
+	for (y = 0; y < height / 2; y++) {
+		top = &(video[2 * y * width * 3]);
+		bottom = top + width * 3;
+		for (x = 0; x < width / 2; x++) {
+			for (c = 0; c < 3; c++) {
+				*preview++ = (unsigned char)(((unsigned)top[c] + top[c + 3] + 
+					bottom[c] + bottom[c + 3] + 2) >> 2);
+			}
+			top += 6;
+			bottom += 6;
+		}
+	}
+}
+
+void _frame_store_forget(frame_store_handle_t handle, frame_t* p_frame) {
+	size_t segment = 0;
+
+	/* the compressed data itself goes with the frame's last reference */
+	if (NULL != p_frame->compressed) {
+		handle->compression_stats.compressed_frames--;
+		handle->compression_stats.raw_bytes -= 
+			handle->video_bytes + handle->depth_bytes;
+		handle->compression_stats.compressed_bytes -= p_frame->compressed_size;
+	}
+	if (NULL != p_frame->extent) {
+		handle->compression_stats.packed_frames--;
+	}
+
+	if (TRUE == _frame_store_on_disk(handle, p_frame)) {
+		handle->compression_stats.spilled_frames--;
+		handle->compression_stats.spilled_bytes -= p_frame->compressed_size;
+	}
+
+	/* spilled data is only read by frame_store_expand_frame, which needs
+	 * the frame id, so its space can be reused right away */
+	if (TRUE == _frame_store_spilled(handle, p_frame->compressed)) {
+		segment = (size_t)(p_frame->compressed - handle->spill_base) / 
+			handle->spill_segment_bytes;
+		handle->spill_live[segment] -= p_frame->compressed_size;
+		if ((segment == handle->spill_segment) && 
+			(0 == handle->spill_live[segment])) 
+		{
+			handle->spill_end = segment * handle->spill_segment_bytes;
+		}
+	}
+}
+
+status_t frame_store_compressed_frame(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	const void** p_data,
+	size_t* p_size,
+	timestamp_t* p_timestamp)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_slot = NULL;
+	frame_t* p_frame = NULL;
+
+	if ((NULL == handle) || (NULL == p_data) || (NULL == p_size)) {
+		return ERR_NULL_POINTER;
+	}
+
+	status = _frame_store_slot(handle, frame_id, &p_slot);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	p_frame = (frame_t*)p_slot->frame;
+	if (NULL == p_frame->compressed) {
+		return ERR_EMPTY;
+	}
+
+	*p_data = p_frame->compressed;
+	*p_size = p_frame->compressed_size;
+	if (NULL != p_timestamp) {
+		memcpy(
+			p_timestamp, 
+			&(p_slot->frame[handle->timestamp_offset]), 
+			sizeof(timestamp_t));
+	}
+	return NO_ERROR;
+}
+
+status_t frame_store_restore_frame(
+	frame_store_handle_t handle,
+	const void* data,
+	size_t size,
+	const void* meta,
+	timestamp_t timestamp,
+	frame_id_t* p_frame_id)
+{
+	status_t status = NO_ERROR;
+	unsigned char* frame = NULL;
+	frame_t* p_frame = NULL;
+
+	if ((NULL == handle) || (NULL == data) || (NULL == p_frame_id)) {
+		return ERR_NULL_POINTER;
+	}
+	if (0 == (FRAME_STORE_COMPRESSED & handle->flags)) {
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	status = frame_codec_check_frame(
+		(const unsigned char*)data, 
+		size, 
+		handle->video_bytes / 3);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* only the frame chunk, the planes are claimed when it is expanded */
+	status = memory_pool_claim(handle->memory_pool, (void**)&frame);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	_frame_store_reset_frame(handle, frame);
+	p_frame = (frame_t*)frame;
+	p_frame->video = NULL;
+	p_frame->depth = NULL;
+	p_frame->compressed = (unsigned char*)data;
+	p_frame->compressed_size = size;
+	p_frame->extent = NULL;
+	p_frame->borrowed = TRUE;
+	p_frame->preview = NULL;
+	if (NULL != meta) {
+		memcpy(&(frame[handle->meta_offset]), meta, handle->meta_bytes);
+	}
+	else {
+		memset(&(frame[handle->meta_offset]), 0, handle->meta_bytes);
+	}
+	memcpy(&(frame[handle->timestamp_offset]), &timestamp, sizeof(timestamp_t));
+
+	status = _frame_store_add_slot(handle, frame, p_frame_id);
+	if (NO_ERROR != status) {
+		memory_pool_unclaim(handle->memory_pool, frame);
+		return status;
+	}
+	handle->frame_count++;
+	/* the store's reference */
+	p_frame->refcount = 1;
+
+	handle->compression_stats.compressed_frames++;
+	handle->compression_stats.raw_bytes += 
+		handle->video_bytes + handle->depth_bytes;
+	handle->compression_stats.compressed_bytes += size;
+	handle->compression_stats.spilled_frames++;
+	handle->compression_stats.spilled_bytes += size;
+	return NO_ERROR;
+}
+
+void _frame_store_free_compressed(frame_t* p_frame) {
+	if (NULL == p_frame->extent) {
+		free(p_frame->compressed);
+	}
+	else if (0 == __sync_sub_and_fetch(&(p_frame->extent->frames), 1)) {
+		free(p_frame->extent);
+	}
+}
+
+bool_t _frame_store_on_disk(frame_store_handle_t handle, frame_t* p_frame) {
+	return (TRUE == p_frame->borrowed) || 
+		(TRUE == _frame_store_spilled(handle, p_frame->compressed));
+}
+
+bool_t _frame_store_spilled(
+	frame_store_handle_t handle, 
+	const unsigned char* data)
+{
+	return (NULL != handle->spill_base) && 
+		(data >= handle->spill_base) && 
+		(data < handle->spill_base + handle->spill_bytes);
+}
+
+status_t _frame_store_spill_space(
+	frame_store_handle_t handle,
+	size_t size,
+	size_t* p_offset)
+{
+	size_t segment = handle->spill_segment;
+	size_t i = 0;
+
+	if (handle->spill_end + size > 
+		(segment + 1) * handle->spill_segment_bytes) 
+	{
+		/* move on to the next segment nothing lives in */
+		for (i = 1; i <= handle->spill_segment_count; i++) {
+			segment = (handle->spill_segment + i) % handle->spill_segment_count;
+			if (0 == handle->spill_live[segment]) {
+				break;
+			}
+		}
+		if (i > handle->spill_segment_count) {
+			return ERR_FULL;
+		}
+		handle->spill_segment = segment;
+		handle->spill_end = segment * handle->spill_segment_bytes;
+	}
+	*p_offset = handle->spill_end;
+	return NO_ERROR;
+}
+
+int _frame_store_compare_time(const void* a, const void* b) {
+	timestamp_t time_a = *(const timestamp_t*)a;
+	timestamp_t time_b = *(const timestamp_t*)b;
+
+	return (time_a > time_b) - (time_a < time_b);
+}
+
+status_t _frame_store_share(void* in, void** copy) {
+	/* keys and data are used in place */
+	*copy = in;
+	return NO_ERROR;
+}
+
+status_t _frame_store_unshare(void* data) {
+	return NO_ERROR;
+}
+
+double _frame_store_seconds(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
+
+status_t _frame_store_unclaim_frames(
+	frame_store_handle_t handle,
+	size_t count,
+	void** frames)
+{
+	status_t status = NO_ERROR;
+	status_t result = NO_ERROR;
+	void* planes[FRAME_STORE_REMOVE_BATCH];
+	size_t plane_count = 0;
+	size_t i = 0;
+
+	if (FRAME_STORE_PLANAR & handle->flags) {
+		/* callers never pass more than one batch.  compressed frames that
+		 * are not expanded have no planes. */
+		for (i = 0; i < count; i++) {
+			if (NULL != ((frame_t*)frames[i])->video) {
+				planes[plane_count++] = (void*)((frame_t*)frames[i])->video;
+			}
+			if (FALSE == _frame_store_on_disk(handle, (frame_t*)frames[i])) {
+				_frame_store_free_compressed((frame_t*)frames[i]);
+			}
+		}
+		result = memory_pool_unclaim_batch(
+			handle->video_pool, 
+			plane_count, 
+			planes);
+		plane_count = 0;
+		for (i = 0; i < count; i++) {
+			if (NULL != ((frame_t*)frames[i])->depth) {
+				planes[plane_count++] = (void*)((frame_t*)frames[i])->depth;
+			}
+		}
+		status = memory_pool_unclaim_batch(
+			handle->depth_pool, 
+			plane_count, 
+			planes);
+		if (NO_ERROR != status) {
+			result = status;
+		}
+	}
+
+	if (NULL != handle->preview_pool) {
+		plane_count = 0;
+		for (i = 0; i < count; i++) {
+			if (NULL != ((frame_t*)frames[i])->preview) {
+				planes[plane_count++] = (void*)((frame_t*)frames[i])->preview;
+			}
+		}
+		status = memory_pool_unclaim_batch(
+			handle->preview_pool, 
+			plane_count, 
+			planes);
+		if (NO_ERROR != status) {
+			result = status;
+		}
+	}
+
+	status = memory_pool_unclaim_batch(handle->memory_pool, count, frames);
+	if (NO_ERROR != status) {
+		result = status;
+	}
+	return result;
+}
+
+status_t _frame_store_slot(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	frame_slot_t** p_slot)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t* p_found = NULL;
+
+	status = vector_element_address(
+		handle->frames, 
+		(size_t)(frame_id & FRAME_STORE_INDEX_MASK), 
+		(void**)&p_found);
+	if (NO_ERROR != status) {
+		return status;
+	}
+	if ((NULL == p_found->frame) || 
+		(p_found->generation != (frame_id >> FRAME_STORE_INDEX_BITS)))
+	{
+		/* removed, possibly with the slot reused since */
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	*p_slot = p_found;
+	return NO_ERROR;
+}
+
+status_t _frame_store_add_slot(
+	frame_store_handle_t handle,
+	unsigned char* frame,
+	frame_id_t* p_frame_id)
+{
+	status_t status = NO_ERROR;
+	frame_slot_t slot;
+	frame_slot_t* p_slot = NULL;
+	frame_id_t index = 0;
+	size_t count = 0;
+
+	if (FRAME_STORE_NO_SLOT != handle->free_slot) {
+		index = handle->free_slot;
+		status = vector_element_address(
+			handle->frames, 
+			(size_t)index, 
+			(void**)&p_slot);
+		if (NO_ERROR != status) {
+			return status;
+		}
+		handle->free_slot = p_slot->next_free;
+	}
+	else {
+		status = vector_count(handle->frames, &count);
+		if (NO_ERROR != status) {
+			return status;
+		}
+		if ((frame_id_t)count >= FRAME_STORE_NO_SLOT) {
+			return ERR_RANGE_ERROR;
+		}
+		index = (frame_id_t)count;
+		slot.frame = NULL;
+		slot.generation = 0;
+		slot.next_free = FRAME_STORE_NO_SLOT;
+		slot.time_node = NULL;
+		status = vector_append(handle->frames, (void*)&slot);
+		if (NO_ERROR != status) {
+			return status;
+		}
+		status = vector_element_address(
+			handle->frames, 
+			(size_t)index, 
+			(void**)&p_slot);
+		if (NO_ERROR != status) {
+			return status;
+		}
+	}
+
+	p_slot->frame = frame;
+	p_slot->next_free = FRAME_STORE_NO_SLOT;
+	*p_frame_id = (p_slot->generation << FRAME_STORE_INDEX_BITS) | index;
+
+	/* the key is the timestamp in the chunk, which outlives the entry */
+	status = rb_tree_insert(
+		handle->time_index,
+		(void*)&(frame[handle->timestamp_offset]),
+		(void*)*p_frame_id,
+		&(p_slot->time_node));
+	if (NO_ERROR != status) {
+		p_slot->time_node = NULL;
+		_frame_store_free_slot(handle, *p_frame_id, p_slot);
+		return status;
+	}
+	return NO_ERROR;
+}
+
+void _frame_store_free_slot(
+	frame_store_handle_t handle,
+	frame_id_t frame_id,
+	frame_slot_t* p_slot)
+{
+	if (NULL != p_slot->time_node) {
+		rb_tree_remove(handle->time_index, p_slot->time_node);
+		p_slot->time_node = NULL;
+	}
+	p_slot->frame = NULL;
+	p_slot->generation = (p_slot->generation + 1) & FRAME_STORE_INDEX_MASK;
+	p_slot->next_free = handle->free_slot;
+	handle->free_slot = frame_id & FRAME_STORE_INDEX_MASK;
+}
+
+bool_t _frame_store_unref(frame_t* p_frame) {
+	/* true when the last reference is gone and the chunk can be unclaimed */
+	return (0 == __sync_sub_and_fetch(&(p_frame->refcount), 1)) ? TRUE : FALSE;
+}
@@ -12,6 +12,8 @@
 static const freenect_loglevel _freenect_log_level = FREENECT_LOG_WARNING;
 static const double _min_camera_angle = -35.0;
 static const double _max_camera_angle = 35.0;
+/* the device clock video and depth frames are stamped with */
+static const double _ticks_per_second = 60000000.0;
 
 
 typedef struct _kinect_manager_s {
@@ -26,7 +28,12 @@ typedef struct _kinect_manager_s {
 	struct timeval timeout;
 	timer_handle_t record_timer;
 	
-	double record_timestamp;
+	/* record time of the first frame since the timer was reset, and the
+	 * device ticks counted since then, past the 32 bit counter wrapping */
+	bool_t have_ticks;
+	double base_timestamp;
+	double ticks;
+	uint32_t last_tick;
 	kinect_callbacks_t callbacks;
 	void* user_data;
 } kinect_manager_t;
@@ -43,6 +50,11 @@ static void _freenect_log_callback(
 	freenect_loglevel level, 
 	const char *msg);
 
+static status_t _record_timestamp(
+	kinect_manager_t* p_knctmgr, 
+	uint32_t tick, 
+	timestamp_t* p_timestamp);
+
 static void _video_cb(freenect_device *dev, void *video, uint32_t timestamp);
 static void _depth_cb(freenect_device *dev, void *depth, uint32_t timestamp);
 
@@ -262,6 +274,8 @@ status_t kinect_manager_reset_timestamp(kinect_manager_handle_t handle) {
 	if (NULL == handle) {
 		return ERR_NULL_POINTER;
 	}
+	/* the device clock is measured from the next frame on */
+	handle->have_ticks = FALSE;
 	return timer_reset(handle->record_timer);
 }
 
@@ -453,6 +467,8 @@ void _freenect_log_callback(
 void _video_cb(freenect_device *dev, void *video, uint32_t timestamp) {
 	/* If in record mode, store video and timestamp */
 	kinect_manager_t* p_knctmgr = NULL;
+	void* buffer = NULL;
+	timestamp_t record_timestamp = 0;
 	int error = 0;
 	
 	p_knctmgr = (kinect_manager_t*)freenect_get_user(dev);
@@ -461,9 +477,7 @@ void _video_cb(freenect_device *dev, void *video, uint32_t timestamp) {
 		return;
 	}
 
-	error = timer_current(
-		p_knctmgr->record_timer, 
-		&(p_knctmgr->record_timestamp));
+	error = _record_timestamp(p_knctmgr, timestamp, &record_timestamp);
 	if (0 != error) {
 		LOG_ERROR("error getting record timestamp");
 		return;
@@ -473,29 +487,99 @@ void _video_cb(freenect_device *dev, void *video, uint32_t timestamp) {
 		p_knctmgr->callbacks.video_frame_callback(
 			p_knctmgr,
 			video,
-			p_knctmgr->record_timestamp,
+			record_timestamp,
+			p_knctmgr->user_data);
+	}
+
+	/* have the device write the next frame straight to where it is kept */
+	if (p_knctmgr->callbacks.video_buffer_callback) {
+		buffer = p_knctmgr->callbacks.video_buffer_callback(
+			p_knctmgr,
 			p_knctmgr->user_data);
+		if (NULL == buffer) {
+			buffer = p_knctmgr->video_buffer;
+		}
+		if (freenect_set_video_buffer(dev, buffer) < 0) {
+			LOG_ERROR("failed to set video buffer");
+		}
 	}
 }
 
 /* freenect callback for depth data */
 void _depth_cb(freenect_device *dev, void *depth, uint32_t timestamp) {
-	/* If in record mode, store depth.  Timestamp handled in video callback */
-	/* TODO: does video callback happen b4 depth? */
+	/* If in record mode, store depth.  The streams run out of step, so
+	 * depth has a timestamp of its own rather than the last video's. */
 	kinect_manager_t* p_knctmgr = NULL;
+	void* buffer = NULL;
+	timestamp_t record_timestamp = 0;
+	int error = 0;
 	
 	p_knctmgr = (kinect_manager_t*)freenect_get_user(dev);
 	if (NULL == p_knctmgr) {
 		LOG_ERROR("null pointer");
 		return;
 	}
+
+	error = _record_timestamp(p_knctmgr, timestamp, &record_timestamp);
+	if (0 != error) {
+		LOG_ERROR("error getting record timestamp");
+		return;
+	}
+
 	if (p_knctmgr->callbacks.depth_frame_callback) {
 		p_knctmgr->callbacks.depth_frame_callback(
 			p_knctmgr,
 			depth,
-			p_knctmgr->record_timestamp,
+			record_timestamp,
 			p_knctmgr->user_data);
 	}
+
+	if (p_knctmgr->callbacks.depth_buffer_callback) {
+		buffer = p_knctmgr->callbacks.depth_buffer_callback(
+			p_knctmgr,
+			p_knctmgr->user_data);
+		if (NULL == buffer) {
+			buffer = p_knctmgr->depth_buffer;
+		}
+		if (freenect_set_depth_buffer(dev, buffer) < 0) {
+			LOG_ERROR("failed to set depth buffer");
+		}
+	}
+}
+
+status_t _record_timestamp(
+	kinect_manager_t* p_knctmgr, 
+	uint32_t tick, 
+	timestamp_t* p_timestamp)
+{
+	/* the time on the record timer the device took the frame at */
+	int32_t delta = 0;
+	status_t error = NO_ERROR;
+
+	if (FALSE == p_knctmgr->have_ticks) {
+		error = timer_current(
+			p_knctmgr->record_timer, 
+			&(p_knctmgr->base_timestamp));
+		if (NO_ERROR != error) {
+			return error;
+		}
+		p_knctmgr->ticks = 0;
+		p_knctmgr->last_tick = tick;
+		p_knctmgr->have_ticks = TRUE;
+	}
+
+	/* the difference is taken unsigned so it survives the counter
+	 * wrapping, and only a later tick moves the count on since a frame of
+	 * one stream can be stamped before the other's last */
+	delta = (int32_t)(tick - p_knctmgr->last_tick);
+	if (delta > 0) {
+		p_knctmgr->ticks += delta;
+		p_knctmgr->last_tick = tick;
+		delta = 0;
+	}
+	*p_timestamp = p_knctmgr->base_timestamp + 
+		(p_knctmgr->ticks + delta) / _ticks_per_second;
+	return NO_ERROR;
 }
 
 bool_t _streq(const char* str1, const char* str2) {
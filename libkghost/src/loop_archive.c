@@ -0,0 +1,394 @@
+#include "loop_archive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* files are in native byte order, the magic does not match otherwise */
+#define LOOP_ARCHIVE_MAGIC "KGHOSTLA"
+#define LOOP_ARCHIVE_MAGIC_BYTES (8)
+#define LOOP_ARCHIVE_TEMP_SUFFIX ".tmp"
+
+/* the first header_bytes of the file.  newer versions may grow it, the
+ * index always starts after it. */
+typedef struct loop_archive_header_s {
+	char magic[LOOP_ARCHIVE_MAGIC_BYTES];
+	uint32_t version;
+	uint32_t header_bytes;
+	uint64_t video_bytes;
+	uint64_t depth_bytes;
+	uint64_t frame_count;
+	uint64_t data_bytes;
+	double first_timestamp;
+	double last_timestamp;
+	double archived_time;
+	/* zero in files written before it was kept */
+	double presence;
+} loop_archive_header_t;
+
+typedef struct loop_archive_entry_s {
+	/* from the start of the file */
+	uint64_t offset;
+	uint64_t size;
+	double timestamp;
+	float cutoff;
+	uint32_t reserved;
+} loop_archive_entry_t;
+
+typedef struct loop_archive_s {
+	unsigned char* base;
+	size_t size;
+	const loop_archive_header_t* p_header;
+	const loop_archive_entry_t* entries;
+} loop_archive_t;
+
+typedef struct loop_archive_writer_s {
+	char* path;
+	char* temp_path;
+	int fd;
+	loop_archive_header_t header;
+	loop_archive_entry_t* entries;
+	size_t frame_index;
+	/* where the next frame is written */
+	uint64_t offset;
+} loop_archive_writer_t;
+
+static status_t _loop_archive_pwrite(
+	int fd,
+	const void* data,
+	size_t size,
+	uint64_t offset);
+
+status_t loop_archive_writer_create(
+	const char* path,
+	size_t video_bytes,
+	size_t depth_bytes,
+	size_t frame_count,
+	loop_archive_writer_handle_t* p_handle)
+{
+	loop_archive_writer_t* p_writer = NULL;
+
+	if ((NULL == path) || (NULL == p_handle)) {
+		return ERR_NULL_POINTER;
+	}
+	if (0 == frame_count) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	p_writer = (loop_archive_writer_t*)malloc(sizeof(loop_archive_writer_t));
+	if (NULL == p_writer) {
+		return ERR_FAILED_ALLOC;
+	}
+	memset(p_writer, 0, sizeof(loop_archive_writer_t));
+	p_writer->fd = -1;
+
+	p_writer->path = (char*)malloc(strlen(path) + 1);
+	p_writer->temp_path = (char*)malloc(
+		strlen(path) + strlen(LOOP_ARCHIVE_TEMP_SUFFIX) + 1);
+	p_writer->entries = (loop_archive_entry_t*)calloc(
+		frame_count,
+		sizeof(loop_archive_entry_t));
+	if ((NULL == p_writer->path) ||
+		(NULL == p_writer->temp_path) ||
+		(NULL == p_writer->entries))
+	{
+		loop_archive_writer_release(p_writer);
+		return ERR_FAILED_ALLOC;
+	}
+	strcpy(p_writer->path, path);
+	strcpy(p_writer->temp_path, path);
+	strcat(p_writer->temp_path, LOOP_ARCHIVE_TEMP_SUFFIX);
+
+	p_writer->fd = open(p_writer->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (p_writer->fd < 0) {
+		loop_archive_writer_release(p_writer);
+		return ERR_IO_ERROR;
+	}
+
+	memcpy(p_writer->header.magic, LOOP_ARCHIVE_MAGIC, LOOP_ARCHIVE_MAGIC_BYTES);
+	p_writer->header.version = LOOP_ARCHIVE_VERSION;
+	p_writer->header.header_bytes = sizeof(loop_archive_header_t);
+	p_writer->header.video_bytes = video_bytes;
+	p_writer->header.depth_bytes = depth_bytes;
+	p_writer->header.frame_count = frame_count;
+	p_writer->offset = sizeof(loop_archive_header_t) +
+		frame_count * sizeof(loop_archive_entry_t);
+
+	*p_handle = p_writer;
+	return NO_ERROR;
+}
+
+status_t loop_archive_writer_add_frame(
+	loop_archive_writer_handle_t handle,
+	const void* data,
+	size_t size,
+	timestamp_t timestamp,
+	float cutoff)
+{
+	status_t status = NO_ERROR;
+	loop_archive_entry_t* p_entry = NULL;
+
+	if ((NULL == handle) || (NULL == data)) {
+		return ERR_NULL_POINTER;
+	}
+	if (handle->frame_index >= handle->header.frame_count) {
+		return ERR_RANGE_ERROR;
+	}
+
+	status = _loop_archive_pwrite(handle->fd, data, size, handle->offset);
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	p_entry = &(handle->entries[handle->frame_index]);
+	p_entry->offset = handle->offset;
+	p_entry->size = size;
+	p_entry->timestamp = timestamp;
+	p_entry->cutoff = cutoff;
+
+	if (0 == handle->frame_index) {
+		handle->header.first_timestamp = timestamp;
+	}
+	handle->header.last_timestamp = timestamp;
+	handle->header.data_bytes += size;
+	handle->offset += size;
+	handle->frame_index++;
+	return NO_ERROR;
+}
+
+status_t loop_archive_writer_set_presence(
+	loop_archive_writer_handle_t handle,
+	double presence)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	handle->header.presence = presence;
+	return NO_ERROR;
+}
+
+status_t loop_archive_writer_finish(loop_archive_writer_handle_t handle) {
+	status_t status = NO_ERROR;
+	struct timeval tv;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (handle->frame_index != handle->header.frame_count) {
+		return ERR_RANGE_ERROR;
+	}
+
+	gettimeofday(&tv, NULL);
+	handle->header.archived_time =
+		(double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+
+	status = _loop_archive_pwrite(
+		handle->fd,
+		handle->entries,
+		handle->header.frame_count * sizeof(loop_archive_entry_t),
+		sizeof(loop_archive_header_t));
+	if (NO_ERROR == status) {
+		status = _loop_archive_pwrite(
+			handle->fd,
+			&(handle->header),
+			sizeof(loop_archive_header_t),
+			0);
+	}
+	if (NO_ERROR != status) {
+		return status;
+	}
+
+	/* the data has to be on disk before the name is */
+	if ((0 != fdatasync(handle->fd)) ||
+		(0 != rename(handle->temp_path, handle->path)))
+	{
+		return ERR_IO_ERROR;
+	}
+	close(handle->fd);
+	handle->fd = -1;
+	return NO_ERROR;
+}
+
+void loop_archive_writer_release(loop_archive_writer_handle_t handle) {
+	if (NULL == handle) {
+		return;
+	}
+
+	if (handle->fd >= 0) {
+		/* never finished */
+		close(handle->fd);
+		unlink(handle->temp_path);
+	}
+	free(handle->path);
+	free(handle->temp_path);
+	free(handle->entries);
+	free(handle);
+}
+
+status_t loop_archive_open(const char* path, loop_archive_handle_t* p_handle) {
+	loop_archive_t* p_archive = NULL;
+	const loop_archive_header_t* p_header = NULL;
+	const loop_archive_entry_t* p_entry = NULL;
+	struct stat st;
+	void* base = MAP_FAILED;
+	size_t index_end = 0;
+	size_t i = 0;
+	int fd = -1;
+
+	if ((NULL == path) || (NULL == p_handle)) {
+		return ERR_NULL_POINTER;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return ERR_IO_ERROR;
+	}
+	if (0 != fstat(fd, &st)) {
+		close(fd);
+		return ERR_IO_ERROR;
+	}
+	if ((size_t)st.st_size < sizeof(loop_archive_header_t)) {
+		close(fd);
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	/* the mapping keeps the file */
+	close(fd);
+	if (MAP_FAILED == base) {
+		return ERR_IO_ERROR;
+	}
+
+	p_header = (const loop_archive_header_t*)base;
+	if ((0 != memcmp(p_header->magic, LOOP_ARCHIVE_MAGIC, LOOP_ARCHIVE_MAGIC_BYTES)) ||
+		(LOOP_ARCHIVE_VERSION != p_header->version) ||
+		(p_header->header_bytes < sizeof(loop_archive_header_t)) ||
+		(0 == p_header->frame_count) ||
+		(p_header->frame_count > (size_t)st.st_size / sizeof(loop_archive_entry_t)))
+	{
+		munmap(base, (size_t)st.st_size);
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+	index_end = p_header->header_bytes +
+		p_header->frame_count * sizeof(loop_archive_entry_t);
+	if (index_end > (size_t)st.st_size) {
+		munmap(base, (size_t)st.st_size);
+		return ERR_UNSUPPORTED_FORMAT;
+	}
+
+	/* frame data is checked once here rather than on every access */
+	p_entry = (const loop_archive_entry_t*)
+		((const unsigned char*)base + p_header->header_bytes);
+	for (i = 0; i < p_header->frame_count; i++) {
+		if ((p_entry[i].offset < index_end) ||
+			(p_entry[i].offset > (size_t)st.st_size) ||
+			(p_entry[i].size > (size_t)st.st_size - p_entry[i].offset))
+		{
+			munmap(base, (size_t)st.st_size);
+			return ERR_UNSUPPORTED_FORMAT;
+		}
+	}
+
+	p_archive = (loop_archive_t*)malloc(sizeof(loop_archive_t));
+	if (NULL == p_archive) {
+		munmap(base, (size_t)st.st_size);
+		return ERR_FAILED_ALLOC;
+	}
+	p_archive->base = (unsigned char*)base;
+	p_archive->size = (size_t)st.st_size;
+	p_archive->p_header = p_header;
+	p_archive->entries = p_entry;
+
+	*p_handle = p_archive;
+	return NO_ERROR;
+}
+
+void loop_archive_release(loop_archive_handle_t handle) {
+	if (NULL == handle) {
+		return;
+	}
+	munmap(handle->base, handle->size);
+	free(handle);
+}
+
+status_t loop_archive_info(
+	loop_archive_handle_t handle,
+	loop_archive_info_t* p_info)
+{
+	if ((NULL == handle) || (NULL == p_info)) {
+		return ERR_NULL_POINTER;
+	}
+
+	p_info->version = handle->p_header->version;
+	p_info->video_bytes = (size_t)handle->p_header->video_bytes;
+	p_info->depth_bytes = (size_t)handle->p_header->depth_bytes;
+	p_info->frame_count = (size_t)handle->p_header->frame_count;
+	p_info->data_bytes = (size_t)handle->p_header->data_bytes;
+	p_info->first_timestamp = handle->p_header->first_timestamp;
+	p_info->last_timestamp = handle->p_header->last_timestamp;
+	p_info->archived_time = handle->p_header->archived_time;
+	p_info->presence = handle->p_header->presence;
+	return NO_ERROR;
+}
+
+status_t loop_archive_frame(
+	loop_archive_handle_t handle,
+	size_t index,
+	const void** p_data,
+	size_t* p_size,
+	timestamp_t* p_timestamp,
+	float* p_cutoff)
+{
+	const loop_archive_entry_t* p_entry = NULL;
+
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+	if (index >= handle->p_header->frame_count) {
+		return ERR_RANGE_ERROR;
+	}
+
+	p_entry = &(handle->entries[index]);
+	if (NULL != p_data) {
+		*p_data = &(handle->base[p_entry->offset]);
+	}
+	if (NULL != p_size) {
+		*p_size = (size_t)p_entry->size;
+	}
+	if (NULL != p_timestamp) {
+		*p_timestamp = p_entry->timestamp;
+	}
+	if (NULL != p_cutoff) {
+		*p_cutoff = p_entry->cutoff;
+	}
+	return NO_ERROR;
+}
+
+status_t _loop_archive_pwrite(
+	int fd,
+	const void* data,
+	size_t size,
+	uint64_t offset)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t written = 0;
+	ssize_t result = 0;
+
+	while (written < size) {
+		result = pwrite(fd, &(bytes[written]), size - written, (off_t)(offset + written));
+		if (result <= 0) {
+			if ((result < 0) && (EINTR == errno)) {
+				continue;
+			}
+			return ERR_IO_ERROR;
+		}
+		written += (size_t)result;
+	}
+	return NO_ERROR;
+}
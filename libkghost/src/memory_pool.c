@@ -1,55 +1,162 @@
 #include "memory_pool.h"
 #include "common.h"
-#include "rb_tree.h"
-#include "stack.h"
 #include "log.h"
 
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 /* memory pool
- *
+ * 
  * The memory_pool utilizes a thread to run memory allocation.  On the thread
- * it allocates memory and places it in the generated stack.  Once it has
- * made the enough chunks it grabs a mutex and transfers them to the available
- * stack.  
+ * it allocates memory, records it in the chunk table and pushes its slot onto
+ * the free list.
+ * 
+ * Every chunk ever generated owns a slot in the chunk table.  Slots that are
+ * available for claiming are linked together in a lock-free (Treiber) stack.
+ * The head of the stack packs the top slot with a tag that is bumped on every
+ * update, so a slot that is popped and pushed back between a read and a
+ * compare-and-swap is not mistaken for an unchanged head.
+ * 
+ * The pool keeps one claimed bit per slot.  Unclaim finds the slot without
+ * touching the memory it was handed: in an arena the slot follows from the
+ * offset, which must land inside the arena on a chunk boundary, and with
+ * malloc the address is looked up in an insert-only hash of chunk addresses.
+ * Either way a pointer that did not come from this pool is rejected before
+ * it is dereferenced, and the claimed bit is cleared atomically, which
+ * catches chunks that are unclaimed twice.
+ * 
+ * When a user tries to claim a chunk, a slot is popped from the free list and
+ * its claimed bit is set.
+ * 
+ * When a user unclaims a chunk, its claimed bit is cleared, and its slot is
+ * pushed back on the free list.
+ * 
+ * The batch calls move a whole run of slots with a single compare-and-swap.
+ * A batch claim walks n links down from the head and swings the head past
+ * them; since every change to the list bumps the tag, an unchanged head
+ * means the walked links are unchanged too.  A batch unclaim links the
+ * returned slots together first and pushes the run in one go.
+ * 
+ * With MEMORY_POOL_ARENA the pool reserves address space for max_chunks up
+ * front with a single mmap and carves chunks from it at a fixed stride, so
+ * the heap is not fragmented by large frame allocations.  The generator then
+ * only has to prefault a chunk's pages before putting it on the free list,
+ * which keeps first-touch page faults off the claiming thread.
+ * MEMORY_POOL_HUGE_PAGES asks for the arena to be backed by huge pages
+ * (MAP_HUGETLB, falling back to transparent huge pages) to cut TLB misses.
  * 
- * When a user tries to claim a chunk, it grabs the mutex, pops from
- * the available stack, and places it into the claimed tree. 
- *
- * When a user unclaims a chunk, it is removed from the claimed tree, and
- * placed back in the available stack
+ * The generator thread sleeps on a condition variable.  A claim that leaves
+ * fewer than min_reserve_chunks available (or finds the pool empty) raises
+ * refill_requested and signals it, so the reserve is topped up as soon as
+ * capture starts draining it rather than on the next polling period.  Only
+ * the claim that raises the flag takes the mutex, so claims stay lock-free
+ * while a refill is pending.  The period is kept as a timeout in case the
+ * reserve needs topping up without a claim, and release signals the thread
+ * so shutdown does not wait out the period.
+ * 
+ * Once max_chunks have been generated the reserve can only grow when users
+ * unclaim.  If a pressure callback is set, the generator calls it whenever
+ * fewer than pressure_chunks could still be claimed, passing the shortfall,
+ * so the owner can free chunks before claims start failing.  It runs on the
+ * generator thread, never inside a claim, so a caller holding its own locks
+ * around memory_pool_claim cannot deadlock against it.
  */
 
+#define MEMORY_POOL_NIL_SLOT (0xFFFFFFFFu)
+#define MEMORY_POOL_HEAD_SLOT(head) ((uint32_t)((head) & 0xFFFFFFFFu))
+#define MEMORY_POOL_HEAD_TAG(head) ((uint32_t)((head) >> 32))
+#define MEMORY_POOL_MAKE_HEAD(slot, tag) \
+	((((uint64_t)(tag)) << 32) | (uint64_t)(slot))
+
+/* arena chunks start on a cache line */
+#define MEMORY_POOL_ARENA_ALIGN (64)
+#define MEMORY_POOL_HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#define MEMORY_POOL_BITS_PER_WORD (sizeof(unsigned int) * 8)
+/* chunk_index entry that ends a probe */
+#define MEMORY_POOL_NO_INDEX (0)
+
 typedef struct memory_pool_s {
 	size_t chunk_size;
 	size_t min_reserve_chunks;
 	size_t max_reserve_chunks;
 	size_t max_chunks;
 	size_t generated_chunks;
-	stack_handle_t generated;
-	rb_tree_handle_t claimed;
-	stack_handle_t available;
+	unsigned int flags;
+
+	/* arena mode only: one mapping holding every chunk at chunk_stride */
+	char* arena;
+	size_t arena_bytes;
+	size_t chunk_stride;
+	size_t page_bytes;
+
+	/* chunk address for every generated slot */
+	void** chunks;
+	/* malloc mode only: open-addressed hash of chunk address to slot + 1,
+	 * index_mask + 1 entries, only ever inserted into by the generator */
+	volatile uint32_t* chunk_index;
+	size_t index_mask;
+	/* one bit per slot, set while the chunk is claimed */
+	volatile unsigned int* claimed;
+	/* free list links, indexed by slot */
+	uint32_t* next_free;
+	/* free list head, see MEMORY_POOL_MAKE_HEAD */
+	volatile uint64_t free_head;
+	/* never less than the number of slots on the free list */
+	volatile size_t available_chunks;
+
+	/* number of claims that found no chunk available */
+	volatile size_t empty_claims;
 
 	pthread_t thread;
 	pthread_mutex_t mutex;
+	pthread_cond_t refill_cond;
+	/* set by the claim that wakes the generator, cleared by the generator */
+	volatile int refill_requested;
 	int kill_thread;
 	useconds_t period_microseconds;
+
+	/* held while the pressure callback is changed or running */
+	pthread_mutex_t pressure_mutex;
+	memory_pool_pressure_cb_t volatile pressure_callback;
+	void* pressure_user_data;
+	size_t pressure_chunks;
 } memory_pool_t;
 
 static void* _memory_pool_thread(void* pool);
-static status_t _memory_pool_generate_chunk(
-	memory_pool_t* pool,
-	stack_handle_t stack);
-static status_t _release_stack_chunks(stack_handle_t stack);
-static status_t _release_tree_chunks(rb_tree_handle_t tree);
-static int _rb_tree_compare(const void*, const void*);
-static status_t _rb_tree_alloc_copy_key(void*, void**);
-static status_t _rb_tree_alloc_copy_data(void*, void**);
-static status_t _rb_tree_release_key(void*);
-static status_t _rb_tree_release_data(void*);
+static status_t _memory_pool_generate_chunk(memory_pool_t* pool);
+static status_t _memory_pool_pop_slot(memory_pool_t* pool, uint32_t* p_slot);
+static void _memory_pool_push_slot(memory_pool_t* pool, uint32_t slot);
+static status_t _memory_pool_pop_slots(
+	memory_pool_t* pool, 
+	size_t count, 
+	uint32_t* p_first);
+static void _memory_pool_push_slots(
+	memory_pool_t* pool, 
+	uint32_t first, 
+	uint32_t last, 
+	size_t count);
+static status_t _memory_pool_release_slot(
+	memory_pool_t* pool, 
+	void* data, 
+	uint32_t* p_slot);
+static void _memory_pool_request_refill(memory_pool_t* pool);
+static int _memory_pool_wait_for_refill(memory_pool_t* pool);
+static void _memory_pool_check_pressure(memory_pool_t* pool);
+static size_t _memory_pool_hash(memory_pool_t* pool, void* chunk);
+static void _release_chunks(memory_pool_t* pool);
+static status_t _memory_pool_map_arena(memory_pool_t* pool);
 
 status_t memory_pool_create(
 	size_t chunkSize, 
@@ -57,6 +164,7 @@ status_t memory_pool_create(
 	size_t maxReserve,
 	size_t maxBytes,
 	useconds_t periodMicroseconds,
+	unsigned int flags,
 	memory_pool_handle_t* p_handle) 
 {
 	status_t err = NO_ERROR;
@@ -64,6 +172,7 @@ status_t memory_pool_create(
 	pthread_attr_t pthreadAttr;
 	memory_pool_t* pool = NULL;
 	size_t chunkCount = 0;
+	size_t claimedWords = 0;
 
 	/* check input variables */
 	if (
@@ -71,6 +180,7 @@ status_t memory_pool_create(
 		(minReserve > maxReserve) ||
 		(maxReserve < 1) ||
 		(maxBytes < (maxReserve * chunkSize)) ||
+		((maxBytes / chunkSize) >= MEMORY_POOL_NIL_SLOT) ||
 		(periodMicroseconds <= 0))
 	{
 		return ERR_INVALID_ARGUMENT;
@@ -87,41 +197,79 @@ status_t memory_pool_create(
 	pool->max_reserve_chunks = maxReserve;
 	pool->max_chunks = maxBytes / chunkSize;
 	pool->generated_chunks = 0;
+	pool->flags = flags;
+	pool->arena = NULL;
+	pool->arena_bytes = 0;
+	pool->chunk_stride = 0;
+	pool->page_bytes = (size_t)sysconf(_SC_PAGESIZE);
 	pool->period_microseconds = periodMicroseconds;
+	pool->chunks = NULL;
+	pool->chunk_index = NULL;
+	pool->index_mask = 0;
+	pool->next_free = NULL;
+	pool->free_head = MEMORY_POOL_MAKE_HEAD(MEMORY_POOL_NIL_SLOT, 0);
+	pool->available_chunks = 0;
 	pool->claimed = NULL;
-	pool->generated = NULL;
-	pool->available = NULL;
+	pool->empty_claims = 0;
 	pool->thread = NULL;
+	pool->refill_requested = 0;
 	pool->kill_thread = 0;
+	pool->pressure_callback = NULL;
+	pool->pressure_user_data = NULL;
+	pool->pressure_chunks = 0;
 
 	/* create chunk containers */
-	err = stack_create(maxReserve, &(pool->generated));
-	if (NO_ERROR != err) {
+	pool->chunks = (void**)malloc(sizeof(void*) * pool->max_chunks);
+	if (NULL == pool->chunks) {
 		memory_pool_release(pool);
-		return err;
+		return ERR_FAILED_ALLOC;
 	}
+	memset(pool->chunks, 0, sizeof(void*) * pool->max_chunks);
 
-	err = stack_create(maxBytes / chunkSize, &(pool->available));
-	if (NO_ERROR != err) {
+	pool->next_free = (uint32_t*)malloc(sizeof(uint32_t) * pool->max_chunks);
+	if (NULL == pool->next_free) {
 		memory_pool_release(pool);
-		return err;
+		return ERR_FAILED_ALLOC;
 	}
 
-	err = rb_tree_create(
-		&_rb_tree_compare,
-		&_rb_tree_alloc_copy_key,
-		&_rb_tree_release_key,
-		&_rb_tree_alloc_copy_data,
-		&_rb_tree_release_data,
-		&(pool->claimed));
-	if (NO_ERROR != err) {
+	claimedWords = pool->max_chunks / MEMORY_POOL_BITS_PER_WORD + 1;
+	pool->claimed = (unsigned int*)malloc(sizeof(unsigned int) * claimedWords);
+	if (NULL == pool->claimed) {
 		memory_pool_release(pool);
-		return err;
+		return ERR_FAILED_ALLOC;
+	}
+	memset((void*)pool->claimed, 0, sizeof(unsigned int) * claimedWords);
+
+	/* reserve the arena before any chunk is carved from it */
+	if (pool->flags & (MEMORY_POOL_ARENA | MEMORY_POOL_HUGE_PAGES)) {
+		err = _memory_pool_map_arena(pool);
+		if (NO_ERROR != err) {
+			memory_pool_release(pool);
+			return err;
+		}
+	}
+	else {
+		/* at most half full, so probes stay short */
+		pool->index_mask = 1;
+		while (pool->index_mask < (2 * pool->max_chunks)) {
+			pool->index_mask <<= 1;
+		}
+		pool->chunk_index = 
+			(uint32_t*)malloc(sizeof(uint32_t) * pool->index_mask);
+		if (NULL == pool->chunk_index) {
+			memory_pool_release(pool);
+			return ERR_FAILED_ALLOC;
+		}
+		memset(
+			(void*)pool->chunk_index, 
+			MEMORY_POOL_NO_INDEX, 
+			sizeof(uint32_t) * pool->index_mask);
+		pool->index_mask -= 1;
 	}
 
 	/* alloc minimum amount of data before creating thread */
 	while ((chunkCount < pool->min_reserve_chunks) && (err == NO_ERROR)) {
-		err = _memory_pool_generate_chunk(pool, pool->available);
+		err = _memory_pool_generate_chunk(pool);
 		chunkCount++;
 	}
 
@@ -131,7 +279,19 @@ status_t memory_pool_create(
 		memory_pool_release(pool);
 		return ERR_FAILED_THREAD_CREATE;
 	}
-	
+
+	pthreadErr = pthread_cond_init(&(pool->refill_cond), NULL);
+	if (pthreadErr) {
+		memory_pool_release(pool);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+
+	pthreadErr = pthread_mutex_init(&(pool->pressure_mutex), NULL);
+	if (pthreadErr) {
+		memory_pool_release(pool);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+
 	pthreadErr = pthread_attr_init(&pthreadAttr);
 	if (pthreadErr) {
 		memory_pool_release(pool);
@@ -169,9 +329,10 @@ status_t memory_pool_release(memory_pool_handle_t pool) {
 	if (NULL == pool) {
 		return NO_ERROR;
 	}
-	/* set kill thread flag */
+	/* set kill thread flag and wake the thread if it is waiting */
 	err = pthread_mutex_lock(&(pool->mutex));
 	pool->kill_thread = 1;
+	err = pthread_cond_broadcast(&(pool->refill_cond));
 	err = pthread_mutex_unlock(&(pool->mutex));
 
 	/* join thread */
@@ -180,13 +341,12 @@ status_t memory_pool_release(memory_pool_handle_t pool) {
 	}
 
 	/* release allocated data */
-	_release_stack_chunks(pool->generated);
-	_release_stack_chunks(pool->available);
-	_release_tree_chunks(pool->claimed);
+	_release_chunks(pool);
 
-	rb_tree_release(pool->claimed);
-	stack_release(pool->generated);
-	stack_release(pool->available);
+	free((void*)pool->claimed);
+	free((void*)pool->chunk_index);
+	free(pool->chunks);
+	free(pool->next_free);
 	free(pool);
 
 	return NO_ERROR;
@@ -194,141 +354,186 @@ status_t memory_pool_release(memory_pool_handle_t pool) {
 
 status_t memory_pool_claim(memory_pool_handle_t handle, void** data) {
 	status_t status = NO_ERROR;
-	int err = 0;
-	void* chunk = NULL;
-	rb_tree_node_handle_t node = NULL;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
 
 	if ((NULL == handle) || (NULL == data)) {
 		return ERR_NULL_POINTER;
 	}
 
-	err = pthread_mutex_lock(&(handle->mutex));
-	if (err) {
-		return ERR_MUTEX_ERROR;
-	}
-
-	status = stack_pop(handle->available, &chunk);
-
-	err = pthread_mutex_unlock(&(handle->mutex));
+	status = _memory_pool_pop_slot(handle, &slot);
 	if (NO_ERROR != status) {
+		__sync_fetch_and_add(&(handle->empty_claims), 1);
+		_memory_pool_request_refill(handle);
 		return status;
 	}
-	else if (err) {
-		return ERR_MUTEX_ERROR;
+	_memory_pool_request_refill(handle);
+	__sync_fetch_and_or(
+		&(handle->claimed[slot / MEMORY_POOL_BITS_PER_WORD]),
+		1u << (slot % MEMORY_POOL_BITS_PER_WORD));
+
+	*data = handle->chunks[slot];
+
+	return NO_ERROR;
+}
+
+status_t memory_pool_unclaim(memory_pool_handle_t handle, void* data) {
+	status_t status = NO_ERROR;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+
+	if ((NULL == handle) || (NULL == data)) {
+		return ERR_NULL_POINTER;
 	}
 
-	status = rb_tree_insert(handle->claimed, chunk, NULL, &node);
+	status = _memory_pool_release_slot(handle, data, &slot);
 	if (NO_ERROR != status) {
 		return status;
 	}
 
-	*data = chunk;
+	_memory_pool_push_slot(handle, slot);
 
 	return NO_ERROR;
 }
 
-status_t memory_pool_unclaim(memory_pool_handle_t handle, void* data) {
+status_t memory_pool_claim_batch(
+	memory_pool_handle_t handle, 
+	size_t count, 
+	void** data) 
+{
 	status_t status = NO_ERROR;
-	rb_tree_node_handle_t node = NULL;
-	int err = 0;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+	size_t i = 0;
 
 	if ((NULL == handle) || (NULL == data)) {
 		return ERR_NULL_POINTER;
 	}
+	if (0 == count) {
+		return NO_ERROR;
+	}
 
-	status = rb_tree_find(handle->claimed, data, &node);
+	/* all or nothing, a partial batch is never handed out */
+	status = _memory_pool_pop_slots(handle, count, &slot);
 	if (NO_ERROR != status) {
+		__sync_fetch_and_add(&(handle->empty_claims), 1);
+		_memory_pool_request_refill(handle);
 		return status;
 	}
-	if (NULL == node) {
-		return ERR_INVALID_ARGUMENT;
+	_memory_pool_request_refill(handle);
+
+	/* the popped run is still linked through next_free */
+	for (i = 0; i < count; i++) {
+		__sync_fetch_and_or(
+			&(handle->claimed[slot / MEMORY_POOL_BITS_PER_WORD]),
+			1u << (slot % MEMORY_POOL_BITS_PER_WORD));
+		data[i] = handle->chunks[slot];
+		slot = handle->next_free[slot];
 	}
 
-	err = pthread_mutex_lock(&(handle->mutex));
-	if (err) {
-		return ERR_MUTEX_ERROR;
+	return NO_ERROR;
+}
+
+status_t memory_pool_unclaim_batch(
+	memory_pool_handle_t handle, 
+	size_t count, 
+	void** data) 
+{
+	status_t status = NO_ERROR;
+	status_t result = NO_ERROR;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+	uint32_t first = MEMORY_POOL_NIL_SLOT;
+	uint32_t last = MEMORY_POOL_NIL_SLOT;
+	size_t released = 0;
+	size_t i = 0;
+
+	if ((NULL == handle) || (NULL == data)) {
+		return ERR_NULL_POINTER;
 	}
-	status = stack_push(handle->available, data);
-	err = pthread_mutex_unlock(&(handle->mutex));
-	if (NO_ERROR != status) {
-		return status;
+
+	/* link the released slots into a run, skipping (and reporting) any
+	 * pointer that does not belong to a claimed chunk */
+	for (i = 0; i < count; i++) {
+		if (NULL == data[i]) {
+			result = ERR_NULL_POINTER;
+			continue;
+		}
+		status = _memory_pool_release_slot(handle, data[i], &slot);
+		if (NO_ERROR != status) {
+			result = status;
+			continue;
+		}
+		if (MEMORY_POOL_NIL_SLOT == first) {
+			first = slot;
+		}
+		else {
+			handle->next_free[last] = slot;
+		}
+		last = slot;
+		released++;
 	}
 
-	status = rb_tree_remove(handle->claimed, node);
-	if (NO_ERROR != status) {
-		return status;
+	if (released > 0) {
+		_memory_pool_push_slots(handle, first, last, released);
 	}
 
-	return NO_ERROR;
+	return result;
 }
 
-int _rb_tree_compare(const void* key1, const void* key2) {
-	return memcmp(&key1, &key2, sizeof(void*));
-}
+status_t memory_pool_empty_claim_count(
+	memory_pool_handle_t handle, 
+	size_t* p_count) 
+{
+	if ((NULL == handle) || (NULL == p_count)) {
+		return ERR_NULL_POINTER;
+	}
 
-status_t _rb_tree_alloc_copy_key(void* in, void** copy) {
-	*copy = in;
-	return NO_ERROR;
-}
+	*p_count = handle->empty_claims;
 
-status_t _rb_tree_alloc_copy_data(void* in, void** copy) {
-	*copy = in;
 	return NO_ERROR;
 }
 
-status_t _rb_tree_release_key(void* key) {
-	return NO_ERROR;
-}
+status_t memory_pool_set_pressure_callback(
+	memory_pool_handle_t handle,
+	size_t pressureChunks,
+	memory_pool_pressure_cb_t callback,
+	void* userData)
+{
+	if (NULL == handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	/* waits for a callback that is already running to return */
+	pthread_mutex_lock(&(handle->pressure_mutex));
+	handle->pressure_chunks = pressureChunks;
+	handle->pressure_user_data = userData;
+	handle->pressure_callback = callback;
+	pthread_mutex_unlock(&(handle->pressure_mutex));
+
+	/* check straight away in case the pool is already under pressure */
+	_memory_pool_request_refill(handle);
 
-status_t _rb_tree_release_data(void* data) {
 	return NO_ERROR;
 }
 
 void* _memory_pool_thread(void* data) {
 	memory_pool_t* pool = (memory_pool_t*)data;
 	int doKill = 0;
-	int err = 0;
 	status_t status = NO_ERROR;
 	size_t chunkCount = 0;
 	size_t availableChunks = 0;
-	void* chunk = NULL;
 
 	if (NULL == pool) {
 		pthread_exit(NULL);
 	}
 
 	while (0 == doKill) {
-		/* update whether to kill thread or not */
-		err = pthread_mutex_lock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
-		}
-
-		doKill = pool->kill_thread;
-
-		err = pthread_mutex_unlock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
-		}
-
+		/* sleep until a claim runs low, the period passes or release */
+		doKill = _memory_pool_wait_for_refill(pool);
 		if (doKill) {
 			/* skip rest of loop and exit while loop */
 			continue;
 		}
 
 		/* get number of chunks available */
-		err = pthread_mutex_lock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
-		}
-		status = stack_count(pool->available, &availableChunks);
-		if (NO_ERROR != status) {
-			pthread_exit(NULL);
-		}
-		err = pthread_mutex_unlock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
-		}
+		availableChunks = pool->available_chunks;
 
 		/* determine if more chunks are needed */
 		if (pool->min_reserve_chunks > availableChunks) {
@@ -340,8 +545,9 @@ void* _memory_pool_thread(void* data) {
 				chunkCount--;
 			}
 
+			/* new chunks go straight onto the free list */
 			while ((chunkCount != 0) && (status == NO_ERROR)) {
-				status = _memory_pool_generate_chunk(pool, pool->generated);
+				status = _memory_pool_generate_chunk(pool);
 				chunkCount--;
 			}
 			if (NO_ERROR != status) {
@@ -349,113 +555,356 @@ void* _memory_pool_thread(void* data) {
 			}
 		}
 
-		/* if chunks exist in generated stack, place them in available stack */
-		status = stack_count(pool->generated, &chunkCount);
-		err = pthread_mutex_lock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
-		}
-		while ((NO_ERROR == status) && (chunkCount > 0)) {
-			status = stack_pop(pool->generated, &chunk);
-			if (NO_ERROR != status) {
-				continue;
-			}
-			status = stack_push(pool->available, chunk);
-			if (NO_ERROR != status) {
-				continue;
-			}
-			chunkCount--;
+		_memory_pool_check_pressure(pool);
+	}
+
+	pthread_exit(NULL);
+}
+
+status_t _memory_pool_generate_chunk(memory_pool_t* pool) {
+	char* newChunk = NULL;
+	size_t offset = 0;
+	size_t index = 0;
+	uint32_t slot = (uint32_t)pool->generated_chunks;
+
+	if (pool->generated_chunks >= pool->max_chunks) {
+		return ERR_FULL;
+	}
+
+	if (NULL != pool->arena) {
+		newChunk = pool->arena + (size_t)slot * pool->chunk_stride;
+
+		/* prefault every page the chunk covers, writing only inside it
+		 * since neighbouring chunks may already be claimed */
+		for (offset = 0; offset < pool->chunk_stride; offset += pool->page_bytes) {
+			((volatile char*)newChunk)[offset] = 0;
 		}
-		err = pthread_mutex_unlock(&(pool->mutex));
-		if (err) {
-			pthread_exit(NULL);
+		((volatile char*)newChunk)[pool->chunk_stride - 1] = 0;
+	}
+	else {
+		newChunk = (char*)malloc(pool->chunk_size);
+		if (NULL == newChunk) {
+			return ERR_FAILED_ALLOC;
 		}
-		if (NO_ERROR != status) {
-			pthread_exit(NULL);
+	}
+
+	/* only the generator touches generated_chunks once the pool exists */
+	pool->chunks[slot] = newChunk;
+	pool->generated_chunks += 1;
+
+	/* the table entry is visible before the index entry that points at it */
+	if (NULL != pool->chunk_index) {
+		__sync_synchronize();
+		index = _memory_pool_hash(pool, newChunk);
+		while (MEMORY_POOL_NO_INDEX != pool->chunk_index[index]) {
+			index = (index + 1) & pool->index_mask;
 		}
+		pool->chunk_index[index] = slot + 1;
+	}
+	_memory_pool_push_slot(pool, slot);
 
-		/* sleep */
-		err = usleep(pool->period_microseconds);
-		if (err) {
-			pthread_exit(NULL);
+	return NO_ERROR;
+}
+
+status_t _memory_pool_pop_slot(memory_pool_t* pool, uint32_t* p_slot) {
+	uint64_t head = 0;
+	uint64_t next = 0;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+
+	do {
+		head = pool->free_head;
+		slot = MEMORY_POOL_HEAD_SLOT(head);
+		if (MEMORY_POOL_NIL_SLOT == slot) {
+			return ERR_EMPTY;
 		}
+		next = MEMORY_POOL_MAKE_HEAD(
+			pool->next_free[slot],
+			MEMORY_POOL_HEAD_TAG(head) + 1);
+	} while (!__sync_bool_compare_and_swap(&(pool->free_head), head, next));
+
+	/* decrement after the pop so the count never drops below the list */
+	__sync_fetch_and_sub(&(pool->available_chunks), 1);
+	*p_slot = slot;
+	return NO_ERROR;
+}
+
+void _memory_pool_push_slot(memory_pool_t* pool, uint32_t slot) {
+	uint64_t head = 0;
+	uint64_t next = 0;
+
+	/* increment before the push so the count never drops below the list */
+	__sync_fetch_and_add(&(pool->available_chunks), 1);
+	do {
+		head = pool->free_head;
+		pool->next_free[slot] = MEMORY_POOL_HEAD_SLOT(head);
+		next = MEMORY_POOL_MAKE_HEAD(slot, MEMORY_POOL_HEAD_TAG(head) + 1);
+	} while (!__sync_bool_compare_and_swap(&(pool->free_head), head, next));
+}
+
+status_t _memory_pool_pop_slots(
+	memory_pool_t* pool, 
+	size_t count, 
+	uint32_t* p_first) 
+{
+	uint64_t head = 0;
+	uint64_t next = 0;
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+	size_t i = 0;
+
+	/* a quick refusal, the walk below is what decides */
+	if (pool->available_chunks < count) {
+		return ERR_EMPTY;
 	}
 
-	pthread_exit(NULL);
+	do {
+		head = pool->free_head;
+		slot = MEMORY_POOL_HEAD_SLOT(head);
+		for (i = 0; (i < count) && (MEMORY_POOL_NIL_SLOT != slot); i++) {
+			slot = pool->next_free[slot];
+		}
+		if (i < count) {
+			return ERR_EMPTY;
+		}
+		next = MEMORY_POOL_MAKE_HEAD(slot, MEMORY_POOL_HEAD_TAG(head) + 1);
+	} while (!__sync_bool_compare_and_swap(&(pool->free_head), head, next));
+
+	__sync_fetch_and_sub(&(pool->available_chunks), count);
+	*p_first = MEMORY_POOL_HEAD_SLOT(head);
+	return NO_ERROR;
 }
 
-status_t _memory_pool_generate_chunk(
+void _memory_pool_push_slots(
 	memory_pool_t* pool, 
-	stack_handle_t stack) {
-	status_t err = NO_ERROR;
-	void* newChunk = NULL;
+	uint32_t first, 
+	uint32_t last, 
+	size_t count) 
+{
+	uint64_t head = 0;
+	uint64_t next = 0;
+
+	__sync_fetch_and_add(&(pool->available_chunks), count);
+	do {
+		head = pool->free_head;
+		pool->next_free[last] = MEMORY_POOL_HEAD_SLOT(head);
+		next = MEMORY_POOL_MAKE_HEAD(first, MEMORY_POOL_HEAD_TAG(head) + 1);
+	} while (!__sync_bool_compare_and_swap(&(pool->free_head), head, next));
+}
 
-	newChunk = malloc(pool->chunk_size);
-	if (NULL == newChunk) {
-		return ERR_FAILED_ALLOC;
+status_t _memory_pool_release_slot(
+	memory_pool_t* pool, 
+	void* data, 
+	uint32_t* p_slot) 
+{
+	uint32_t slot = MEMORY_POOL_NIL_SLOT;
+	uint32_t entry = MEMORY_POOL_NO_INDEX;
+	unsigned int mask = 0;
+	unsigned int previous = 0;
+	size_t offset = 0;
+	size_t index = 0;
+
+	/* find the slot from the address alone, data is not read */
+	if (NULL != pool->arena) {
+		if (((char*)data < pool->arena) || 
+			((char*)data >= (pool->arena + pool->arena_bytes)))
+		{
+			return ERR_INVALID_ARGUMENT;
+		}
+		offset = (size_t)((char*)data - pool->arena);
+		if (0 != (offset % pool->chunk_stride)) {
+			return ERR_INVALID_ARGUMENT;
+		}
+		slot = (uint32_t)(offset / pool->chunk_stride);
+	}
+	else {
+		index = _memory_pool_hash(pool, data);
+		for (;;) {
+			entry = pool->chunk_index[index];
+			if (MEMORY_POOL_NO_INDEX == entry) {
+				return ERR_INVALID_ARGUMENT;
+			}
+			if (pool->chunks[entry - 1] == data) {
+				break;
+			}
+			index = (index + 1) & pool->index_mask;
+		}
+		slot = entry - 1;
+	}
+	if (slot >= pool->generated_chunks) {
+		return ERR_INVALID_ARGUMENT;
 	}
 
-	err = stack_push(stack, newChunk);
-	if (NO_ERROR != err) {
-		free(newChunk);
-		return err;
+	/* only one caller can clear the claimed bit */
+	mask = 1u << (slot % MEMORY_POOL_BITS_PER_WORD);
+	previous = __sync_fetch_and_and(
+		&(pool->claimed[slot / MEMORY_POOL_BITS_PER_WORD]),
+		~mask);
+	if (0 == (previous & mask)) {
+		return ERR_INVALID_ARGUMENT;
 	}
-	pool->generated_chunks += 1;
 
+	*p_slot = slot;
 	return NO_ERROR;
 }
 
-status_t _release_stack_chunks(stack_handle_t stack) {
-	status_t status = NO_ERROR;
-	size_t count = 0;
-	void* chunk = NULL;
+void _memory_pool_request_refill(memory_pool_t* pool) {
+	size_t availableChunks = pool->available_chunks;
+	size_t ungeneratedChunks = pool->max_chunks - pool->generated_chunks;
+	int needsChunks = 0;
+	int underPressure = 0;
+
+	/* nothing left to generate once the pool is at its limit */
+	needsChunks = 
+		(ungeneratedChunks > 0) &&
+		((availableChunks < pool->min_reserve_chunks) || (0 == availableChunks));
+	underPressure = 
+		(NULL != pool->pressure_callback) &&
+		((availableChunks + ungeneratedChunks) < pool->pressure_chunks);
+	if ((0 == needsChunks) && (0 == underPressure)) {
+		return;
+	}
 
-	if (NULL == stack) {
-		return ERR_NULL_POINTER;
+	/* only the claim that raises the flag pays for the signal */
+	if (!__sync_bool_compare_and_swap(&(pool->refill_requested), 0, 1)) {
+		return;
 	}
+	pthread_mutex_lock(&(pool->mutex));
+	pthread_cond_signal(&(pool->refill_cond));
+	pthread_mutex_unlock(&(pool->mutex));
+}
 
-	status = stack_count(stack, &count);
-	while ((status == NO_ERROR) && (count > 0)) {
-		status = stack_pop(stack, &chunk);
-		if (NO_ERROR != status) {
-			continue;
+int _memory_pool_wait_for_refill(memory_pool_t* pool) {
+	struct timeval now;
+	struct timespec deadline;
+	int doKill = 0;
+	int err = 0;
+
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + pool->period_microseconds / 1000000;
+	deadline.tv_nsec = 
+		(now.tv_usec + pool->period_microseconds % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	err = pthread_mutex_lock(&(pool->mutex));
+	if (err) {
+		return 1;
+	}
+	while ((0 == pool->kill_thread) && (0 == pool->refill_requested)) {
+		err = pthread_cond_timedwait(
+			&(pool->refill_cond), 
+			&(pool->mutex), 
+			&deadline);
+		if (err) {
+			/* timed out, check the reserve anyway */
+			break;
 		}
-		free(chunk);
-		status = stack_count(stack, &count);
 	}
-	return status;
+	/* cleared before the reserve is read, so a later claim signals again */
+	pool->refill_requested = 0;
+	doKill = pool->kill_thread;
+	pthread_mutex_unlock(&(pool->mutex));
+
+	return doKill;
 }
 
-status_t _release_tree_chunks(rb_tree_handle_t tree) {
-	status_t status = NO_ERROR;
-	rb_tree_node_handle_t last = NULL;
-	rb_tree_node_handle_t next = NULL;
-	void* chunk = NULL;
+void _memory_pool_check_pressure(memory_pool_t* pool) {
+	size_t headroom = 0;
+
+	pthread_mutex_lock(&(pool->pressure_mutex));
+	headroom = 
+		pool->available_chunks + (pool->max_chunks - pool->generated_chunks);
+	if ((NULL != pool->pressure_callback) && (headroom < pool->pressure_chunks)) {
+		pool->pressure_callback(
+			pool, 
+			pool->pressure_chunks - headroom, 
+			pool->pressure_user_data);
+	}
+	pthread_mutex_unlock(&(pool->pressure_mutex));
+}
 
-	if (NULL == tree) {
-		return ERR_NULL_POINTER;
+size_t _memory_pool_hash(memory_pool_t* pool, void* chunk) {
+	/* malloc aligns to at least 16 bytes, so the low bits carry nothing */
+	uint64_t key = (uint64_t)(uintptr_t)chunk >> 4;
+	key *= 0x9E3779B97F4A7C15ull;
+	return (size_t)(key >> 32) & pool->index_mask;
+}
+
+void _release_chunks(memory_pool_t* pool) {
+	size_t slot = 0;
+
+	if (NULL != pool->arena) {
+		munmap(pool->arena, pool->arena_bytes);
+		pool->arena = NULL;
+		return;
 	}
 
-	status = rb_tree_enumerate(
-		tree,
-		NULL,
-		NULL,
-		last,
-		&next);
-	while ((NO_ERROR == status) && (NULL != next)) {
-		last = next;
-		status = rb_tree_node_key(next, &chunk);
-		if (NO_ERROR != status) {
-			continue;
-		}
-		free(chunk);
-		status = rb_tree_enumerate(
-			tree,
+	if (NULL == pool->chunks) {
+		return;
+	}
+
+	/* every chunk owns a slot, whether it is claimed or not */
+	for (slot = 0; slot < pool->generated_chunks; slot++) {
+		free(pool->chunks[slot]);
+		pool->chunks[slot] = NULL;
+	}
+}
+
+
+status_t _memory_pool_map_arena(memory_pool_t* pool) {
+	void* arena = MAP_FAILED;
+	size_t alignBytes = pool->page_bytes;
+
+	pool->chunk_stride = 
+		pool->chunk_size + MEMORY_POOL_ARENA_ALIGN - 1;
+	pool->chunk_stride &= ~((size_t)MEMORY_POOL_ARENA_ALIGN - 1);
+	if (pool->flags & MEMORY_POOL_HUGE_PAGES) {
+		alignBytes = MEMORY_POOL_HUGE_PAGE_BYTES;
+	}
+
+	/* the whole arena has to fit in the address space */
+	if (pool->max_chunks > ((size_t)-1 - alignBytes) / pool->chunk_stride) {
+		return ERR_INVALID_ARGUMENT;
+	}
+	pool->arena_bytes = pool->max_chunks * pool->chunk_stride + alignBytes - 1;
+	pool->arena_bytes &= ~(alignBytes - 1);
+
+#ifdef MAP_HUGETLB
+	/* hugetlb pages must be reserved here, touching an unreserved one later
+	 * raises SIGBUS rather than failing the mmap */
+	if (pool->flags & MEMORY_POOL_HUGE_PAGES) {
+		arena = mmap(
 			NULL,
+			pool->arena_bytes,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+			-1,
+			0);
+		if (MAP_FAILED == arena) {
+			LOG_DEBUG("memory_pool: no hugetlb pages, using transparent huge pages");
+		}
+	}
+#endif
+
+	if (MAP_FAILED == arena) {
+		arena = mmap(
 			NULL,
-			last,
-			&next);
+			pool->arena_bytes,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			-1,
+			0);
+		if (MAP_FAILED == arena) {
+			return ERR_FAILED_ALLOC;
+		}
+#ifdef MADV_HUGEPAGE
+		if (pool->flags & MEMORY_POOL_HUGE_PAGES) {
+			madvise(arena, pool->arena_bytes, MADV_HUGEPAGE);
+		}
+#endif
 	}
-	return status;
-}
 
+	pool->arena = (char*)arena;
+	return NO_ERROR;
+}
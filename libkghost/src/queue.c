@@ -0,0 +1,120 @@
+#include "queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* keeps the counters each side writes on cache lines of their own */
+#define QUEUE_CACHE_LINE (64)
+
+typedef struct queue_s {
+	size_t capacity;
+	size_t element_size;
+	byte_t* data;
+	/* elements ever pushed, only written by the pushing thread */
+	char head_pad[QUEUE_CACHE_LINE];
+	volatile size_t head;
+	/* elements ever popped, only written by the popping thread */
+	char tail_pad[QUEUE_CACHE_LINE];
+	volatile size_t tail;
+	char end_pad[QUEUE_CACHE_LINE];
+} queue_t;
+
+status_t queue_create(
+	size_t capacity,
+	size_t element_size,
+	queue_handle_t* p_handle)
+{
+	queue_t* p_queue = NULL;
+
+	if ((capacity < 1) ||
+		(element_size < 1))
+	{
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	if (NULL == p_handle) {
+		return ERR_NULL_POINTER;
+	}
+
+	p_queue = (queue_t*)malloc(sizeof(queue_t));
+	if (NULL == p_queue) {
+		return ERR_FAILED_ALLOC;
+	}
+
+	memset(p_queue, 0, sizeof(queue_t));
+	p_queue->data = (byte_t*)malloc(capacity * element_size);
+	if (NULL == p_queue->data) {
+		queue_release(p_queue);
+		return ERR_FAILED_ALLOC;
+	}
+	p_queue->capacity = capacity;
+	p_queue->element_size = element_size;
+
+	*p_handle = p_queue;
+	return NO_ERROR;
+}
+
+void queue_release(queue_handle_t handle) {
+	if (NULL == handle) {
+		return;
+	}
+
+	free(handle->data);
+	free(handle);
+}
+
+status_t queue_push(queue_handle_t handle, const void* p_element) {
+	size_t head = 0;
+
+	if ((NULL == handle) || (NULL == p_element)) {
+		return ERR_NULL_POINTER;
+	}
+
+	head = handle->head;
+	if (head - handle->tail >= handle->capacity) {
+		return ERR_FULL;
+	}
+	memcpy(
+		&(handle->data[(head % handle->capacity) * handle->element_size]), 
+		p_element, 
+		handle->element_size);
+	/* the element has to be in place before the other side sees it */
+	__sync_synchronize();
+	handle->head = head + 1;
+	return NO_ERROR;
+}
+
+status_t queue_pop(queue_handle_t handle, void* p_element) {
+	size_t tail = 0;
+
+	if ((NULL == handle) || (NULL == p_element)) {
+		return ERR_NULL_POINTER;
+	}
+
+	tail = handle->tail;
+	if (tail == handle->head) {
+		return ERR_EMPTY;
+	}
+	__sync_synchronize();
+	memcpy(
+		p_element, 
+		&(handle->data[(tail % handle->capacity) * handle->element_size]), 
+		handle->element_size);
+	/* and read before its slot is handed back */
+	__sync_synchronize();
+	handle->tail = tail + 1;
+	return NO_ERROR;
+}
+
+status_t queue_count(queue_handle_t handle, size_t* p_count) {
+	size_t tail = 0;
+
+	if ((NULL == handle) || (NULL == p_count)) {
+		return ERR_NULL_POINTER;
+	}
+	/* tail first, the head can only have moved further since */
+	tail = handle->tail;
+	__sync_synchronize();
+	*p_count = handle->head - tail;
+	return NO_ERROR;
+}
@@ -0,0 +1,202 @@
+#include "worker_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+typedef struct worker_pool_entry_s {
+	worker_pool_job_t job;
+	void* data;
+	double submit_time;
+} worker_pool_entry_t;
+
+typedef struct worker_pool_s {
+	pthread_t* threads;
+	size_t thread_count;
+	/* jobs waiting, oldest at first */
+	worker_pool_entry_t* entries;
+	size_t max_jobs;
+	size_t first;
+	size_t count;
+	bool_t exit;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool_t mutex_created;
+	worker_pool_stats_t stats;
+} worker_pool_t;
+
+static void* _worker_pool_thread(void* data);
+static double _worker_pool_seconds(void);
+
+status_t worker_pool_create(
+	size_t thread_count,
+	size_t max_jobs,
+	worker_pool_handle_t* p_handle)
+{
+	worker_pool_t* p_pool = NULL;
+	int pthread_error = 0;
+
+	if (NULL == p_handle) {
+		return ERR_NULL_POINTER;
+	}
+	if ((thread_count < 1) || (max_jobs < 1)) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	p_pool = (worker_pool_t*)malloc(sizeof(worker_pool_t));
+	if (NULL == p_pool) {
+		return ERR_FAILED_ALLOC;
+	}
+	memset(p_pool, 0, sizeof(worker_pool_t));
+
+	p_pool->threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+	p_pool->entries = (worker_pool_entry_t*)malloc(
+		max_jobs * sizeof(worker_pool_entry_t));
+	if ((NULL == p_pool->threads) || (NULL == p_pool->entries)) {
+		worker_pool_release(p_pool);
+		return ERR_FAILED_ALLOC;
+	}
+	p_pool->max_jobs = max_jobs;
+
+	pthread_error = pthread_mutex_init(&(p_pool->mutex), NULL);
+	if (0 == pthread_error) {
+		pthread_error = pthread_cond_init(&(p_pool->cond), NULL);
+		if (0 != pthread_error) {
+			pthread_mutex_destroy(&(p_pool->mutex));
+		}
+	}
+	if (0 != pthread_error) {
+		worker_pool_release(p_pool);
+		return ERR_FAILED_THREAD_CREATE;
+	}
+	p_pool->mutex_created = TRUE;
+
+	/* threads that did start are joined by the release */
+	for (p_pool->thread_count = 0; 
+		p_pool->thread_count < thread_count; 
+		p_pool->thread_count++) 
+	{
+		pthread_error = pthread_create(
+			&(p_pool->threads[p_pool->thread_count]),
+			NULL,
+			&_worker_pool_thread,
+			p_pool);
+		if (0 != pthread_error) {
+			worker_pool_release(p_pool);
+			return ERR_FAILED_THREAD_CREATE;
+		}
+	}
+
+	*p_handle = p_pool;
+	return NO_ERROR;
+}
+
+void worker_pool_release(worker_pool_handle_t handle) {
+	size_t i = 0;
+
+	if (NULL == handle) {
+		return;
+	}
+
+	if (TRUE == handle->mutex_created) {
+		pthread_mutex_lock(&(handle->mutex));
+		handle->exit = TRUE;
+		pthread_cond_broadcast(&(handle->cond));
+		pthread_mutex_unlock(&(handle->mutex));
+
+		for (i = 0; i < handle->thread_count; i++) {
+			pthread_join(handle->threads[i], NULL);
+		}
+		pthread_cond_destroy(&(handle->cond));
+		pthread_mutex_destroy(&(handle->mutex));
+	}
+
+	free(handle->threads);
+	free(handle->entries);
+	free(handle);
+}
+
+status_t worker_pool_submit(
+	worker_pool_handle_t handle,
+	worker_pool_job_t job,
+	void* data)
+{
+	worker_pool_entry_t* p_entry = NULL;
+
+	if ((NULL == handle) || (NULL == job)) {
+		return ERR_NULL_POINTER;
+	}
+
+	pthread_mutex_lock(&(handle->mutex));
+	if (handle->count == handle->max_jobs) {
+		pthread_mutex_unlock(&(handle->mutex));
+		return ERR_FULL;
+	}
+	p_entry = &(handle->entries[(handle->first + handle->count) % handle->max_jobs]);
+	p_entry->job = job;
+	p_entry->data = data;
+	p_entry->submit_time = _worker_pool_seconds();
+	handle->count++;
+	handle->stats.submitted_jobs++;
+	pthread_cond_signal(&(handle->cond));
+	pthread_mutex_unlock(&(handle->mutex));
+	return NO_ERROR;
+}
+
+status_t worker_pool_stats(
+	worker_pool_handle_t handle,
+	worker_pool_stats_t* p_stats)
+{
+	if ((NULL == handle) || (NULL == p_stats)) {
+		return ERR_NULL_POINTER;
+	}
+
+	pthread_mutex_lock(&(handle->mutex));
+	*p_stats = handle->stats;
+	pthread_mutex_unlock(&(handle->mutex));
+	return NO_ERROR;
+}
+
+void* _worker_pool_thread(void* data) {
+	worker_pool_t* p_pool = (worker_pool_t*)data;
+	worker_pool_entry_t entry;
+	double start_time = 0.0;
+	double end_time = 0.0;
+
+	pthread_mutex_lock(&(p_pool->mutex));
+	for (;;) {
+		if (0 == p_pool->count) {
+			/* queued jobs still run after the pool is told to exit */
+			if (TRUE == p_pool->exit) {
+				break;
+			}
+			pthread_cond_wait(&(p_pool->cond), &(p_pool->mutex));
+			continue;
+		}
+		entry = p_pool->entries[p_pool->first];
+		p_pool->first = (p_pool->first + 1) % p_pool->max_jobs;
+		p_pool->count--;
+		pthread_mutex_unlock(&(p_pool->mutex));
+
+		start_time = _worker_pool_seconds();
+		entry.job(entry.data);
+		end_time = _worker_pool_seconds();
+
+		pthread_mutex_lock(&(p_pool->mutex));
+		p_pool->stats.completed_jobs++;
+		p_pool->stats.run_seconds += end_time - start_time;
+		p_pool->stats.latency_seconds += end_time - entry.submit_time;
+		if (end_time - entry.submit_time > p_pool->stats.max_latency_seconds) {
+			p_pool->stats.max_latency_seconds = end_time - entry.submit_time;
+		}
+	}
+	pthread_mutex_unlock(&(p_pool->mutex));
+	return NULL;
+}
+
+double _worker_pool_seconds(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include "memory_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/* Contention benchmark for memory_pool_claim / memory_pool_unclaim.
+ *
+ * Each thread repeatedly claims a small batch of chunks and hands them back,
+ * which mirrors the capture thread claiming frames while the playback thread
+ * drops them.  Throughput is reported for 1 to 8 threads, next to the same
+ * work with every call serialised on one mutex as the pool used to be.
+ *
+ * Disabled by default, run it with --gtest_also_run_disabled_tests. */
+
+static const size_t _bench_max_threads = 8;
+static const size_t _bench_iterations = 100000;
+static const size_t _bench_batch = 4;
+
+typedef struct bench_thread_data_s {
+	memory_pool_handle_t pool;
+	/* held around every call when not NULL */
+	pthread_mutex_t* p_mutex;
+	size_t iterations;
+	size_t failures;
+} bench_thread_data_t;
+
+static void* _bench_thread(void* data) {
+	bench_thread_data_t* p_data = (bench_thread_data_t*)data;
+	void* chunks[_bench_batch];
+	size_t i = 0;
+	size_t j = 0;
+
+	for (i = 0; i < p_data->iterations; i++) {
+		for (j = 0; j < _bench_batch; j++) {
+			if (NULL != p_data->p_mutex) {
+				pthread_mutex_lock(p_data->p_mutex);
+			}
+			if (NO_ERROR != memory_pool_claim(p_data->pool, &chunks[j])) {
+				chunks[j] = NULL;
+				p_data->failures++;
+			}
+			if (NULL != p_data->p_mutex) {
+				pthread_mutex_unlock(p_data->p_mutex);
+			}
+		}
+		for (j = 0; j < _bench_batch; j++) {
+			if (NULL == chunks[j]) {
+				continue;
+			}
+			if (NULL != p_data->p_mutex) {
+				pthread_mutex_lock(p_data->p_mutex);
+			}
+			memory_pool_unclaim(p_data->pool, chunks[j]);
+			if (NULL != p_data->p_mutex) {
+				pthread_mutex_unlock(p_data->p_mutex);
+			}
+		}
+	}
+	return NULL;
+}
+
+static double _bench_seconds(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
+
+/* claim/unclaim pairs per second over thread_count threads */
+static double _bench_run(
+	memory_pool_handle_t pool,
+	pthread_mutex_t* p_mutex,
+	size_t thread_count)
+{
+	pthread_t threads[_bench_max_threads];
+	bench_thread_data_t data[_bench_max_threads];
+	size_t i = 0;
+	double start = 0.0;
+
+	start = _bench_seconds();
+	for (i = 0; i < thread_count; i++) {
+		data[i].pool = pool;
+		data[i].p_mutex = p_mutex;
+		data[i].iterations = _bench_iterations / thread_count;
+		data[i].failures = 0;
+		EXPECT_EQ(0, pthread_create(&threads[i], NULL, &_bench_thread, &data[i]));
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(threads[i], NULL);
+		EXPECT_EQ((size_t)0, data[i].failures);
+	}
+	return (double)(_bench_iterations * _bench_batch) / (_bench_seconds() - start);
+}
+
+TEST(MemoryPoolBench, DISABLED_Contention) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	pthread_mutex_t mutex;
+	size_t thread_count = 0;
+	double lock_free = 0.0;
+	double locked = 0.0;
+
+	/* every thread can hold a full batch, so claims never run dry */
+	err = memory_pool_create(
+		64,
+		_bench_max_threads * _bench_batch,
+		_bench_max_threads * _bench_batch,
+		64 * _bench_max_threads * _bench_batch,
+		1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+	ASSERT_TRUE(NULL != pool);
+
+	ASSERT_EQ(0, pthread_mutex_init(&mutex, NULL));
+	for (thread_count = 1; thread_count <= _bench_max_threads; thread_count++) {
+		lock_free = _bench_run(pool, NULL, thread_count);
+		locked = _bench_run(pool, &mutex, thread_count);
+		printf(
+			"[ bench    ] %zu thread(s): %.0f pairs/s lock-free, %.0f pairs/s locked (%.2fx)\n",
+			thread_count,
+			lock_free,
+			locked,
+			lock_free / locked);
+	}
+	pthread_mutex_destroy(&mutex);
+
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
@@ -0,0 +1,449 @@
+#include "gtest/gtest.h"
+#include "common.h"
+#include "director.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const size_t _width = 32;
+static const size_t _height = 24;
+static const float _cutoff = 0.25f;
+static const double _frame_seconds = 1.0 / 30.0;
+
+/* depth nearer and further than _cutoff */
+static const unsigned short _near = 1000;
+static const unsigned short _far = 40000;
+
+/* every depth frame captured, by index */
+static unsigned short _depths[64][_width * _height];
+
+typedef enum {
+	_background,
+	_still,
+	_moving
+} _pattern_t;
+
+static director_handle_t _create_director(void) {
+	director_handle_t director = NULL;
+	status_t status = director_create(
+		1,
+		8 * 1024 * 1024,
+		_width * _height * 3,
+		_width * _height * 2,
+		2,
+		1.0f,
+		&director);
+	EXPECT_EQ(NO_ERROR, status);
+	return director;
+}
+
+/* captures frame index with grey video of value tag, which the video codec
+ * keeps exactly, and waits for the analysis thread to score it.  nothing is
+ * present in _background, everything in _still, and about half the pixels
+ * in _moving, different ones every frame. */
+static void _capture(
+	director_handle_t director,
+	size_t index,
+	_pattern_t pattern,
+	unsigned char tag)
+{
+	static unsigned char video[_width * _height * 3];
+	unsigned short* depth = _depths[index];
+	director_analysis_stats_t stats;
+	size_t i = 0;
+
+	memset(video, tag, sizeof(video));
+	for (i = 0; i < _width * _height; i++) {
+		if (_moving == pattern) {
+			depth[i] = (rand() & 1) ? _near : _far;
+		}
+		else {
+			depth[i] = (_still == pattern) ? _near : _far;
+		}
+	}
+	ASSERT_EQ(NO_ERROR, director_capture_video(director, video, index * _frame_seconds));
+	ASSERT_EQ(NO_ERROR, director_capture_depth(director, depth, _cutoff, index * _frame_seconds));
+
+	for (i = 0; i < 2000; i++) {
+		ASSERT_EQ(NO_ERROR, director_analysis_stats(director, &stats));
+		if (stats.analysed_frames == stats.queued_frames) {
+			break;
+		}
+		usleep(1000);
+	}
+	ASSERT_EQ((size_t)0, stats.dropped_frames);
+}
+
+/* waits until count finished loops have been through their job */
+static void _wait_for_loops(director_handle_t director, size_t count) {
+	worker_pool_stats_t stats;
+	size_t i = 0;
+
+	for (i = 0; i < 2000; i++) {
+		ASSERT_EQ(NO_ERROR, director_job_stats(director, &stats));
+		if (stats.completed_jobs >= count) {
+			return;
+		}
+		usleep(1000);
+	}
+	FAIL() << "loop jobs did not finish";
+}
+
+/* tag of the frame the first layer shows at play_time, -1 if none.  its
+ * depth is copied to depth if that is not NULL. */
+static int _shown_frame(
+	director_handle_t director, 
+	timestamp_t play_time, 
+	unsigned short* depth)
+{
+	director_frame_layers_t layers;
+	int tag = -1;
+
+	EXPECT_EQ(NO_ERROR, director_playback_layers(director, play_time, &layers));
+	if (layers.layer_count > 0) {
+		tag = ((unsigned char*)layers.video_layers[0])[0];
+		if (NULL != depth) {
+			memcpy(depth, layers.depth_layers[0], _width * _height * 2);
+		}
+	}
+	EXPECT_EQ(NO_ERROR, director_release_layers(director, &layers));
+	return tag;
+}
+
+static int _shown_tag(director_handle_t director, timestamp_t play_time) {
+	return _shown_frame(director, play_time, NULL);
+}
+
+static unsigned short _median(unsigned short a, unsigned short b, unsigned short c) {
+	if (a > b) {
+		return (b > c) ? b : ((a < c) ? a : c);
+	}
+	return (a > c) ? a : ((b < c) ? b : c);
+}
+
+/* records a loop tagged with the capture index of every frame: count
+ * frames of still depth, moving frames up to index end, then background
+ * until the loop ends.  returns the next free index. */
+static size_t _record_loop(
+	director_handle_t director,
+	size_t index,
+	size_t still_count,
+	size_t end)
+{
+	size_t i = 0;
+
+	/* recording starts with a frame that moves against this */
+	_capture(director, index, _background, (unsigned char)index);
+	index++;
+	for (i = 0; i < still_count; i++, index++) {
+		_capture(director, index, _still, (unsigned char)index);
+	}
+	for (; index < end; index++) {
+		_capture(director, index, _moving, (unsigned char)index);
+	}
+	/* six frames without presence run out the patience of five */
+	for (i = 0; i < 6; i++, index++) {
+		_capture(director, index, _background, (unsigned char)index);
+	}
+	return index;
+}
+
+TEST(TestDirector, TrimKeepsMovingFrames) {
+	director_handle_t director = _create_director();
+	timestamp_t start = 100.0;
+	size_t i = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(1);
+
+	/* frames 1 to 20 move, the five background frames recording ends
+	 * with are trimmed off the tail */
+	_record_loop(director, 0, 0, 21);
+	_wait_for_loops(director, 1);
+
+	/* the loop starts playing at start, frames are looked at halfway */
+	ASSERT_EQ(1, _shown_tag(director, start));
+	for (i = 0; i < 20; i++) {
+		ASSERT_EQ((int)(i + 1), _shown_tag(director, start + (i + 0.5) * _frame_seconds));
+	}
+	/* and starts over */
+	ASSERT_EQ(1, _shown_tag(director, start + 20.5 * _frame_seconds));
+
+	director_release(director);
+}
+
+TEST(TestDirector, TrimStillHead) {
+	director_handle_t director = _create_director();
+	timestamp_t start = 100.0;
+	size_t i = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(2);
+
+	/* recording starts on frame 1 as it moves against the background, but
+	 * frames 2 and 3 do not move and frame 1 takes frame 2's motion, so
+	 * the loop starts at frame 4 */
+	_record_loop(director, 0, 3, 24);
+	_wait_for_loops(director, 1);
+
+	ASSERT_EQ(4, _shown_tag(director, start));
+	for (i = 0; i < 20; i++) {
+		ASSERT_EQ((int)(i + 4), _shown_tag(director, start + (i + 0.5) * _frame_seconds));
+	}
+	ASSERT_EQ(4, _shown_tag(director, start + 20.5 * _frame_seconds));
+
+	director_release(director);
+}
+
+TEST(TestDirector, TrimTooShort) {
+	director_handle_t director = _create_director();
+	size_t index = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(3);
+
+	/* nine moving frames are left once trimmed, one short of a loop */
+	index = _record_loop(director, 0, 2, 12);
+	_wait_for_loops(director, 1);
+	ASSERT_EQ(-1, _shown_tag(director, 100.0));
+
+	/* a loop that is long enough still plays after one that was dropped */
+	_record_loop(director, index, 0, index + 21);
+	_wait_for_loops(director, 2);
+	ASSERT_EQ((int)(index + 1), _shown_tag(director, 100.0));
+
+	director_release(director);
+}
+
+TEST(TestDirector, DepthFilter) {
+	director_handle_t director = _create_director();
+	unsigned short depth[_width * _height];
+	timestamp_t start = 100.0;
+	size_t index = 0;
+	size_t changed = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	ASSERT_TRUE(NULL != director);
+	ASSERT_EQ(NO_ERROR, director_set_depth_filter(director, TRUE));
+	srand(4);
+
+	/* the loop is frames 1 to 20 */
+	_record_loop(director, 0, 0, 21);
+	_wait_for_loops(director, 1);
+
+	ASSERT_EQ(1, _shown_tag(director, start));
+	for (i = 0; i < 20; i++) {
+		index = i + 1;
+		ASSERT_EQ((int)index, _shown_frame(director, start + (i + 0.5) * _frame_seconds, depth));
+		for (j = 0; j < _width * _height; j++) {
+			if ((1 == index) || (20 == index)) {
+				/* the ends have one neighbour and are kept */
+				ASSERT_EQ(_depths[index][j], depth[j]);
+			}
+			else {
+				/* from the frames as captured, not as already filtered */
+				ASSERT_EQ(
+					_median(_depths[index - 1][j], _depths[index][j], _depths[index + 1][j]), 
+					depth[j]);
+			}
+			changed += (_depths[index][j] != depth[j]) ? 1 : 0;
+		}
+	}
+	ASSERT_LT((size_t)0, changed);
+
+	director_release(director);
+}
+
+TEST(TestDirector, PlaybackRate) {
+	director_handle_t director = _create_director();
+	timestamp_t start = 100.0;
+	size_t i = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(5);
+
+	/* the loop is frames 1 to 20, recorded at 30 a second */
+	_record_loop(director, 0, 0, 21);
+	_wait_for_loops(director, 1);
+
+	/* asked for twice as often, every frame is held for two */
+	ASSERT_EQ(1, _shown_tag(director, start));
+	for (i = 0; i < 40; i++) {
+		ASSERT_EQ((int)(1 + i / 2), _shown_tag(director, start + (i + 0.5) / 60.0));
+	}
+
+	/* asked for half as often, every other frame is skipped */
+	start += 1.0;
+	ASSERT_EQ(1, _shown_tag(director, start));
+	for (i = 0; i < 10; i++) {
+		ASSERT_EQ((int)(1 + 2 * i), _shown_tag(director, start + (2 * i + 0.5) * _frame_seconds));
+	}
+
+	/* the last frame is held as long as an average one, then the loop
+	 * starts over */
+	start += 1.0;
+	ASSERT_EQ(1, _shown_tag(director, start));
+	ASSERT_EQ(20, _shown_tag(director, start + 19.9 * _frame_seconds));
+	ASSERT_EQ(1, _shown_tag(director, start + 20.1 * _frame_seconds));
+
+	director_release(director);
+}
+
+TEST(TestDirector, PlaybackFollowsTimestamps) {
+	director_handle_t director = _create_director();
+	timestamp_t start = 100.0;
+	size_t index = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(6);
+
+	/* frame 10 is never captured, so the loop has a gap in time */
+	_capture(director, 0, _background, 0);
+	for (index = 1; index < 22; index++) {
+		if (10 != index) {
+			_capture(director, index, _moving, (unsigned char)index);
+		}
+	}
+	for (; index < 28; index++) {
+		_capture(director, index, _background, (unsigned char)index);
+	}
+	_wait_for_loops(director, 1);
+
+	ASSERT_EQ(1, _shown_tag(director, start));
+	ASSERT_EQ(9, _shown_tag(director, start + 8.5 * _frame_seconds));
+	/* the frame before the gap is held through it */
+	ASSERT_EQ(9, _shown_tag(director, start + 9.5 * _frame_seconds));
+	ASSERT_EQ(11, _shown_tag(director, start + 10.5 * _frame_seconds));
+	/* a pass that comes late skips to the frame due */
+	ASSERT_EQ(17, _shown_tag(director, start + 16.5 * _frame_seconds));
+	ASSERT_EQ(21, _shown_tag(director, start + 20.5 * _frame_seconds));
+
+	director_release(director);
+}
+
+TEST(TestDirector, EvictionRanks) {
+	director_loop_stats_t low;
+	director_loop_stats_t high;
+
+	memset(&low, 0, sizeof(low));
+	memset(&high, 0, sizeof(high));
+
+	/* lower ranks are evicted first */
+	low.age_seconds = 60.0;
+	high.age_seconds = 5.0;
+	EXPECT_LT(director_rank_oldest(&low), director_rank_oldest(&high));
+
+	low.idle_seconds = 30.0;
+	high.idle_seconds = 1.0;
+	EXPECT_LT(director_rank_lru(&low), director_rank_lru(&high));
+	/* the oldest is not the same as the least recently played */
+	low.age_seconds = 5.0;
+	high.age_seconds = 60.0;
+	EXPECT_LT(director_rank_lru(&low), director_rank_lru(&high));
+
+	/* fainter loops go first, and so do loops played more often */
+	low.presence = 0.1;
+	high.presence = 0.5;
+	EXPECT_LT(director_rank_score(&low), director_rank_score(&high));
+	low.presence = 0.5;
+	low.play_count = 3;
+	high.play_count = 0;
+	EXPECT_LT(director_rank_score(&low), director_rank_score(&high));
+}
+
+/* starts a new pass well after any loop has ended and returns the tag of
+ * the first frame of the loop chosen */
+static int _next_loop_tag(director_handle_t director, timestamp_t* p_play_time) {
+	*p_play_time += 1.0;
+	return _shown_tag(director, *p_play_time);
+}
+
+TEST(TestDirector, BudgetKeepsShownAndPublished) {
+	director_handle_t director = _create_director();
+	timestamp_t start = 100.0;
+	timestamp_t play_time = 0.0;
+	size_t index = 0;
+	size_t second = 0;
+	int tag = -1;
+	size_t i = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(7);
+
+	/* the first loop is frames 1 to 20 and goes on screen */
+	index = _record_loop(director, 0, 0, 21);
+	_wait_for_loops(director, 1);
+	ASSERT_EQ(1, _shown_tag(director, start));
+
+	/* no loop fits a budget of a byte, but the one shown stays */
+	ASSERT_EQ(NO_ERROR, director_set_eviction(director, &director_rank_oldest, 1));
+	ASSERT_EQ(2, _shown_tag(director, start + 1.5 * _frame_seconds));
+
+	/* a loop published over budget is not evicted to make room for
+	 * itself, and does not push out the loop on screen either */
+	second = index + 1;
+	_record_loop(director, index, 0, index + 21);
+	_wait_for_loops(director, 2);
+	for (i = 2; i < 20; i++) {
+		ASSERT_EQ((int)(i + 1), _shown_tag(director, start + (i + 0.5) * _frame_seconds));
+	}
+
+	/* both can be chosen once the first has ended */
+	play_time = start;
+	for (i = 0; i < 64; i++) {
+		tag = _next_loop_tag(director, &play_time);
+		ASSERT_TRUE((1 == tag) || ((int)second == tag));
+		if ((int)second == tag) {
+			break;
+		}
+	}
+	ASSERT_EQ((int)second, tag);
+
+	/* the first loop is off screen now, and goes as soon as the budget is
+	 * looked at again */
+	ASSERT_EQ(NO_ERROR, director_set_eviction(director, &director_rank_oldest, 1));
+	for (i = 0; i < 16; i++) {
+		ASSERT_EQ((int)second, _next_loop_tag(director, &play_time));
+	}
+
+	director_release(director);
+}
+
+TEST(TestDirector, LiveLayer) {
+	director_handle_t director = _create_director();
+	director_frame_layers_t layers;
+	director_frame_layers_t held;
+	size_t i = 0;
+
+	ASSERT_TRUE(NULL != director);
+	srand(7);
+
+	layers.layer_count = 0;
+	EXPECT_EQ(ERR_EMPTY, director_live_layer(director, &layers));
+	EXPECT_EQ((size_t)0, layers.layer_count);
+
+	/* the live frame is added after whatever playback put in */
+	_capture(director, 0, _background, 7);
+	ASSERT_EQ(NO_ERROR, director_playback_layers(director, 0.0, &held));
+	ASSERT_EQ(NO_ERROR, director_live_layer(director, &held));
+	ASSERT_EQ((size_t)1, held.layer_count);
+	EXPECT_EQ(7, ((unsigned char*)held.video_layers[0])[0]);
+	EXPECT_EQ(_far, ((unsigned short*)held.depth_layers[0])[0]);
+	EXPECT_EQ(_cutoff, held.depth_cutoffs[0]);
+
+	/* newer frames replace it, and analysis drops the frames that are not
+	 * part of a loop, but the layer still being displayed keeps its data */
+	for (i = 1; i < 20; i++) {
+		_capture(director, i, _background, (unsigned char)(i + 7));
+	}
+	layers.layer_count = 0;
+	ASSERT_EQ(NO_ERROR, director_live_layer(director, &layers));
+	EXPECT_EQ(26, ((unsigned char*)layers.video_layers[0])[0]);
+	EXPECT_EQ(7, ((unsigned char*)held.video_layers[0])[0]);
+
+	EXPECT_EQ(NO_ERROR, director_release_layers(director, &held));
+	EXPECT_EQ(NO_ERROR, director_release_layers(director, &layers));
+	director_release(director);
+}
@@ -0,0 +1,203 @@
+#include "gtest/gtest.h"
+#include "frame_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const size_t _width = 640;
+static const size_t _height = 480;
+static const size_t _pixel_count = _width * _height;
+
+static double _seconds(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
+
+/* something like a kinect frame: a wall, a person in front of it, no depth
+ * readings along the left edge and a little sensor noise */
+static void _fill_frames(unsigned short* depth, unsigned char* rgb) {
+	size_t x = 0;
+	size_t y = 0;
+	size_t i = 0;
+	bool person = false;
+
+	srand(1);
+	for (y = 0; y < _height; y++) {
+		for (x = 0; x < _width; x++) {
+			i = y * _width + x;
+			person = (x > 250) && (x < 390) && (y > 80);
+			if (x < 40) {
+				depth[i] = 0;
+			}
+			else if (person) {
+				depth[i] = (unsigned short)(1500 + (x - 320) * (x - 320) / 8 + rand() % 3);
+			}
+			else {
+				depth[i] = (unsigned short)(3000 + y / 4);
+			}
+			rgb[i * 3 + 0] = person ? 200 : (unsigned char)(x / 3);
+			rgb[i * 3 + 1] = person ? 150 : (unsigned char)(y / 2);
+			rgb[i * 3 + 2] = person ? 120 : 90;
+		}
+	}
+}
+
+TEST(FrameCodec, Depth) {
+	status_t status = NO_ERROR;
+	unsigned short* depth = (unsigned short*)malloc(_pixel_count * 2);
+	unsigned short* decoded = (unsigned short*)malloc(_pixel_count * 2);
+	unsigned char* rgb = (unsigned char*)malloc(_pixel_count * 3);
+	unsigned char* data = (unsigned char*)malloc(frame_codec_depth_bound(_pixel_count));
+	size_t size = 0;
+	double start = 0.0;
+	int i = 0;
+
+	_fill_frames(depth, rgb);
+
+	status = frame_codec_encode_depth(depth, _pixel_count, data, &size);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_LT(size, _pixel_count * 2);
+
+	start = _seconds();
+	for (i = 0; i < 10; i++) {
+		status = frame_codec_decode_depth(data, size, decoded, _pixel_count);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	printf(
+		"[ bench    ] depth %.1f:1, %.2f ms decode per frame\n",
+		(double)(_pixel_count * 2) / (double)size,
+		(_seconds() - start) * 100.0);
+
+	/* lossless */
+	ASSERT_EQ(0, memcmp(depth, decoded, _pixel_count * 2));
+
+	/* corrupt data is rejected rather than overrunning */
+	status = frame_codec_decode_depth(data, size - 1, decoded, _pixel_count);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+	status = frame_codec_decode_depth(data, size, decoded, _pixel_count - 1);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+
+	free(depth);
+	free(decoded);
+	free(rgb);
+	free(data);
+}
+
+TEST(FrameCodec, Video) {
+	status_t status = NO_ERROR;
+	unsigned short* depth = (unsigned short*)malloc(_pixel_count * 2);
+	unsigned char* rgb = (unsigned char*)malloc(_pixel_count * 3);
+	unsigned char* decoded = (unsigned char*)malloc(_pixel_count * 3);
+	size_t size = frame_codec_video_size(_pixel_count);
+	unsigned char* data = (unsigned char*)malloc(size);
+	double start = 0.0;
+	size_t i = 0;
+	size_t total = 0;
+
+	_fill_frames(depth, rgb);
+
+	status = frame_codec_encode_video(rgb, _pixel_count, data);
+	ASSERT_EQ(NO_ERROR, status);
+
+	start = _seconds();
+	for (i = 0; i < 10; i++) {
+		status = frame_codec_decode_video(data, _pixel_count, decoded);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	printf(
+		"[ bench    ] video %.1f:1, %.2f ms decode per frame\n",
+		(double)(_pixel_count * 3) / (double)size,
+		(_seconds() - start) * 100.0);
+
+	/* only chroma detail is lost, which shows at colour edges */
+	for (i = 0; i < _pixel_count * 3; i++) {
+		total += (size_t)abs((int)rgb[i] - (int)decoded[i]);
+	}
+	ASSERT_LE(total / (_pixel_count * 3), (size_t)2);
+
+	/* a partial chroma group at the end */
+	status = frame_codec_encode_video(rgb, 5, data);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_codec_decode_video(data, 5, decoded);
+	ASSERT_EQ(NO_ERROR, status);
+	for (i = 0; i < 15; i++) {
+		ASSERT_LE(abs((int)rgb[i] - (int)decoded[i]), 8);
+	}
+
+	free(depth);
+	free(rgb);
+	free(decoded);
+	free(data);
+}
+
+TEST(FrameCodec, Frame) {
+	status_t status = NO_ERROR;
+	size_t bound = frame_codec_frame_bound(_pixel_count, _pixel_count);
+	unsigned short* depth = (unsigned short*)malloc(_pixel_count * 2);
+	unsigned short* decoded_depth = (unsigned short*)malloc(_pixel_count * 2);
+	unsigned char* rgb = (unsigned char*)malloc(_pixel_count * 3);
+	unsigned char* decoded = (unsigned char*)malloc(_pixel_count * 3);
+	unsigned char* mask = (unsigned char*)malloc(_pixel_count);
+	unsigned char* data = (unsigned char*)malloc(bound);
+	size_t dense_size = 0;
+	size_t size = 0;
+	size_t kept = 0;
+	long error = 0;
+	size_t i = 0;
+
+	_fill_frames(depth, rgb);
+
+	status = frame_codec_encode_frame(rgb, _pixel_count, depth, _pixel_count, NULL, data, &dense_size);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_LE(dense_size, bound);
+	status = frame_codec_decode_frame(data, dense_size, decoded, _pixel_count, decoded_depth, _pixel_count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, memcmp(depth, decoded_depth, _pixel_count * 2));
+
+	/* only the person, with their depth alone left in */
+	for (i = 0; i < _pixel_count; i++) {
+		mask[i] = (depth[i] > 0) && (depth[i] < 2500);
+		if (!mask[i]) {
+			depth[i] = 0;
+		}
+		kept += mask[i];
+	}
+	status = frame_codec_encode_frame(rgb, _pixel_count, depth, _pixel_count, mask, data, &size);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_LT(size, dense_size / 2);
+	printf(
+		"[ bench    ] foreground %.1f:1 against %.1f:1 for the whole frame\n",
+		(double)(_pixel_count * 5) / (double)size,
+		(double)(_pixel_count * 5) / (double)dense_size);
+
+	status = frame_codec_check_frame(data, size, _pixel_count);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_codec_check_frame(data, size - 1, _pixel_count);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+	status = frame_codec_decode_frame(data, size - 1, decoded, _pixel_count, decoded_depth, _pixel_count);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+
+	memset(decoded, 0xff, _pixel_count * 3);
+	status = frame_codec_decode_frame(data, size, decoded, _pixel_count, decoded_depth, _pixel_count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, memcmp(depth, decoded_depth, _pixel_count * 2));
+	for (i = 0; i < _pixel_count; i++) {
+		if (!mask[i]) {
+			ASSERT_EQ(0, decoded[i * 3] | decoded[i * 3 + 1] | decoded[i * 3 + 2]);
+		}
+		else {
+			error += labs((long)decoded[i * 3] - (long)rgb[i * 3]);
+		}
+	}
+	ASSERT_LE(error / (long)kept, 2);
+
+	free(depth);
+	free(decoded_depth);
+	free(rgb);
+	free(decoded);
+	free(mask);
+	free(data);
+}
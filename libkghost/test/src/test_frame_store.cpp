@@ -2,6 +2,9 @@
 #include "frame_store.h"
 #include "libfreenect/libfreenect.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+
 
 static const size_t _width = 4;
 static const size_t _height = 4;
@@ -51,6 +54,7 @@ TEST(TestFrameStore, CreateRelease) {
 		_depth_size,
 		_meta_size,
 		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
 		&frame_store);
 
 	ASSERT_EQ(NO_ERROR, status);
@@ -76,6 +80,7 @@ TEST(TestFrameStore, RemoveFrame) {
 		_depth_size,
 		_meta_size,
 		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
 		&frame_store);
 
 	ASSERT_EQ(NO_ERROR, status);
@@ -274,6 +279,7 @@ TEST(TestFrameStore, Capture) {
 		_depth_size,
 		_meta_size,
 		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
 		&frame_store);
 
 	ASSERT_EQ(NO_ERROR, status);
@@ -497,3 +503,1121 @@ TEST(TestFrameStore, Capture) {
 	frame_store_release(frame_store);
 }
 
+
+TEST(TestFrameStore, RemoveFrames) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_id_t frame_ids[100];
+	frame_id_t frame_id = invalid_frame_id;
+	timestamp_t timestamp = 0;
+	void* data = NULL;
+	double meta = 1.0;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* more frames than fit in one unclaim batch */
+	for (i = 0; i < 100; i++) {
+		timestamp = (timestamp_t)i;
+		status = frame_store_capture_video(frame_store, (void*)_video_frame, timestamp, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, (void*)_depth_frame, timestamp, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, (void*)&meta, timestamp, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_NE(frame_id, invalid_frame_id);
+		frame_ids[i] = frame_id;
+
+		/* let the memory pool keep up */
+		usleep(1000);
+	}
+
+	/* remove all but the last frame */
+	status = frame_store_remove_frames(frame_store, 99, frame_ids);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)1, count);
+
+	status = frame_store_video_frame(frame_store, frame_ids[99], &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)99, timestamp);
+
+	/* removed twice or out of range ids are reported, valid ones removed */
+	frame_ids[0] = invalid_frame_id;
+	status = frame_store_remove_frames(frame_store, 100, frame_ids);
+	ASSERT_NE(NO_ERROR, status);
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, count);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, AcquireRelease) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_handle_t second = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	timestamp_t timestamp = 0;
+	void* video = NULL;
+	void* depth = NULL;
+	void* meta_data = NULL;
+	double meta = 1.0;
+	size_t count = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 7, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 7, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 7, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(frame_id, invalid_frame_id);
+
+	/* pin the frame twice, then remove it from the store */
+	status = frame_store_acquire_frame(frame_store, frame_id, &frame);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_acquire_frame(frame_store, frame_id, &second);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(frame == second);
+
+	status = frame_store_remove_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, count);
+
+	/* removed frames cannot be pinned again */
+	status = frame_store_acquire_frame(frame_store, frame_id, &second);
+	ASSERT_NE(NO_ERROR, status);
+
+	/* but the pinned data is intact */
+	status = frame_store_release_frame(frame_store, frame);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_data(
+		frame_store, 
+		frame, 
+		&video, 
+		&depth, 
+		&meta_data, 
+		&timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)7, timestamp);
+	ASSERT_EQ(0, memcmp(video, _video_frame, _video_size));
+	ASSERT_EQ(0, memcmp(depth, _depth_frame, _depth_size));
+	ASSERT_EQ(0, memcmp(meta_data, &meta, _meta_size));
+
+	/* the last release returns the frame to the pool */
+	status = frame_store_release_frame(frame_store, frame);
+	ASSERT_EQ(NO_ERROR, status);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, CaptureInPlace) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	timestamp_t timestamp = 0;
+	void* video_target = NULL;
+	void* next_video_target = NULL;
+	void* depth_target = NULL;
+	void* data = NULL;
+	double meta = 1.0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* the device writes the first frame's video where the store keeps it */
+	status = frame_store_video_target(frame_store, &video_target);
+	ASSERT_EQ(NO_ERROR, status);
+	memcpy(video_target, _video_frame, _video_size);
+	status = frame_store_capture_video(frame_store, video_target, 3, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(invalid_frame_id, frame_id);
+
+	/* the next video frame goes elsewhere while the first is incomplete */
+	status = frame_store_video_target(frame_store, &next_video_target);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(video_target != next_video_target);
+	memset(next_video_target, 0x5a, _video_size);
+
+	status = frame_store_depth_target(frame_store, &depth_target);
+	ASSERT_EQ(NO_ERROR, status);
+	memcpy(depth_target, _depth_frame, _depth_size);
+	status = frame_store_capture_depth(frame_store, depth_target, 3, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 3, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((frame_id_t)0, frame_id);
+
+	/* the second frame is assembled around the data already written */
+	status = frame_store_capture_video(frame_store, next_video_target, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((frame_id_t)1, frame_id);
+
+	status = frame_store_video_frame(frame_store, 0, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(data == video_target);
+	ASSERT_EQ((timestamp_t)3, timestamp);
+	ASSERT_EQ(0, memcmp(data, _video_frame, _video_size));
+	status = frame_store_depth_frame(frame_store, 0, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, memcmp(data, _depth_frame, _depth_size));
+
+	status = frame_store_video_frame(frame_store, 1, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(data == next_video_target);
+	ASSERT_EQ((timestamp_t)4, timestamp);
+	ASSERT_EQ(0x5a, ((unsigned char*)data)[0]);
+	ASSERT_EQ(0x5a, ((unsigned char*)data)[_video_size - 1]);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, CaptureInterleaved) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_store_capture_stats_t stats;
+	frame_store_capture_stats_t before;
+	frame_id_t first_id = invalid_frame_id;
+	frame_id_t second_id = invalid_frame_id;
+	frame_id_t frame_id = invalid_frame_id;
+	timestamp_t timestamp = 0;
+	void* data = NULL;
+	static unsigned char depth[_depth_size];
+	double meta = 1.0;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* video runs a frame ahead of depth */
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 2, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 1, &first_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, first_id);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 2, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 2, &second_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, second_id);
+
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)2, count);
+	status = frame_store_depth_frame(frame_store, first_id, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)1, timestamp);
+	ASSERT_EQ(0, memcmp(data, _depth_frame, _depth_size));
+	status = frame_store_video_frame(frame_store, second_id, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)2, timestamp);
+	ASSERT_EQ(0, memcmp(data, _video_frame, _video_size));
+
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)2, stats.completed_frames);
+	ASSERT_EQ((size_t)0, stats.dropped_frames);
+	ASSERT_EQ((size_t)2, stats.late_planes);
+	ASSERT_EQ((size_t)0, stats.pending_frames);
+
+	/* depth for 3 never comes, it is dropped once 4 is complete */
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 3, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)2, stats.pending_frames);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 4, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, frame_id);
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)3, stats.completed_frames);
+	ASSERT_EQ((size_t)1, stats.dropped_frames);
+	ASSERT_EQ((size_t)0, stats.pending_frames);
+
+	/* without depth at all the oldest frames make room for newer ones */
+	for (i = 0; i < 10; i++) {
+		status = frame_store_capture_video(frame_store, (void*)_video_frame, 10 + i, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(invalid_frame_id, frame_id);
+	}
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)7, stats.dropped_frames);
+	ASSERT_EQ((size_t)4, stats.pending_frames);
+
+	/* the newest of them can still be completed */
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 19, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 19, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, frame_id);
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)10, stats.dropped_frames);
+	ASSERT_EQ((size_t)0, stats.pending_frames);
+
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)4, count);
+
+	/* each stream stamped by the device, depth 5ms behind video at 30fps:
+	 * video(t1), video(t2), depth(t1) arrive as t1, t2, t1 + 0.005 */
+	status = frame_store_set_capture_tolerance(frame_store, 1.0 / 60.0);
+	ASSERT_EQ(NO_ERROR, status);
+	memset(depth, 3, sizeof(depth));
+	status = frame_store_capture_stats(frame_store, &before);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 30.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 30.0 + 1.0 / 30.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)depth, 30.005, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 30.005, &first_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, first_id);
+	status = frame_store_capture_depth(frame_store, (void*)_depth_frame, 30.005 + 1.0 / 30.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, (void*)&meta, 30.005 + 1.0 / 30.0, &second_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_NE(invalid_frame_id, second_id);
+
+	/* the first frame has its own depth and the timestamp of its video */
+	status = frame_store_depth_frame(frame_store, first_id, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)30.0, timestamp);
+	ASSERT_EQ(0, memcmp(data, depth, _depth_size));
+	status = frame_store_depth_frame(frame_store, second_id, &data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)(30.0 + 1.0 / 30.0), timestamp);
+	ASSERT_EQ(0, memcmp(data, _depth_frame, _depth_size));
+
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(before.completed_frames + 2, stats.completed_frames);
+	ASSERT_EQ(before.dropped_frames, stats.dropped_frames);
+	ASSERT_EQ(before.late_planes + 2, stats.late_planes);
+	ASSERT_EQ((size_t)0, stats.pending_frames);
+
+	/* depth more than half a frame from any video starts a frame of its own */
+	status = frame_store_capture_video(frame_store, (void*)_video_frame, 31.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, (void*)depth, 31.02, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)2, stats.pending_frames);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, StaleFrameId) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t removed = invalid_frame_id;
+	frame_id_t frame_id = invalid_frame_id;
+	timestamp_t timestamp = 0;
+	void* data = NULL;
+	double meta = 1.0;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*512, /* half a gigabyte */
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* capture and remove many frames, keeping at most one alive */
+	for (i = 0; i < 1000; i++) {
+		status = frame_store_capture_video(frame_store, (void*)_video_frame, i, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, (void*)_depth_frame, i, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, (void*)&meta, i, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_NE(frame_id, invalid_frame_id);
+
+		if (invalid_frame_id != removed) {
+			/* the new frame reuses the slot but not the id */
+			ASSERT_NE(removed, frame_id);
+			status = frame_store_video_frame(frame_store, removed, &data, &timestamp);
+			ASSERT_NE(NO_ERROR, status);
+			status = frame_store_acquire_frame(frame_store, removed, &frame);
+			ASSERT_NE(NO_ERROR, status);
+			status = frame_store_remove_frame(frame_store, removed);
+			ASSERT_NE(NO_ERROR, status);
+		}
+
+		status = frame_store_video_frame(frame_store, frame_id, &data, &timestamp);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ((timestamp_t)i, timestamp);
+
+		status = frame_store_remove_frame(frame_store, frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		removed = frame_id;
+	}
+
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, count);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Planar) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_ids[10];
+	timestamp_t timestamp = 0;
+	unsigned char video[_video_size];
+	unsigned char depth[_depth_size];
+	void* video_data = NULL;
+	void* depth_data = NULL;
+	void* meta_data = NULL;
+	void* target = NULL;
+	double meta = 0.0;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024*64,
+		FRAME_STORE_PLANAR,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	for (i = 0; i < 10; i++) {
+		memset(video, (int)i, _video_size);
+		memset(depth, (int)(100 + i), _depth_size);
+		meta = (double)i;
+		status = frame_store_capture_video(frame_store, video, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		/* in place capture works for planes in their own pools too */
+		status = frame_store_depth_target(frame_store, &target);
+		ASSERT_EQ(NO_ERROR, status);
+		memcpy(target, depth, _depth_size);
+		status = frame_store_capture_depth(frame_store, target, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, &meta, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_NE(invalid_frame_id, frame_ids[i]);
+	}
+
+	for (i = 0; i < 10; i++) {
+		memset(video, (int)i, _video_size);
+		memset(depth, (int)(100 + i), _depth_size);
+		meta = (double)i;
+
+		status = frame_store_video_frame(frame_store, frame_ids[i], &video_data, &timestamp);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ((timestamp_t)i, timestamp);
+		ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+		status = frame_store_depth_frame(frame_store, frame_ids[i], &depth_data, &timestamp);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+		status = frame_store_meta_frame(frame_store, frame_ids[i], &meta_data, &timestamp);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(0, memcmp(&meta, meta_data, _meta_size));
+
+		status = frame_store_acquire_frame(frame_store, frame_ids[i], &frame);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+		ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+		status = frame_store_release_frame(frame_store, frame);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	status = frame_store_remove_frames(frame_store, 10, frame_ids);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_count(frame_store, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, count);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Compressed) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_ids[10];
+	unsigned char video[_video_size];
+	unsigned char depth[_depth_size];
+	void* video_data = NULL;
+	void* depth_data = NULL;
+	timestamp_t timestamp = 0;
+	frame_store_compression_stats_t stats;
+	bool_t shrunk = FALSE;
+	double meta = 0.0;
+	size_t i = 0;
+
+	/* video has to be RGB */
+	status = frame_store_create(
+		_video_size + 1,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* grey video survives the chroma subsampling unchanged */
+	for (i = 0; i < 10; i++) {
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		meta = (double)i;
+		status = frame_store_capture_video(frame_store, video, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, depth, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, &meta, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	/* a pinned frame keeps its planes until it is shrunk */
+	status = frame_store_acquire_frame(frame_store, frame_ids[0], &frame);
+	ASSERT_EQ(NO_ERROR, status);
+	for (i = 0; i < 10; i++) {
+		status = frame_store_compress_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	status = frame_store_shrink_frame(frame_store, frame_ids[0], &shrunk);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(FALSE, shrunk);
+	status = frame_store_release_frame(frame_store, frame);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_shrink_frame(frame_store, frame_ids[0], &shrunk);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(TRUE, shrunk);
+
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)10, stats.compressed_frames);
+	ASSERT_EQ((size_t)10 * (_video_size + _depth_size), stats.raw_bytes);
+	ASSERT_LT(stats.compressed_bytes, stats.raw_bytes);
+	ASSERT_EQ((size_t)10, stats.encoded_frames);
+
+	for (i = 0; i < 10; i++) {
+		status = frame_store_video_frame(frame_store, frame_ids[i], &video_data, &timestamp);
+		ASSERT_EQ(ERR_EMPTY, status);
+		status = frame_store_acquire_frame(frame_store, frame_ids[i], &frame);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(NULL, video_data);
+		ASSERT_EQ(NULL, depth_data);
+
+		status = frame_store_expand_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+		ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+		status = frame_store_release_frame(frame_store, frame);
+		ASSERT_EQ(NO_ERROR, status);
+
+		status = frame_store_shrink_frame(frame_store, frame_ids[i], &shrunk);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(TRUE, shrunk);
+	}
+
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)10, stats.decoded_frames);
+
+	status = frame_store_remove_frames(frame_store, 10, frame_ids);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, stats.compressed_frames);
+	ASSERT_EQ((size_t)0, stats.compressed_bytes);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Spill) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_ids[10];
+	unsigned char video[_video_size];
+	unsigned char depth[_depth_size];
+	void* video_data = NULL;
+	void* depth_data = NULL;
+	frame_store_compression_stats_t stats;
+	char path[] = "/tmp/test_frame_store_spill_XXXXXX";
+	double meta = 0.0;
+	size_t i = 0;
+	int fd = -1;
+
+	fd = mkstemp(path);
+	ASSERT_LE(0, fd);
+	close(fd);
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* too small for a single segment */
+	status = frame_store_enable_spill(frame_store, path, 1024);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+	status = frame_store_enable_spill(frame_store, path, 1024*1024*64);
+	ASSERT_EQ(NO_ERROR, status);
+	/* the file only lives as long as the store */
+	ASSERT_NE(0, access(path, F_OK));
+
+	for (i = 0; i < 10; i++) {
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		meta = (double)i;
+		status = frame_store_capture_video(frame_store, video, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, depth, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, &meta, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	/* only compressed frames can be spilled */
+	status = frame_store_spill_frame(frame_store, frame_ids[0]);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+
+	for (i = 0; i < 10; i++) {
+		status = frame_store_compress_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_spill_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		/* spilling twice does nothing */
+		status = frame_store_spill_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)10, stats.compressed_frames);
+	ASSERT_EQ((size_t)10, stats.spilled_frames);
+	ASSERT_EQ(stats.compressed_bytes, stats.spilled_bytes);
+
+	for (i = 0; i < 10; i++) {
+		status = frame_store_prefetch_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_expand_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_acquire_frame(frame_store, frame_ids[i], &frame);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+		ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+		status = frame_store_release_frame(frame_store, frame);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	status = frame_store_remove_frames(frame_store, 10, frame_ids);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, stats.spilled_frames);
+	ASSERT_EQ((size_t)0, stats.spilled_bytes);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Restore) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	unsigned char video[_video_size];
+	unsigned char depth[_depth_size];
+	const void* compressed = NULL;
+	unsigned char* archived = NULL;
+	void* video_data = NULL;
+	void* depth_data = NULL;
+	void* meta_data = NULL;
+	frame_store_compression_stats_t stats;
+	timestamp_t timestamp = 0;
+	size_t size = 0;
+	double meta = 7.0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	memset(video, 40, _video_size);
+	memset(depth, 3, _depth_size);
+	status = frame_store_capture_video(frame_store, video, 5, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, depth, 5, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, &meta, 5, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_compressed_frame(frame_store, frame_id, &compressed, &size, &timestamp);
+	ASSERT_EQ(ERR_EMPTY, status);
+	status = frame_store_compress_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compressed_frame(frame_store, frame_id, &compressed, &size, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)5, timestamp);
+
+	/* what an archive would hold */
+	archived = (unsigned char*)malloc(size);
+	memcpy(archived, compressed, size);
+	status = frame_store_remove_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_restore_frame(frame_store, archived, 1, &meta, 5, &frame_id);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+	status = frame_store_restore_frame(frame_store, archived, size, &meta, 5, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)1, stats.compressed_frames);
+	ASSERT_EQ((size_t)1, stats.spilled_frames);
+
+	status = frame_store_meta_frame(frame_store, frame_id, &meta_data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((timestamp_t)5, timestamp);
+	ASSERT_EQ(0, memcmp(&meta, meta_data, _meta_size));
+
+	status = frame_store_expand_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_acquire_frame(frame_store, frame_id, &frame);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+	ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+
+	/* the data stays the caller's */
+	status = frame_store_remove_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_release_frame(frame_store, frame);
+	ASSERT_EQ(NO_ERROR, status);
+	free(archived);
+
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, stats.compressed_frames);
+	ASSERT_EQ((size_t)0, stats.spilled_frames);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, TimeIndex) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_id_t frame_ids[10];
+	frame_id_t frame_id = invalid_frame_id;
+	void* cursor = NULL;
+	double meta = 0.0;
+	size_t count = 0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_INTERLEAVED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_find_by_time(frame_store, 100.0, &frame_id);
+	ASSERT_EQ(ERR_EMPTY, status);
+
+	/* frames at 10, 20, ... 100 */
+	for (i = 0; i < 10; i++) {
+		status = frame_store_capture_video(frame_store, _video_frame, 10.0 * (i + 1), &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, _depth_frame, 10.0 * (i + 1), &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, &meta, 10.0 * (i + 1), &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	status = frame_store_find_by_time(frame_store, 5.0, &frame_id);
+	ASSERT_EQ(ERR_EMPTY, status);
+	status = frame_store_find_by_time(frame_store, 10.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(frame_ids[0], frame_id);
+	status = frame_store_find_by_time(frame_store, 55.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(frame_ids[4], frame_id);
+	status = frame_store_find_by_time(frame_store, 1000.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(frame_ids[9], frame_id);
+
+	/* newest first */
+	i = 7;
+	count = 0;
+	do {
+		status = frame_store_enumerate_by_time(frame_store, 25.0, 80.0, &cursor, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		if (NULL != cursor) {
+			ASSERT_EQ(frame_ids[i], frame_id);
+			i--;
+			count++;
+		}
+	} while (NULL != cursor);
+	ASSERT_EQ((size_t)6, count);
+
+	/* removed frames leave the index */
+	status = frame_store_remove_frame(frame_store, frame_ids[4]);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_remove_frames(frame_store, 2, &frame_ids[8]);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_find_by_time(frame_store, 55.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(frame_ids[3], frame_id);
+	status = frame_store_find_by_time(frame_store, 1000.0, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(frame_ids[7], frame_id);
+
+	count = 0;
+	do {
+		status = frame_store_enumerate_by_time(frame_store, 0.0, 1000.0, &cursor, &frame_id);
+		ASSERT_EQ(NO_ERROR, status);
+		if (NULL != cursor) {
+			count++;
+		}
+	} while (NULL != cursor);
+	ASSERT_EQ((size_t)7, count);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Previews) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	unsigned short depth[_width * _height];
+	unsigned char video[_video_size];
+	unsigned short* depth_preview = NULL;
+	unsigned char* video_preview = NULL;
+	unsigned short* depth_data = NULL;
+	timestamp_t timestamp = 0;
+	size_t width = 0;
+	size_t height = 0;
+	double meta = 0.0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_preview_size(frame_store, FRAME_STORE_PREVIEW_HALF, &width, &height);
+	ASSERT_EQ(ERR_EMPTY, status);
+	/* the sizes have to match the frames */
+	status = frame_store_enable_previews(frame_store, _width, _height * 2);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+	status = frame_store_enable_previews(frame_store, _width, _height);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_preview_size(frame_store, FRAME_STORE_PREVIEW_QUARTER, &width, &height);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)1, width);
+	ASSERT_EQ((size_t)1, height);
+
+	/* depth 100 + x + 10 * y, with no reading for the top left block */
+	for (i = 0; i < _width * _height; i++) {
+		depth[i] = (unsigned short)(100 + (i % _width) + 10 * (i / _width));
+	}
+	depth[0] = 0;
+	depth[1] = 0;
+	depth[_width] = 0;
+	depth[_width + 1] = 0;
+	for (i = 0; i < _video_size; i++) {
+		video[i] = (unsigned char)(4 * (i / 3));
+	}
+	status = frame_store_capture_video(frame_store, video, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, depth, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, &meta, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_preview_frame(frame_store, frame_id, FRAME_STORE_PREVIEW_HALF, (void**)&video_preview, (void**)&depth_preview);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, depth_preview[0]);
+	ASSERT_EQ(102, depth_preview[1]);
+	ASSERT_EQ(120, depth_preview[2]);
+	ASSERT_EQ(122, depth_preview[3]);
+	/* the average of pixels 0, 1, 4 and 5 */
+	ASSERT_EQ(10, video_preview[0]);
+	ASSERT_EQ(10, video_preview[2]);
+
+	status = frame_store_preview_frame(frame_store, frame_id, FRAME_STORE_PREVIEW_QUARTER, (void**)&video_preview, (void**)&depth_preview);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(102, depth_preview[0]);
+	ASSERT_EQ(30, video_preview[0]);
+
+	/* depth changed in place shows once the previews are made again */
+	status = frame_store_depth_frame(frame_store, frame_id, (void**)&depth_data, &timestamp);
+	ASSERT_EQ(NO_ERROR, status);
+	depth_data[_width + 1] = 7;
+	status = frame_store_update_previews(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_preview_frame(frame_store, frame_id, FRAME_STORE_PREVIEW_HALF, (void**)&video_preview, (void**)&depth_preview);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(7, depth_preview[0]);
+	ASSERT_EQ(102, depth_preview[1]);
+	ASSERT_EQ(10, video_preview[0]);
+
+	/* previews go with the planes */
+	status = frame_store_compress_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_preview_frame(frame_store, frame_id, FRAME_STORE_PREVIEW_HALF, NULL, (void**)&depth_preview);
+	ASSERT_EQ(ERR_EMPTY, status);
+	status = frame_store_update_previews(frame_store, frame_id);
+	ASSERT_EQ(ERR_EMPTY, status);
+
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Foreground) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_id = invalid_frame_id;
+	unsigned short depth[_width * _height];
+	unsigned char video[_video_size];
+	unsigned short* depth_data = NULL;
+	unsigned char* video_data = NULL;
+	double meta = 0.0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* only the top left pixel is near, the rest is the background */
+	for (i = 0; i < _width * _height; i++) {
+		depth[i] = 1000;
+	}
+	depth[0] = 100;
+	memset(video, 120, _video_size);
+	status = frame_store_capture_video(frame_store, video, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_depth(frame_store, depth, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_capture_meta(frame_store, &meta, 1, &frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_compress_foreground(frame_store, frame_id, 500);
+	ASSERT_EQ(ERR_EMPTY, status);
+	/* the sizes have to match the frames */
+	status = frame_store_enable_foreground(frame_store, _width * 2, _height, 1);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+	status = frame_store_enable_foreground(frame_store, _width, _height, 1);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compress_foreground(frame_store, frame_id, 500);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = frame_store_acquire_frame(frame_store, frame_id, &frame);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_expand_frame(frame_store, frame_id);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_frame_data(frame_store, frame, (void**)&video_data, (void**)&depth_data, NULL, NULL);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* the near pixel and those within the margin survive */
+	for (i = 0; i < _width * _height; i++) {
+		if (((i % _width) <= 1) && ((i / _width) <= 1)) {
+			ASSERT_EQ(depth[i], depth_data[i]);
+			ASSERT_EQ(120, video_data[i * 3]);
+			ASSERT_EQ(120, video_data[i * 3 + 2]);
+		}
+		else {
+			ASSERT_EQ(0, depth_data[i]);
+			ASSERT_EQ(0, video_data[i * 3]);
+			ASSERT_EQ(0, video_data[i * 3 + 2]);
+		}
+	}
+
+	status = frame_store_release_frame(frame_store, frame);
+	ASSERT_EQ(NO_ERROR, status);
+	frame_store_release(frame_store);
+}
+
+TEST(TestFrameStore, Pack) {
+	status_t status = NO_ERROR;
+	frame_store_handle_t frame_store = NULL;
+	frame_handle_t frame = NULL;
+	frame_id_t frame_ids[10];
+	frame_id_t order[10];
+	unsigned char video[_video_size];
+	unsigned char depth[_depth_size];
+	const unsigned char* data[10];
+	size_t sizes[10];
+	void* video_data = NULL;
+	void* depth_data = NULL;
+	frame_store_compression_stats_t stats;
+	bool_t shrunk = FALSE;
+	double meta = 0.0;
+	size_t i = 0;
+
+	status = frame_store_create(
+		_video_size,
+		_depth_size,
+		_meta_size,
+		1024*1024,
+		FRAME_STORE_COMPRESSED,
+		&frame_store);
+	ASSERT_EQ(NO_ERROR, status);
+
+	for (i = 0; i < 10; i++) {
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		status = frame_store_capture_video(frame_store, video, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_depth(frame_store, depth, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_capture_meta(frame_store, &meta, i, &frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_compress_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		/* played backwards */
+		order[9 - i] = frame_ids[i];
+	}
+
+	status = frame_store_pack_frames(frame_store, 10, order);
+	ASSERT_EQ(NO_ERROR, status);
+	for (i = 0; i < 10; i++) {
+		status = frame_store_compressed_frame(frame_store, order[i], (const void**)&data[i], &sizes[i], NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		if (i > 0) {
+			ASSERT_EQ(data[i - 1] + sizes[i - 1], data[i]);
+		}
+	}
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)10, stats.packed_frames);
+
+	/* packing what is left again frees the first allocation with it */
+	status = frame_store_remove_frames(frame_store, 5, frame_ids);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_pack_frames(frame_store, 5, &frame_ids[5]);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)5, stats.packed_frames);
+	status = frame_store_pack_frames(frame_store, 5, frame_ids);
+	ASSERT_NE(NO_ERROR, status);
+
+	for (i = 5; i < 10; i++) {
+		status = frame_store_acquire_frame(frame_store, frame_ids[i], &frame);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_expand_frame(frame_store, frame_ids[i]);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_frame_data(frame_store, frame, &video_data, &depth_data, NULL, NULL);
+		ASSERT_EQ(NO_ERROR, status);
+		memset(video, (int)(10 * i), _video_size);
+		memset(depth, (int)i, _depth_size);
+		ASSERT_EQ(0, memcmp(video, video_data, _video_size));
+		ASSERT_EQ(0, memcmp(depth, depth_data, _depth_size));
+		status = frame_store_release_frame(frame_store, frame);
+		ASSERT_EQ(NO_ERROR, status);
+		status = frame_store_shrink_frame(frame_store, frame_ids[i], &shrunk);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	status = frame_store_remove_frames(frame_store, 5, &frame_ids[5]);
+	ASSERT_EQ(NO_ERROR, status);
+	status = frame_store_compression_stats(frame_store, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)0, stats.packed_frames);
+
+	frame_store_release(frame_store);
+}
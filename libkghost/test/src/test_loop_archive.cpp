@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "loop_archive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const size_t _frame_count = 3;
+
+static void _archive_path(char* path, size_t size) {
+	snprintf(path, size, "/tmp/test_loop_archive_%d.kgl", (int)getpid());
+}
+
+TEST(LoopArchive, WriteOpen) {
+	status_t status = NO_ERROR;
+	loop_archive_writer_handle_t writer = NULL;
+	loop_archive_handle_t archive = NULL;
+	loop_archive_info_t info;
+	unsigned char frames[_frame_count][100];
+	const void* data = NULL;
+	size_t size = 0;
+	timestamp_t timestamp = 0;
+	float cutoff = 0.0f;
+	char path[256];
+	size_t i = 0;
+
+	_archive_path(path, sizeof(path));
+	status = loop_archive_writer_create(path, 300, 200, _frame_count, &writer);
+	ASSERT_EQ(NO_ERROR, status);
+	for (i = 0; i < _frame_count; i++) {
+		memset(frames[i], (int)i, sizeof(frames[i]));
+		status = loop_archive_writer_add_frame(
+			writer, 
+			frames[i], 
+			50 + i, 
+			(timestamp_t)(10 + i), 
+			(float)i);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	status = loop_archive_writer_add_frame(writer, frames[0], 1, 0.0, 0.0f);
+	ASSERT_EQ(ERR_RANGE_ERROR, status);
+
+	status = loop_archive_writer_set_presence(writer, 0.25);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* nothing under the real name until it is finished */
+	ASSERT_NE(0, access(path, F_OK));
+	status = loop_archive_writer_finish(writer);
+	ASSERT_EQ(NO_ERROR, status);
+	loop_archive_writer_release(writer);
+	ASSERT_EQ(0, access(path, F_OK));
+
+	status = loop_archive_open(path, &archive);
+	ASSERT_EQ(NO_ERROR, status);
+	status = loop_archive_info(archive, &info);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((unsigned)LOOP_ARCHIVE_VERSION, info.version);
+	ASSERT_EQ((size_t)300, info.video_bytes);
+	ASSERT_EQ((size_t)200, info.depth_bytes);
+	ASSERT_EQ(_frame_count, info.frame_count);
+	ASSERT_EQ((size_t)(50 + 51 + 52), info.data_bytes);
+	ASSERT_EQ(10.0, info.first_timestamp);
+	ASSERT_EQ(12.0, info.last_timestamp);
+	ASSERT_EQ(0.25, info.presence);
+
+	for (i = 0; i < _frame_count; i++) {
+		status = loop_archive_frame(archive, i, &data, &size, &timestamp, &cutoff);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(50 + i, size);
+		ASSERT_EQ((timestamp_t)(10 + i), timestamp);
+		ASSERT_EQ((float)i, cutoff);
+		ASSERT_EQ(0, memcmp(frames[i], data, size));
+	}
+	status = loop_archive_frame(archive, _frame_count, &data, &size, NULL, NULL);
+	ASSERT_EQ(ERR_RANGE_ERROR, status);
+	loop_archive_release(archive);
+
+	/* a damaged file is refused */
+	ASSERT_EQ(0, truncate(path, 200));
+	status = loop_archive_open(path, &archive);
+	ASSERT_EQ(ERR_UNSUPPORTED_FORMAT, status);
+
+	unlink(path);
+}
+
+TEST(LoopArchive, Unfinished) {
+	status_t status = NO_ERROR;
+	loop_archive_writer_handle_t writer = NULL;
+	loop_archive_handle_t archive = NULL;
+	unsigned char frame[10] = {0};
+	char path[256];
+	char temp_path[300];
+
+	_archive_path(path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+	status = loop_archive_writer_create(path, 300, 200, 2, &writer);
+	ASSERT_EQ(NO_ERROR, status);
+	status = loop_archive_writer_add_frame(writer, frame, sizeof(frame), 0.0, 0.0f);
+	ASSERT_EQ(NO_ERROR, status);
+	/* a frame short */
+	status = loop_archive_writer_finish(writer);
+	ASSERT_EQ(ERR_RANGE_ERROR, status);
+	ASSERT_EQ(0, access(temp_path, F_OK));
+	loop_archive_writer_release(writer);
+	ASSERT_NE(0, access(temp_path, F_OK));
+	ASSERT_NE(0, access(path, F_OK));
+
+	status = loop_archive_open(path, &archive);
+	ASSERT_EQ(ERR_IO_ERROR, status);
+}
@@ -1,6 +1,8 @@
 #include "gtest/gtest.h"
 #include "memory_pool.h"
 #include "unistd.h"
+#include <string.h>
+#include <stdlib.h>
 
 TEST(MemoryPoolTest, CreateRelease) {
 	status_t err = NO_ERROR;
@@ -12,6 +14,7 @@ TEST(MemoryPoolTest, CreateRelease) {
 		32,
 		1024 * 1024,
 		1000,
+		MEMORY_POOL_MALLOC,
 		&pool);
 	ASSERT_EQ(NO_ERROR, err);
 	ASSERT_TRUE(NULL != pool);
@@ -33,6 +36,7 @@ TEST(MemoryPoolTest, ClaimUnclaim) {
 		32,
 		256 * 1024,
 		10,
+		MEMORY_POOL_MALLOC,
 		&pool);
 	ASSERT_EQ(NO_ERROR, err);
 	ASSERT_TRUE(NULL != pool);
@@ -64,3 +68,345 @@ TEST(MemoryPoolTest, ClaimUnclaim) {
 	ASSERT_EQ(NO_ERROR, err);
 }
 
+TEST(MemoryPoolTest, UnclaimInvalid) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	memory_pool_handle_t other_pool = NULL;
+	memory_pool_handle_t arena_pool = NULL;
+	void* data = NULL;
+	void* other_data = NULL;
+	void* arena_data = NULL;
+	char* heap = NULL;
+	char foreign[64];
+
+	err = memory_pool_create(
+		1024,
+		4,
+		8,
+		64 * 1024,
+		1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_create(
+		1024,
+		4,
+		8,
+		64 * 1024,
+		1000,
+		MEMORY_POOL_MALLOC,
+		&other_pool);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_create(
+		1024,
+		4,
+		8,
+		64 * 1024,
+		1000,
+		MEMORY_POOL_ARENA,
+		&arena_pool);
+	ASSERT_EQ(NO_ERROR, err);
+
+	err = memory_pool_claim(pool, &data);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_claim(other_pool, &other_data);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_claim(arena_pool, &arena_data);
+	ASSERT_EQ(NO_ERROR, err);
+
+	/* pointers that did not come from this pool */
+	memset(foreign, 0, sizeof(foreign));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, (void*)&foreign[32]));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, other_data));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, (char*)data + 8));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, arena_data));
+
+	/* nothing in front of a foreign allocation may be read */
+	heap = (char*)malloc(16);
+	ASSERT_TRUE(NULL != heap);
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, heap));
+
+	/* the arena backend checks range and alignment */
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, (void*)&foreign[32]));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, heap));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, data));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, (char*)arena_data + 8));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, (char*)arena_data - 64));
+	EXPECT_NE(
+		NO_ERROR, 
+		memory_pool_unclaim(arena_pool, (char*)arena_data + 64 * 1024 * 1024));
+	free(heap);
+
+	/* double unclaim */
+	EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, data));
+
+	EXPECT_EQ(NO_ERROR, memory_pool_unclaim(other_pool, other_data));
+	EXPECT_EQ(NO_ERROR, memory_pool_unclaim(arena_pool, arena_data));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(arena_pool, arena_data));
+
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_release(other_pool);
+	ASSERT_EQ(NO_ERROR, err);
+	err = memory_pool_release(arena_pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
+
+
+TEST(MemoryPoolTest, LowWatermarkRefill) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	void* data[16];
+	size_t claimed = 0;
+	size_t attempts = 0;
+	size_t i = 0;
+
+	/* a period long enough that only the low watermark can trigger refill */
+	err = memory_pool_create(
+		1024,
+		2,
+		4,
+		64 * 1024,
+		10 * 1000 * 1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+
+	/* claim well past the initial reserve, retrying while it refills */
+	while ((claimed < 16) && (attempts < 1000)) {
+		if (NO_ERROR == memory_pool_claim(pool, &data[claimed])) {
+			claimed++;
+		}
+		else {
+			usleep(1000);
+		}
+		attempts++;
+	}
+	ASSERT_EQ((size_t)16, claimed);
+
+	for (i = 0; i < claimed; i++) {
+		EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data[i]));
+	}
+
+	/* release must not wait out the period */
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
+
+TEST(MemoryPoolTest, EmptyClaimCount) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	void* data[3];
+	size_t empty_claims = 0;
+
+	/* room for exactly two chunks */
+	err = memory_pool_create(
+		1024,
+		2,
+		2,
+		2 * 1024,
+		1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+
+	err = memory_pool_empty_claim_count(pool, &empty_claims);
+	ASSERT_EQ(NO_ERROR, err);
+	EXPECT_EQ((size_t)0, empty_claims);
+
+	ASSERT_EQ(NO_ERROR, memory_pool_claim(pool, &data[0]));
+	ASSERT_EQ(NO_ERROR, memory_pool_claim(pool, &data[1]));
+	EXPECT_EQ(ERR_EMPTY, memory_pool_claim(pool, &data[2]));
+	EXPECT_EQ(ERR_EMPTY, memory_pool_claim(pool, &data[2]));
+
+	err = memory_pool_empty_claim_count(pool, &empty_claims);
+	ASSERT_EQ(NO_ERROR, err);
+	EXPECT_EQ((size_t)2, empty_claims);
+
+	EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data[0]));
+	EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data[1]));
+
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
+
+TEST(MemoryPoolTest, Arena) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	unsigned int flags[2] = {MEMORY_POOL_ARENA, MEMORY_POOL_HUGE_PAGES};
+	void* data[16];
+	size_t i = 0;
+	size_t j = 0;
+
+	for (i = 0; i < 2; i++) {
+		err = memory_pool_create(
+			1000,
+			16,
+			16,
+			16 * 1000,
+			1000,
+			flags[i],
+			&pool);
+		ASSERT_EQ(NO_ERROR, err);
+
+		/* the whole arena is usable and chunks do not overlap */
+		for (j = 0; j < 16; j++) {
+			ASSERT_EQ(NO_ERROR, memory_pool_claim(pool, &data[j]));
+			memset(data[j], (int)j, 1000);
+		}
+		EXPECT_EQ(ERR_EMPTY, memory_pool_claim(pool, &data[0]));
+		for (j = 0; j < 16; j++) {
+			EXPECT_EQ((char)j, ((char*)data[j])[0]);
+			EXPECT_EQ((char)j, ((char*)data[j])[999]);
+		}
+
+		EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, (char*)data[3] + 64));
+		for (j = 0; j < 16; j++) {
+			EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data[j]));
+		}
+
+		err = memory_pool_release(pool);
+		ASSERT_EQ(NO_ERROR, err);
+	}
+}
+
+TEST(MemoryPoolTest, ClaimUnclaimBatch) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	void* data[16];
+	void* more[4];
+	void* single = NULL;
+	size_t i = 0;
+	size_t j = 0;
+
+	/* room for exactly sixteen chunks */
+	err = memory_pool_create(
+		1024,
+		16,
+		16,
+		16 * 1024,
+		1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+
+	err = memory_pool_claim_batch(pool, 12, data);
+	ASSERT_EQ(NO_ERROR, err);
+	for (i = 0; i < 12; i++) {
+		ASSERT_TRUE(NULL != data[i]);
+		for (j = 0; j < i; j++) {
+			ASSERT_TRUE(data[i] != data[j]);
+		}
+	}
+
+	/* a batch that cannot be filled claims nothing */
+	err = memory_pool_claim_batch(pool, 5, &data[12]);
+	EXPECT_EQ(ERR_EMPTY, err);
+	err = memory_pool_claim_batch(pool, 4, &data[12]);
+	ASSERT_EQ(NO_ERROR, err);
+	EXPECT_EQ(ERR_EMPTY, memory_pool_claim(pool, &single));
+
+	/* invalid entries are reported, the rest are still unclaimed */
+	more[0] = data[0];
+	more[1] = data[1];
+	more[2] = data[0];
+	more[3] = NULL;
+	err = memory_pool_unclaim_batch(pool, 4, more);
+	EXPECT_NE(NO_ERROR, err);
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, data[0]));
+	EXPECT_NE(NO_ERROR, memory_pool_unclaim(pool, data[1]));
+
+	err = memory_pool_unclaim_batch(pool, 14, &data[2]);
+	EXPECT_EQ(NO_ERROR, err);
+
+	/* everything is back */
+	err = memory_pool_claim_batch(pool, 16, data);
+	EXPECT_EQ(NO_ERROR, err);
+	err = memory_pool_unclaim_batch(pool, 16, data);
+	EXPECT_EQ(NO_ERROR, err);
+
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
+
+typedef struct pressure_data_s {
+	void* data[8];
+	volatile size_t claimed;
+	volatile size_t shortfall;
+	volatile size_t calls;
+} pressure_data_t;
+
+static void _pressure_cb(
+	memory_pool_handle_t pool, 
+	size_t shortfall_chunks, 
+	void* user_data)
+{
+	pressure_data_t* p_data = (pressure_data_t*)user_data;
+
+	/* give back the oldest chunks to cover the shortfall */
+	p_data->shortfall = shortfall_chunks;
+	p_data->calls++;
+	while ((shortfall_chunks > 0) && (p_data->claimed > 0)) {
+		p_data->claimed--;
+		memory_pool_unclaim(pool, p_data->data[p_data->claimed]);
+		shortfall_chunks--;
+	}
+}
+
+TEST(MemoryPoolTest, PressureCallback) {
+	status_t err = NO_ERROR;
+	memory_pool_handle_t pool = NULL;
+	pressure_data_t data;
+	size_t i = 0;
+
+	memset(&data, 0, sizeof(data));
+
+	/* room for exactly eight chunks */
+	err = memory_pool_create(
+		1024,
+		8,
+		8,
+		8 * 1024,
+		1000 * 1000,
+		MEMORY_POOL_MALLOC,
+		&pool);
+	ASSERT_EQ(NO_ERROR, err);
+
+	/* no pressure until fewer than three chunks are left */
+	err = memory_pool_set_pressure_callback(pool, 3, &_pressure_cb, &data);
+	ASSERT_EQ(NO_ERROR, err);
+	for (i = 0; i < 5; i++) {
+		ASSERT_EQ(NO_ERROR, memory_pool_claim(pool, &data.data[i]));
+		data.claimed++;
+	}
+	usleep(50 * 1000);
+	EXPECT_EQ((size_t)0, data.calls);
+
+	/* remove the callback so it cannot race the claims below */
+	err = memory_pool_set_pressure_callback(pool, 0, NULL, NULL);
+	ASSERT_EQ(NO_ERROR, err);
+	for (i = 5; i < 7; i++) {
+		ASSERT_EQ(NO_ERROR, memory_pool_claim(pool, &data.data[i]));
+		data.claimed++;
+	}
+
+	/* one chunk left, so the callback is asked for two */
+	err = memory_pool_set_pressure_callback(pool, 3, &_pressure_cb, &data);
+	ASSERT_EQ(NO_ERROR, err);
+	for (i = 0; (i < 100) && (0 == data.calls); i++) {
+		usleep(10 * 1000);
+	}
+	err = memory_pool_set_pressure_callback(pool, 0, NULL, NULL);
+	ASSERT_EQ(NO_ERROR, err);
+	EXPECT_EQ((size_t)1, data.calls);
+	EXPECT_EQ((size_t)2, data.shortfall);
+	EXPECT_EQ((size_t)5, data.claimed);
+
+	for (i = 0; i < data.claimed; i++) {
+		EXPECT_EQ(NO_ERROR, memory_pool_unclaim(pool, data.data[i]));
+	}
+
+	err = memory_pool_release(pool);
+	ASSERT_EQ(NO_ERROR, err);
+}
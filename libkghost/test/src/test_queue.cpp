@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+#include "common.h"
+#include "queue.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+static const size_t _element_count = 100000;
+
+static void* _push_thread(void* data) {
+	queue_handle_t queue = (queue_handle_t)data;
+	size_t value = 0;
+
+	for (value = 0; value < _element_count; ) {
+		if (NO_ERROR == queue_push(queue, &value)) {
+			value++;
+		}
+		else {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+TEST(QueueTest, CreateRelease) {
+	status_t status = NO_ERROR;
+	queue_handle_t queue = NULL;
+
+	status = queue_create(0, sizeof(int), &queue);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+	status = queue_create(1, sizeof(int), &queue);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(queue != NULL);
+	queue_release(queue);
+}
+
+TEST(QueueTest, QueueBasic) {
+	status_t status = NO_ERROR;
+	queue_handle_t queue = NULL;
+	int element = 0;
+	size_t count = 0;
+	int i = 0;
+
+	status = queue_create(4, sizeof(int), &queue);
+	ASSERT_EQ(NO_ERROR, status);
+
+	status = queue_pop(queue, &element);
+	ASSERT_EQ(ERR_EMPTY, status);
+
+	/* first in, first out, and nothing is overwritten when full */
+	for (i = 0; i < 4; i++) {
+		status = queue_push(queue, &i);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	status = queue_push(queue, &i);
+	ASSERT_EQ(ERR_FULL, status);
+	status = queue_count(queue, &count);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)4, count);
+
+	/* around the end of the buffer */
+	for (i = 0; i < 10; i++) {
+		status = queue_pop(queue, &element);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(i, element);
+		element = i + 4;
+		status = queue_push(queue, &element);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+	for (i = 10; i < 14; i++) {
+		status = queue_pop(queue, &element);
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(i, element);
+	}
+	status = queue_pop(queue, &element);
+	ASSERT_EQ(ERR_EMPTY, status);
+
+	queue_release(queue);
+}
+
+TEST(QueueTest, Threads) {
+	status_t status = NO_ERROR;
+	queue_handle_t queue = NULL;
+	pthread_t thread;
+	size_t expected = 0;
+	size_t value = 0;
+
+	status = queue_create(16, sizeof(size_t), &queue);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ(0, pthread_create(&thread, NULL, &_push_thread, queue));
+
+	while (expected < _element_count) {
+		status = queue_pop(queue, &value);
+		if (ERR_EMPTY == status) {
+			sched_yield();
+			continue;
+		}
+		ASSERT_EQ(NO_ERROR, status);
+		ASSERT_EQ(expected, value);
+		expected++;
+	}
+
+	pthread_join(thread, NULL);
+	queue_release(queue);
+}
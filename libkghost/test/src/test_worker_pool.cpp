@@ -0,0 +1,95 @@
+#include "gtest/gtest.h"
+#include "common.h"
+#include "worker_pool.h"
+
+#include <sched.h>
+
+static volatile int _started = 0;
+static volatile int _finish = 0;
+
+static void _count_job(void* data) {
+	__sync_fetch_and_add((volatile int*)data, 1);
+}
+
+static void _blocking_job(void* data) {
+	_started = 1;
+	while (0 == _finish) {
+		sched_yield();
+	}
+	__sync_fetch_and_add((volatile int*)data, 1);
+}
+
+TEST(WorkerPoolTest, CreateRelease) {
+	status_t status = NO_ERROR;
+	worker_pool_handle_t pool = NULL;
+
+	status = worker_pool_create(0, 1, &pool);
+	ASSERT_EQ(ERR_INVALID_ARGUMENT, status);
+	status = worker_pool_create(2, 4, &pool);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_TRUE(pool != NULL);
+	worker_pool_release(pool);
+}
+
+TEST(WorkerPoolTest, Drain) {
+	status_t status = NO_ERROR;
+	worker_pool_handle_t pool = NULL;
+	volatile int count = 0;
+	int i = 0;
+
+	status = worker_pool_create(3, 100, &pool);
+	ASSERT_EQ(NO_ERROR, status);
+	for (i = 0; i < 100; i++) {
+		status = worker_pool_submit(pool, &_count_job, (void*)&count);
+		ASSERT_EQ(NO_ERROR, status);
+	}
+
+	/* every queued job has run once release returns */
+	worker_pool_release(pool);
+	ASSERT_EQ(100, count);
+}
+
+TEST(WorkerPoolTest, Full) {
+	status_t status = NO_ERROR;
+	worker_pool_handle_t pool = NULL;
+	worker_pool_stats_t stats;
+	volatile int count = 0;
+
+	status = worker_pool_create(1, 2, &pool);
+	ASSERT_EQ(NO_ERROR, status);
+
+	/* the only thread is kept busy while the queue fills up */
+	_started = 0;
+	_finish = 0;
+	status = worker_pool_submit(pool, &_blocking_job, (void*)&count);
+	ASSERT_EQ(NO_ERROR, status);
+	while (0 == _started) {
+		sched_yield();
+	}
+	status = worker_pool_submit(pool, &_count_job, (void*)&count);
+	ASSERT_EQ(NO_ERROR, status);
+	status = worker_pool_submit(pool, &_count_job, (void*)&count);
+	ASSERT_EQ(NO_ERROR, status);
+	status = worker_pool_submit(pool, &_count_job, (void*)&count);
+	ASSERT_EQ(ERR_FULL, status);
+
+	status = worker_pool_stats(pool, &stats);
+	ASSERT_EQ(NO_ERROR, status);
+	ASSERT_EQ((size_t)3, stats.submitted_jobs);
+	ASSERT_EQ((size_t)0, stats.completed_jobs);
+
+	_finish = 1;
+	while (count < 3) {
+		sched_yield();
+	}
+	/* counted once the job has returned */
+	do {
+		status = worker_pool_stats(pool, &stats);
+		ASSERT_EQ(NO_ERROR, status);
+	} while (stats.completed_jobs < 3);
+	ASSERT_LE(stats.run_seconds, stats.latency_seconds);
+	ASSERT_LE(stats.max_latency_seconds, stats.latency_seconds);
+	ASSERT_GT(stats.max_latency_seconds, 0.0);
+
+	worker_pool_release(pool);
+}